@@ -0,0 +1,60 @@
+#include "../headers/icvast.h"
+
+// Messages per second through one channel, for a range of producer and consumer counts.
+// Usage: channel_bench [messages per run] [capacity]
+
+namespace {
+    double measure(const size_t producers, const size_t consumers, const uint64_t messages, const size_t capacity) {
+        channels::Channel<uint64_t> channel(capacity);
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> checksum{0};
+        std::vector<std::thread> threads;
+
+        const auto started = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < producers; p++) {
+            threads.emplace_back([&, p] {
+                for (uint64_t i = p; i < messages; i += producers) {
+                    channel.send(i);
+                }
+            });
+        }
+        for (size_t c = 0; c < consumers; c++) {
+            threads.emplace_back([&] {
+                uint64_t sum = 0, count = 0;
+                while (const auto value = channel.receive()) {
+                    sum += *value;
+                    count++;
+                }
+                checksum += sum;
+                received += count;
+            });
+        }
+
+        for (size_t p = 0; p < producers; p++) {
+            threads[p].join();
+        }
+        channel.close();
+        for (size_t c = producers; c < threads.size(); c++) {
+            threads[c].join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+        if (received != messages || checksum != messages * (messages - 1) / 2) {
+            std::cerr << "channel_bench: lost or duplicated messages" << std::endl;
+            std::exit(1);
+        }
+        return static_cast<double>(messages) / elapsed.count();
+    }
+}
+
+int main(const int argc, char* argv[]) {
+    const uint64_t messages = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+    const size_t capacity = argc > 2 ? std::stoul(argv[2]) : 1024;
+
+    std::cout << "capacity " << capacity << ", " << messages << " messages per run" << std::endl;
+    for (const auto &[producers, consumers] : std::array<std::pair<size_t, size_t>, 5>{{{1, 1}, {2, 2}, {4, 1}, {1, 4}, {4, 4}}}) {
+        const double rate = measure(producers, consumers, messages, capacity);
+        std::cout << producers << " producer(s) x " << consumers << " consumer(s): " << static_cast<uint64_t>(rate) << " msgs/sec" << std::endl;
+    }
+    return 0;
+}
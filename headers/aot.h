@@ -0,0 +1,380 @@
+#pragma once
+
+// Ahead-of-time compilation, behind --emit-cpp and --build.
+//
+// The entry file and every module it merges (recursively, stdlib included) are read up front and
+// their functions compiled by the tiering compiler. Each resulting program is translated to a C++
+// function that runs it instruction by instruction through tiering::Machine, with expressions
+// turned into straight-line double arithmetic for the C++ compiler to optimize. The generated
+// file also carries every source it read, so the executable --build makes from it runs without
+// them: it is the interpreter with those sources bundled and those bodies precompiled. Bodies are
+// optimized (ssa::optimize) at the -O level of the build, and the executable runs at that level.
+//
+// Top-level statements and any function the tiering compiler doesn't handle are still
+// interpreted. A precompiled body only runs when the program compiled against its first caller
+// is the one it was generated from (tiering::prepare), so names that turn out different at run
+// time fall back to the usual tiers instead of running the wrong code.
+namespace aot {
+    struct Module {
+        std::string source;
+        tiering::Table table; // What its top level declares, functions as parsed
+        std::vector<std::string> functions; // In declaration order
+    };
+
+    // A string literal holding `value`
+    inline std::string quote(const std::string &value) {
+        std::string quoted = "\"";
+        for (const char c : value) {
+            const auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            } else if (byte < 0x20 || byte >= 0x7F) {
+                char escaped[5];
+                std::snprintf(escaped, sizeof escaped, "\\%03o", byte);
+                quoted += escaped;
+            } else {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    // A raw string literal holding `value`, its delimiter picked to not occur in it
+    inline std::string raw(const std::string &value) {
+        std::string delimiter = "cvast";
+        for (int i = 0; value.find(")" + delimiter + "\"") != std::string::npos; i++) {
+            delimiter = "cvast" + std::to_string(i);
+        }
+        return "R\"" + delimiter + "(" + value + ")" + delimiter + "\"";
+    }
+
+    class Translator {
+    private:
+        std::string stdlib;
+        int level; // -O, which the executable runs with too
+        std::vector<std::string> order; // Modules in the order they were first merged
+        std::unordered_map<std::string, Module> modules;
+
+        // Read and declare the module at canonical `path`, and everything it merges
+        const tiering::Table& load(const std::string &path) {
+            if (const auto it = modules.find(path); it != modules.end()) return it->second.table;
+            Module &module = modules[path]; // Node based, stays put while merged modules are added
+            order.push_back(path);
+
+            std::ostringstream text;
+            text << modules::open(path)->rdbuf();
+            module.source = text.str();
+            std::istringstream source(module.source);
+            auto [tokens, unfilteredTokens, unfilteredLines] = Lexer(source).tokenize();
+            set_unfilteredLines(unfilteredLines);
+
+            Parser parser(std::make_shared<const std::vector<Token>>(tokens), std::make_shared<const std::vector<Token>>(unfilteredTokens), path);
+            for (const auto &statement : autoparallel::split(tokens)) {
+                const bool annotated = tokens[statement.begin].value == "@"; // `@memoize fn ...`
+                const size_t begin = statement.begin + (annotated ? 2 : 0);
+                const Token &first = tokens[begin];
+                if (first.type != TokenType::KEYWORD || begin + 1 >= tokens.size()) continue;
+                if (first.value == "fn") {
+                    int pos = static_cast<int>(statement.begin);
+                    annotated ? parser.parseAnnotation(pos) : parser.parseFunction(pos);
+                    const std::string &name = tokens[begin + 1].value;
+                    if (std::ranges::find(module.functions, name) == module.functions.end()) module.functions.push_back(name);
+                } else if (first.value == "var" || first.value == "const") {
+                    const std::string &name = tokens[begin + 1].value;
+                    module.table[name] = Variable{name, "", "", "global"};
+                } else if (first.value == "merge") {
+                    merge(tokens, statement, path, module);
+                    // Functions declared after it fold their static calls of it the way the interpreter does
+                    const std::string &alias = tokens[statement.end - 2].value;
+                    if (const auto it = module.table.find(alias); it != module.table.end()) {
+                        auto symbols = parser.getSymbolTable();
+                        symbols[alias] = it->second;
+                        parser.set_globalSymbolTable(symbols);
+                    }
+                }
+            }
+            set_filePath(path); // Merges parsed above may have moved it
+            for (const auto &[name, symbol] : parser.getSymbolTable()) {
+                if (std::holds_alternative<Function>(symbol)) module.table[name] = symbol;
+            }
+            return module.table;
+        }
+
+        // `merge "location" as alias;` or `merge stdlib@"location" as alias;`, resolved like Parser::parseMerge
+        void merge(const std::vector<Token> &tokens, const autoparallel::Statement &statement, const std::string &importer, Module &module) {
+            size_t pos = statement.begin + 1;
+            const bool fromStdlib = tokens[pos].value == "stdlib";
+            if (fromStdlib) pos += 2; // stdlib @
+            if (tokens[pos].value != "\"") return;
+            std::string location;
+            pos = autoparallel::skipString(tokens, pos, &location);
+            if (pos + 1 >= statement.end) return;
+            const std::string alias = tokens[pos + 1].value; // After `as`
+
+            std::vector<std::string> files;
+            if (!fromStdlib) {
+                if (const auto resolved = modules::index().resolve(location, importer)) files.push_back(*resolved);
+            } else if (!stdlib.empty()) {
+                if (const auto resolved = modules::index().resolveStdlib(stdlib, location)) {
+                    files = resolved->second == modules::Kind::DIRECTORY ? modules::index().moduleFiles(resolved->first) : std::vector{resolved->first};
+                }
+            }
+            tiering::Table members;
+            for (const auto &file : files) {
+                for (const auto &[name, symbol] : load(file)) members[name] = symbol;
+            }
+            module.table[alias] = Namespace{alias, std::make_shared<const tiering::Table>(std::move(members))};
+        }
+
+        // One expression as a lambda computing it in order, like Machine::evaluate
+        static std::string expression(const tiering::Program &program, const std::vector<tiering::Instruction> &code) {
+            using tiering::Op;
+            std::ostringstream out;
+            std::vector<std::string> stack;
+            int next = 0;
+            const auto push = [&](const std::string &value) {
+                const std::string name = "v" + std::to_string(next++);
+                out << " const double " << name << " = " << value << ";";
+                stack.push_back(name);
+            };
+            out << "[&] {";
+            for (const tiering::Instruction &in : code) {
+                switch (in.op) {
+                    case Op::NUMBER: {
+                        std::ostringstream bits;
+                        bits << "std::bit_cast<double>(0x" << std::hex << std::bit_cast<uint64_t>(program.numbers[in.a]) << "ull)";
+                        push(bits.str());
+                        break;
+                    }
+                    case Op::LOCAL: push("m.local(" + std::to_string(in.a) + ")"); break;
+                    case Op::FREE: push("m.freeVariable(" + std::to_string(in.b) + ")"); break;
+                    case Op::LOCAL_OR_FREE: push("m.localOrFree(" + std::to_string(in.a) + ", " + std::to_string(in.b) + ")"); break;
+                    case Op::OPERAND: out << " m.setOperand(" << in.a << ");"; break;
+                    case Op::ROUND_TRIP: {
+                        const std::string value = stack.back();
+                        stack.pop_back();
+                        push("std::stod(std::to_string(" + value + "))");
+                        break;
+                    }
+                    default: {
+                        const std::string right = stack.back();
+                        stack.pop_back();
+                        const std::string left = stack.back();
+                        stack.pop_back();
+                        const auto test = [&](const std::string &op) { return left + " " + op + " " + right + " ? 1.0 : 0.0"; };
+                        switch (in.op) {
+                            case Op::ADD: push(left + " + " + right); break;
+                            case Op::SUBTRACT: push(left + " - " + right); break;
+                            case Op::MULTIPLY: push(left + " * " + right); break;
+                            case Op::DIVIDE: push("m.quotient(" + left + ", " + right + ", " + std::to_string(in.a) + ")"); break;
+                            case Op::LESS: push(test("<")); break;
+                            case Op::GREATER: push(test(">")); break;
+                            case Op::LESS_EQUAL: push(test("<=")); break;
+                            case Op::GREATER_EQUAL: push(test(">=")); break;
+                            case Op::EQUAL: push(test("==")); break;
+                            case Op::NOT_EQUAL: push(test("!=")); break;
+                            case Op::AND: push(left + " != 0.0 && " + right + " != 0.0 ? 1.0 : 0.0"); break;
+                            case Op::OR: push(left + " != 0.0 || " + right + " != 0.0 ? 1.0 : 0.0"); break;
+                            default: break;
+                        }
+                    }
+                }
+            }
+            out << " return " << stack.back() << "; }";
+            return out.str();
+        }
+
+        // The body of `program` as a tiering::Body, one statement per instruction
+        static std::string body(const tiering::Program &program, const std::string &function) {
+            using tiering::Op;
+            std::set<int> targets;
+            for (const tiering::Instruction &in : program.code) {
+                if (in.op == Op::BRANCH || in.op == Op::BRANCH_IF || in.op == Op::JUMP) targets.insert(in.a);
+            }
+            std::ostringstream out;
+            out << "    Variable " << function << "(tiering::Machine &m) {\n";
+            for (size_t pc = 0; pc <= program.code.size(); pc++) {
+                if (targets.contains(static_cast<int>(pc))) out << "    pc" << pc << ":\n";
+                if (pc == program.code.size()) break;
+                const tiering::Instruction &in = program.code[pc];
+                out << "        ";
+                switch (in.op) {
+                    case Op::DECLARE_ARITHMETIC:
+                        out << "m.declare(" << pc << ", m.arithmetic(" << expression(program, program.expressions[in.b]) << "));\n";
+                        break;
+                    case Op::DECLARE_RESULT:
+                        out << "m.result(" << pc << ", m.arithmetic(" << expression(program, program.expressions[in.b]) << "));\n";
+                        break;
+                    case Op::RETURN_ARITHMETIC:
+                        out << "return m.returnArithmetic(" << pc << ", m.arithmetic(" << expression(program, program.expressions[in.b]) << "));\n";
+                        break;
+                    case Op::BRANCH:
+                        out << "if (!m.holds(" << expression(program, program.expressions[in.b]) << ")) goto pc" << in.a << ";\n";
+                        break;
+                    case Op::BRANCH_IF:
+                        out << "if (m.holds(" << expression(program, program.expressions[in.b]) << ")) goto pc" << in.a << ";\n";
+                        break;
+                    case Op::JUMP:
+                        out << "goto pc" << in.a << ";\n";
+                        break;
+                    case Op::RETURN:
+                    case Op::RETURN_CONSTANT:
+                    case Op::RETURN_VARIABLE:
+                    case Op::RETURN_CALL:
+                        out << "return *m.step(" << pc << ");\n";
+                        break;
+                    default:
+                        out << "m.step(" << pc << ");\n";
+                        break;
+                }
+            }
+            out << "        return m.finish();\n    }\n";
+            return out.str();
+        }
+
+    public:
+        Translator(std::string stdlib, const int level) : stdlib(std::move(stdlib)), level(level) {}
+
+        // C++ source of an executable running `entry` (a canonical path)
+        std::string translate(const std::string &entry) {
+            load(entry);
+
+            std::ostringstream functions, table;
+            size_t count = 0;
+            for (const auto &path : order) {
+                const Module &module = modules.at(path);
+                for (const auto &name : module.functions) {
+                    const Function &func = std::get<Function>(module.table.at(name));
+                    std::shared_ptr<tiering::Program> program;
+                    try {
+                        const tiering::Scope scope{nullptr, &module.table};
+                        auto kinds = tiering::survey(func, scope);
+                        const tiering::Callees callees = level >= 1 ? tiering::inlinable(kinds, scope) : tiering::Callees{};
+                        const tiering::Callees checked = level >= 1 ? tiering::signatures(kinds, scope) : tiering::Callees{};
+                        program = tiering::Compiler(func, kinds, &callees, nullptr, &checked).compile();
+                        ssa::optimize(*program, name, level, false);
+                    } catch (const tiering::Unsupported &unsupported) {
+                        functions << "    // " << name << " in " << path << " stays interpreted, " << unsupported.reason << "\n\n";
+                        continue;
+                    } catch (const ErrInfo &) {
+                        functions << "    // " << name << " in " << path << " stays interpreted, malformed body\n\n";
+                        continue;
+                    }
+                    const std::string function = "body" + std::to_string(count++);
+                    functions << "    // " << name << " in " << path << "\n" << body(*program, function) << "\n";
+                    table << "        {" << quote(path) << ", " << quote(name) << ", 0x" << std::hex << tiering::digest(*program) << std::dec << "ull, &" << function << "},\n";
+                }
+            }
+
+            std::ostringstream out;
+            out << "// Generated by " << INTERPRETER_NAME << " --emit-cpp from " << entry << ", do not edit\n"
+                << "#include \"icvast.h\"\n\n"
+                << "namespace {\n"
+                << "    // The program and every module it merges\n"
+                << "    const std::vector<std::pair<std::string, std::string>> SOURCES = {\n";
+            for (const auto &path : order) {
+                out << "        {" << quote(path) << ", " << raw(modules.at(path).source) << "},\n";
+            }
+            out << "    };\n\n"
+                << functions.str()
+                << "    const std::vector<tiering::Precompiled> FUNCTIONS = {\n" << table.str() << "    };\n"
+                << "}\n\n"
+                << "int main(const int argc, char* argv[]) {\n"
+                << "    std::signal(SIGSEGV, signalHandler);\n"
+                << "    aot::install(SOURCES, FUNCTIONS, " << quote(stdlib) << ");\n"
+                << "    std::vector<std::string> args(argv, argv + argc);\n"
+                << "    args.insert(args.begin() + 1, \"-O" << level << "\");\n"
+                << "    args.push_back(" << quote(entry) << ");\n"
+                << "    return driver::run(args);\n"
+                << "}\n";
+            return out.str();
+        }
+    };
+
+    // Called first thing by a generated executable
+    inline void install(const std::vector<std::pair<std::string, std::string>> &sources, const std::vector<tiering::Precompiled> &functions, const std::string &stdlib) {
+        for (const auto &[path, source] : sources) modules::bundle()[path] = source;
+        for (const auto &function : functions) {
+            tiering::precompiled()[std::string(function.path) + '\n' + function.name] = &function;
+        }
+        // Where the bundled stdlib modules were found, unless told otherwise
+        if (!stdlib.empty()) {
+#if defined(_WIN32)
+            if (std::getenv("CVAST_STDLIB") == nullptr) _putenv_s("CVAST_STDLIB", stdlib.c_str());
+#else
+            setenv("CVAST_STDLIB", stdlib.c_str(), 0);
+#endif
+        }
+    }
+
+    // Directory holding icvast.h, for compiling generated code: CVAST_INCLUDE, the one the build
+    // recorded, or the headers next to the stdlib in a checkout
+    inline std::optional<std::filesystem::path> includeDirectory() {
+        std::vector<std::filesystem::path> candidates;
+        if (const char* dir = std::getenv("CVAST_INCLUDE")) candidates.emplace_back(dir);
+#if defined(ICVAST_INCLUDE_DIR)
+        candidates.emplace_back(ICVAST_INCLUDE_DIR);
+#endif
+        if (const std::filesystem::path self(__FILE__); self.is_absolute()) candidates.push_back(self.parent_path());
+        if (const char* stdlib = std::getenv("CVAST_STDLIB")) candidates.push_back(std::filesystem::path(stdlib) / ".." / "headers");
+        for (const auto &candidate : candidates) {
+            std::error_code ec;
+            if (std::filesystem::is_regular_file(candidate / "icvast.h", ec)) return std::filesystem::absolute(candidate, ec).lexically_normal();
+        }
+        return std::nullopt;
+    }
+
+    inline void fail(const std::string &message) {
+        std::cerr << INTERPRETER_NAME << ": ";
+        std::cerr << "\033[31m" << "error: " << message << "\033[0m" << std::endl;
+    }
+
+    // --emit-cpp writes the translation of `input` to `cppPath`, --build also compiles it to `output`
+    inline int compile(const std::string &input, std::string cppPath, const std::string &output, const int level) {
+        std::error_code ec;
+        const auto entry = std::filesystem::weakly_canonical(input, ec);
+        if (ec || !std::filesystem::is_regular_file(entry, ec)) {
+            fail("No such input file '" + input + "'");
+            return 1;
+        }
+        const char* stdlib = std::getenv("CVAST_STDLIB");
+
+        std::string source;
+        {
+            // Declaring functions reports on stdout like a run would, keep that out of the way
+            std::ostringstream discarded;
+            auto* previous = std::cout.rdbuf(discarded.rdbuf());
+            try {
+                source = Translator(stdlib != nullptr ? std::filesystem::absolute(stdlib, ec).lexically_normal().string() : "", level).translate(entry.string());
+            } catch (...) {
+                std::cout.rdbuf(previous);
+                throw;
+            }
+            std::cout.rdbuf(previous);
+        }
+
+        if (cppPath.empty()) cppPath = output + ".cpp";
+        std::ofstream file(cppPath);
+        if (!(file << source) || !file.flush()) {
+            fail("Could not write '" + cppPath + "'");
+            return 1;
+        }
+        file.close();
+        if (output.empty()) return 0;
+
+        const auto include = includeDirectory();
+        if (!include) {
+            fail("Could not find icvast.h to build against, set CVAST_INCLUDE to its directory");
+            return 1;
+        }
+        const char* compiler = std::getenv("CXX");
+        const std::string command = std::string(compiler != nullptr ? compiler : "g++") + " -std=c++20 -O2 -pthread -I\"" + include->string() +
+                                    "\" \"" + cppPath + "\" -o \"" + output + "\"";
+        if (std::system(command.c_str()) != 0) {
+            fail("Compiling '" + cppPath + "' failed: " + command);
+            return 1;
+        }
+        return 0;
+    }
+}
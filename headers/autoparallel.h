@@ -0,0 +1,175 @@
+#pragma once
+
+// Dependency analysis behind --auto-parallel.
+//
+// The entry file's top-level statements are split up front and each one is summarized right before
+// it would run, against the symbols declared by then: the global names it may read, including
+// through the bodies of the functions it calls, and the names it declares. Two statements are
+// independent when neither declares a name the other reads or declares. Anything with an effect
+// outside the symbol table, merges, a top-level return and every extern but writescr (called
+// directly or from any function reached), is a barrier and runs alone.
+namespace autoparallel {
+    struct Statement {
+        size_t begin; // First token
+        size_t end;   // One past the last token
+    };
+
+    struct Effects {
+        std::unordered_set<std::string> reads;
+        std::unordered_set<std::string> writes;
+        bool barrier = false;
+        bool calls = false; // Calls a function: worth a task of its own, the rest runs inline
+    };
+
+    // Index of the token after the string literal whose opening quote is at `pos`, the literal's
+    // words are appended to `text`
+    inline size_t skipString(const std::vector<Token> &tokens, size_t pos, std::string *text = nullptr) {
+        for (++pos; pos < tokens.size() && tokens[pos].type != TokenType::eof; ++pos) {
+            if (tokens[pos].value == "\"" && tokens[pos - 1].value != "\\") return pos + 1;
+            if (text != nullptr) *text += tokens[pos].value;
+        }
+        return pos;
+    }
+
+    // Index of the `}` closing the first block that opens at or after `pos`
+    inline size_t blockEnd(const std::vector<Token> &tokens, size_t pos) {
+        int depth = 0;
+        while (pos < tokens.size() && tokens[pos].type != TokenType::eof) {
+            if (tokens[pos].value == "\"") {
+                pos = skipString(tokens, pos);
+                continue;
+            }
+            if (tokens[pos].value == "{") {
+                ++depth;
+            } else if (tokens[pos].value == "}" && --depth == 0) {
+                return pos;
+            }
+            ++pos;
+        }
+        return pos - 1;
+    }
+
+    // Index of the `;` ending the statement that starts at `pos`
+    inline size_t terminator(const std::vector<Token> &tokens, size_t pos) {
+        int depth = 0;
+        while (pos < tokens.size() && tokens[pos].type != TokenType::eof) {
+            if (tokens[pos].value == "\"") {
+                pos = skipString(tokens, pos);
+                continue;
+            }
+            if (tokens[pos].value == "(" || tokens[pos].value == "{") {
+                ++depth;
+            } else if (tokens[pos].value == ")" || tokens[pos].value == "}") {
+                --depth;
+            } else if (tokens[pos].value == ";" && depth <= 0) {
+                return pos;
+            }
+            ++pos;
+        }
+        return pos - 1;
+    }
+
+    // Top-level statements in the order Parser::parse() would run them
+    inline std::vector<Statement> split(const std::vector<Token> &tokens) {
+        std::vector<Statement> statements;
+        size_t pos = 0;
+        while (pos < tokens.size() && tokens[pos].type != TokenType::eof) {
+            const Token &token = tokens[pos];
+            size_t last = pos;
+            if (token.type == TokenType::KEYWORD && token.value == "fn") {
+                last = blockEnd(tokens, pos);
+            } else if (token.type == TokenType::SYMBOL && token.value == "@") {
+                last = blockEnd(tokens, pos); // `@memoize fn ...`
+            } else if (token.type == TokenType::KEYWORD && token.value == "if") {
+                last = blockEnd(tokens, pos);
+                while (last + 1 < tokens.size() && tokens[last + 1].value == "else") {
+                    last = blockEnd(tokens, last + 1);
+                }
+            } else if (token.type == TokenType::KEYWORD || token.type == TokenType::IDENTIFIER) {
+                last = terminator(tokens, pos);
+            }
+            statements.push_back({pos, last + 1});
+            pos = last + 1;
+        }
+        return statements;
+    }
+
+    // Add what tokens [begin, end) may read or do, following calls into function bodies once each
+    inline void scan(const std::vector<Token> &tokens, size_t begin, const size_t end, const std::unordered_map<std::string, SymbolInfo> &symbols,
+                     Effects &effects, std::unordered_set<const std::vector<Token>*> &visited) {
+        while (begin < end && begin < tokens.size()) {
+            const Token &token = tokens[begin];
+            if (token.value == "\"") {
+                begin = skipString(tokens, begin);
+                continue;
+            }
+            if (token.type == TokenType::KEYWORD && token.value == "merge") {
+                effects.barrier = true;
+            }
+            if (token.type == TokenType::KEYWORD && token.value == "extern" && begin + 1 < end && tokens[begin + 1].value == "\"") {
+                std::string action;
+                skipString(tokens, begin + 1, &action);
+                if (action != "writescr") effects.barrier = true; // writescr output is kept in order instead
+            }
+            if (token.type != TokenType::IDENTIFIER) {
+                ++begin;
+                continue;
+            }
+
+            effects.reads.insert(token.value);
+            const auto it = symbols.find(token.value);
+            const SymbolInfo *symbol = it == symbols.end() ? nullptr : &it->second;
+            // Follow `ns::inner::name`
+            while (symbol != nullptr && std::holds_alternative<Namespace>(*symbol) && begin + 2 < end && tokens[begin + 1].value == "::") {
+                const auto &members = *std::get<Namespace>(*symbol).symbols;
+                const auto member = members.find(tokens[begin + 2].value);
+                symbol = member == members.end() ? nullptr : &member->second;
+                begin += 2;
+            }
+            if (symbol != nullptr && std::holds_alternative<Function>(*symbol)) {
+                effects.calls = true;
+                const auto &body = std::get<Function>(*symbol).body;
+                if (visited.insert(body.get()).second) {
+                    scan(*body, 0, body->size(), symbols, effects, visited);
+                }
+            }
+            ++begin;
+        }
+    }
+
+    inline Effects analyze(const std::vector<Token> &tokens, const Statement &statement, const std::unordered_map<std::string, SymbolInfo> &symbols) {
+        Effects effects;
+        const size_t begin = statement.begin + (tokens[statement.begin].value == "@" ? 2 : 0); // Past `@memoize`
+        const Token &first = tokens[begin];
+        if (first.type == TokenType::KEYWORD) {
+            if (first.value == "merge" || first.value == "return") {
+                effects.barrier = true;
+                return effects;
+            }
+            if (first.value == "fn") {
+                effects.writes.insert(tokens[begin + 1].value); // Only declares, the body runs when called
+                return effects;
+            }
+            if (first.value == "var" || first.value == "const") {
+                effects.writes.insert(tokens[statement.begin + 1].value);
+                std::unordered_set<const std::vector<Token>*> visited;
+                scan(tokens, statement.begin + 2, statement.end, symbols, effects, visited);
+                return effects;
+            }
+        }
+        std::unordered_set<const std::vector<Token>*> visited;
+        scan(tokens, statement.begin, statement.end, symbols, effects, visited);
+        return effects;
+    }
+
+    // Whether `later` has to wait for `earlier`
+    inline bool conflicts(const Effects &earlier, const Effects &later) {
+        for (const auto &name : earlier.writes) {
+            if (later.reads.contains(name) || later.writes.contains(name)) return true;
+        }
+        for (const auto &name : later.writes) {
+            if (earlier.reads.contains(name)) return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+// The bytecode hot functions are compiled to (tiering.h), rewritten by the optimizer (ssa.h) and
+// translated to C++ by --emit-cpp (aot.h).
+namespace quicken {
+    struct Feedback;
+}
+
+namespace pgo {
+    struct Counts;
+}
+
+namespace tiering {
+    enum class Kind : uint8_t { ABSENT, VARIABLE, FUNCTION, NAMESPACE };
+
+    enum class Op : uint8_t {
+        // Expressions, evaluated on a stack of doubles
+        NUMBER,        // Push numbers[a]
+        LOCAL,         // Push the variable in slot a, always declared by then
+        FREE,          // Push free variable b
+        LOCAL_OR_FREE, // Slot a once it is declared, free variable b before that
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,        // strings[a] is the division by zero message
+        LESS,
+        GREATER,
+        LESS_EQUAL,
+        GREATER_EQUAL,
+        EQUAL,
+        NOT_EQUAL,
+        AND,
+        OR,
+        OPERAND,       // A condition operand starting at token a follows
+        ROUND_TRIP,    // Condition operands go through their string form
+        // Statements
+        TRACE,              // Print strings[a], b times
+        DECLARE,            // Slot a = strings[b], of type strings[c]
+        DECLARE_ARITHMETIC, // Slot a = expressions[b], of type strings[c]
+        DECLARE_CALL,       // Slot a = calls[b], converted to strings[c]
+        COPY,               // Slot a = the value in slot b, converted to strings[c]
+        CHECK,              // Trace and check the arguments of calls[b] like calling the function inlined after it
+        ARGUMENT,           // Slot a = argument c of calls[b], a parameter of the inlined function
+        DECLARE_RESULT,     // Slot a = expressions[b] returned by an inlined function, reported at token c when it fails
+        CALL,               // calls[b], the result is dropped
+        WRITE,              // writescr the variable in slot a / free variable b
+        RETURN,             // Nothing
+        RETURN_CONSTANT,    // strings[b]
+        RETURN_VARIABLE,    // The value in slot a / free variable b
+        RETURN_ARITHMETIC,  // expressions[b], reported at token c when it fails
+        RETURN_CALL,        // calls[b]
+        BRANCH,             // Unless condition expressions[b] holds, continue at a
+        BRANCH_IF,          // If condition expressions[b] holds, continue at a
+        JUMP,               // Continue at a
+        ENTER,              // Save the slots blocks[a] declares
+        LEAVE,              // Restore them
+    };
+
+    struct Instruction {
+        Op op;
+        int a = -1;
+        int b = -1;
+        int c = -1;
+    };
+
+    struct Argument {
+        int slot = -1;
+        int free = -1;
+        std::optional<Variable> constant; // Literals
+    };
+
+    struct CallSite {
+        int callee;            // Free name of the function
+        std::string name;      // What the interpreter calls the callee's scope
+        std::vector<Argument> arguments;
+        size_t token;          // Where argument type errors are reported
+        bool traced;           // A plain call, which the interpreter announces
+        bool checked = false;  // Its argument types were checked when compiled, the callee is pinned
+    };
+
+    // A name the body doesn't declare itself, `ns::member` for namespace members
+    struct Free {
+        std::vector<std::string> path;
+        Kind kind; // What it was when the function was compiled
+        std::shared_ptr<const std::vector<Token>> body; // Of the function, when calls to it were inlined
+    };
+
+    struct Program {
+        std::shared_ptr<const std::vector<Token>> tokens; // The body, for diagnostics
+        std::vector<std::shared_ptr<const std::vector<Token>>> inlined; // Bodies of inlined calls, their tokens numbered on from the body's
+        std::unordered_map<std::string, int> slots; // Slot of each variable the body names
+        std::vector<std::string> slotNames;
+        size_t named = 0; // Slots [0, named) are the body's variables, the rest hold the locals of inlined calls
+        std::vector<int> parameters; // Slot of each parameter
+        std::vector<Free> frees;
+        std::vector<Instruction> code;
+        std::vector<std::vector<Instruction>> expressions;
+        std::vector<size_t> origins; // Token each of expressions[i] starts at
+        std::vector<double> numbers;
+        std::vector<std::string> strings;
+        std::vector<CallSite> calls;
+        std::vector<std::vector<int>> blocks; // Slots each then-block declares
+        std::shared_ptr<const jit::Code> native; // With --jit, entry i evaluates expressions[i]
+        std::shared_ptr<quicken::Feedback> feedback; // Of expressions[i] in compiled functions, see quicken.h
+        std::shared_ptr<pgo::Counts> counts; // Outcomes of the branches of functions --profile-out records, see pgo.h
+    };
+
+    // Token `at` of the body, or of the inlined bodies after it
+    inline const Token& token(const Program &program, size_t at) {
+        if (at < program.tokens->size()) return (*program.tokens)[at];
+        at -= program.tokens->size();
+        for (const auto &body : program.inlined) {
+            if (at < body->size()) return (*body)[at];
+            at -= body->size();
+        }
+        return program.tokens->back();
+    }
+
+    inline size_t instructions(const Program &program) {
+        size_t total = program.code.size();
+        for (const auto &expression : program.expressions) total += expression.size();
+        return total;
+    }
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+// Bounded multi-producer multi-consumer channels between tasks.
+//
+// The buffer is Dmitry Vyukov's bounded MPMC queue: a power of two ring of cells, each stamped with
+// a sequence number that tells producers and consumers whose turn the cell is, so sends and receives
+// claim cells with a single compare-and-swap and never take a lock. The ring is the capacity rounded
+// up, a send finds the channel full once `limit` messages are in it. Only a thread that has to wait
+// (full on send, empty on receive) touches the mutex: a task suspends its fiber until a peer makes
+// progress, any other thread parks on a condition variable.
+namespace channels {
+    template<typename T>
+    class Channel {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        static constexpr size_t CACHE_LINE = 64;
+
+        std::unique_ptr<Cell[]> cells;
+        const size_t mask;
+        const size_t limit; // The capacity asked for, at most mask + 1
+        alignas(CACHE_LINE) std::atomic<size_t> enqueuePos{0};
+        alignas(CACHE_LINE) std::atomic<size_t> dequeuePos{0};
+        alignas(CACHE_LINE) std::atomic<bool> closed{false};
+        std::atomic<size_t> parkedCount{0};
+        std::atomic<uint64_t> wakeups{0};
+        std::mutex parkMutex;
+        std::condition_variable parked;
+        std::vector<std::shared_ptr<scheduler::Task>> parkedTasks; // Suspended fibers waiting for a peer
+
+        static size_t roundUp(const size_t capacity) {
+            return std::bit_ceil(std::max<size_t>(capacity, 2));
+        }
+
+        void wakeParked() {
+            // Orders the cell we just published before reading parkedCount, pairing with the
+            // increment in block(): either the parker sees the cell or we see the parker
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parkedCount.load() > 0) {
+                wakeAll();
+            }
+        }
+
+        void wakeAll() {
+            std::vector<std::shared_ptr<scheduler::Task>> resumed;
+            {
+                std::lock_guard lock(parkMutex);
+                wakeups++;
+                resumed.swap(parkedTasks);
+            }
+            parked.notify_all();
+            for (auto &task : resumed) {
+                scheduler::pool().submit(std::move(task));
+            }
+        }
+
+        // Retry `attempt` until it succeeds, parking in between
+        template<typename Attempt>
+        auto block(Attempt attempt) -> decltype(attempt()) {
+            while (true) {
+                if (auto result = attempt()) return result;
+                if (!scheduler::inFiber() && scheduler::pool().isWorker() && scheduler::pool().helpOnce()) continue;
+
+                // Checked again once registered as parked, a peer that ran in between bumped
+                // `wakeups` and the wait below returns straight away
+                parkedCount++;
+                const uint64_t seen = wakeups.load();
+                if (auto result = attempt()) {
+                    parkedCount--;
+                    return result;
+                }
+                if (scheduler::inFiber()) {
+                    scheduler::suspend([this, seen](const std::shared_ptr<scheduler::Task> &self) {
+                        std::unique_lock lock(parkMutex);
+                        if (wakeups.load() == seen) {
+                            parkedTasks.push_back(self);
+                            return;
+                        }
+                        lock.unlock();
+                        scheduler::pool().submit(self);
+                    });
+                } else {
+                    std::unique_lock lock(parkMutex);
+                    const auto woken = [&] { return wakeups.load() != seen; };
+                    if (scheduler::pool().isWorker()) {
+                        parked.wait_for(lock, std::chrono::milliseconds(1), woken);
+                    } else {
+                        parked.wait(lock, woken);
+                    }
+                }
+                parkedCount--;
+            }
+        }
+
+    public:
+        explicit Channel(const size_t capacity)
+            : cells(new Cell[roundUp(capacity)]), mask(roundUp(capacity) - 1), limit(std::clamp<size_t>(capacity, 1, mask + 1)) {
+            for (size_t i = 0; i <= mask; i++) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return limit;
+        }
+
+        bool trySend(T &value) {
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                // Receives claimed up to dequeuePos, which only grows: a count under the limit here is
+                // still under it when `pos` is claimed
+                if (static_cast<intptr_t>(pos - dequeuePos.load(std::memory_order_acquire)) >= static_cast<intptr_t>(limit)) {
+                    if (pos == enqueuePos.load(std::memory_order_relaxed)) return false; // Full
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                    continue;
+                }
+                Cell &cell = cells[pos & mask];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        wakeParked();
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false; // Full
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::optional<T> tryReceive() {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Cell &cell = cells[pos & mask];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        T value = std::move(cell.value);
+                        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                        wakeParked();
+                        return value;
+                    }
+                } else if (diff < 0) {
+                    return std::nullopt; // Empty
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Blocks while the channel is full, false if it is (or gets) closed
+        bool send(T value) {
+            return block([&]() -> std::optional<bool> {
+                if (closed.load()) return false;
+                if (trySend(value)) return true;
+                return std::nullopt;
+            }).value();
+        }
+
+        // Blocks while the channel is empty, nullopt once it is closed and drained
+        std::optional<T> receive() {
+            std::optional<std::optional<T>> result = block([&]() -> std::optional<std::optional<T>> {
+                if (auto value = tryReceive()) return value;
+                if (closed.load()) {
+                    // Anything sent before the close is still delivered
+                    if (auto value = tryReceive()) return value;
+                    return std::optional<T>{};
+                }
+                return std::nullopt;
+            });
+            return *result;
+        }
+
+        void close() {
+            closed = true;
+            wakeAll();
+        }
+
+        [[nodiscard]] bool isClosed() const {
+            return closed.load();
+        }
+    };
+
+    // Channels created by one interpreter. Handles are indices from 1 and stay valid in every task
+    // the interpreter spawns, which share the registry.
+    class Registry {
+    private:
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Channel<std::string>>> channels;
+
+    public:
+        std::string create(const size_t capacity) {
+            auto channel = std::make_shared<Channel<std::string>>(capacity);
+            std::lock_guard lock(mutex);
+            channels.push_back(std::move(channel));
+            return std::to_string(channels.size());
+        }
+
+        std::shared_ptr<Channel<std::string>> find(const std::string &handle) {
+            if (handle.empty() || !std::ranges::all_of(handle, [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+                return nullptr;
+            }
+            const size_t index = std::stoul(handle);
+            std::lock_guard lock(mutex);
+            return index == 0 || index > channels.size() ? nullptr : channels[index - 1];
+        }
+    };
+
+    inline Registry& registry() {
+        auto &channels = context().channels;
+        if (!channels) channels = std::make_shared<Registry>();
+        return *channels;
+    }
+}
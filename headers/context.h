@@ -0,0 +1,58 @@
+#pragma once
+
+struct SEGFAULTErrContext;
+
+namespace scheduler {
+    struct Task;
+}
+
+namespace channels {
+    class Registry;
+}
+
+namespace pgo {
+    struct Session;
+}
+
+// Everything one interpreter instance changes while it runs. The parser and error reporting reach
+// it through context(), which is the context of the interpreter running on the calling thread, so
+// instances on different threads never share any of it.
+struct Context {
+    std::map<int, std::string> unfilteredLines; // Source lines of the file being parsed, for diagnostics
+    std::string currfilePath;
+    SEGFAULTErrContext* crashContext = nullptr; // Shown by the SIGSEGV handler
+    std::ostream* output = &std::cout;      // Where `extern "writescr"` writes to
+    std::shared_ptr<std::mutex> outputMutex = std::make_shared<std::mutex>(); // Shared with spawned tasks writing to the same output
+    bool exitOnError = true;                // Otherwise error::gen throws the ErrInfo
+    Options options;
+    std::vector<std::shared_ptr<scheduler::Task>> tasks; // Spawned from this context, `extern "join"` handles index it from 1
+    std::shared_ptr<channels::Registry> channels; // Created on first use, shared with spawned tasks
+    std::shared_ptr<pgo::Session> profile; // With --profile-in or --profile-out, shared with spawned tasks
+};
+
+inline thread_local Context* activeContext = nullptr;
+
+// Code running outside of an Interpreter (the command line before it starts one) gets a default
+// context of its own thread
+inline Context& context() {
+    static thread_local Context fallback;
+    return activeContext != nullptr ? *activeContext : fallback;
+}
+
+// Makes a context current on this thread for as long as the scope lives
+class ContextScope {
+private:
+    Context* previous;
+
+public:
+    explicit ContextScope(Context &ctx) : previous(activeContext) {
+        activeContext = &ctx;
+    }
+
+    ~ContextScope() {
+        activeContext = previous;
+    }
+
+    ContextScope(const ContextScope&) = delete;
+    ContextScope& operator=(const ContextScope&) = delete;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+// Compile-time function evaluation for `const` declarations and `static` calls.
+//
+// In a function body, `const name: type = ...;` and `var name: type = static f(...);` are evaluated
+// once, when the function is declared, and so is `return static f(...);`. The initializer is
+// replaced by a single LITERAL token holding the value, so every call, the compiled tiers, cached
+// modules and snapshot images see the value instead of the computation. An initializer is constant
+// when it only uses literals, arithmetic, consts declared before it at the top of the same body and
+// calls of pure functions with such arguments. Anything else is an error at declaration time.
+//
+// A pure function reads nothing but its parameters and locals: no externs, no merges, no nested
+// declarations, and it only calls pure functions. Calls bind to the functions visible where the
+// body is declared.
+//
+// At the top level every statement already runs once at load time: `const` declares a variable
+// like `var` and `static` only checks that the callee is pure.
+namespace ctfe {
+    using Table = std::unordered_map<std::string, SymbolInfo>;
+
+    // The value `type` initializer tokens (ending in `;` and eof) give against `symbols`
+    using Evaluate = std::string (*)(const std::vector<Token> &tokens, const std::vector<Token> &unfilteredTokens, const std::string &type,
+                                     const Table &symbols, const std::string &filePath);
+
+    // Index of the `"` closing the string literal opened at `pos`
+    inline size_t closingQuote(const std::vector<Token> &tokens, size_t pos) {
+        ++pos;
+        while (pos < tokens.size() && tokens[pos].type != TokenType::eof && tokens[pos].value != "\"") ++pos;
+        return pos;
+    }
+
+    // Index of the `;` ending the statement that `pos` is in
+    inline size_t terminator(const std::vector<Token> &tokens, size_t pos) {
+        while (pos < tokens.size() && tokens[pos].type != TokenType::eof && tokens[pos].value != ";") {
+            pos = tokens[pos].value == "\"" ? closingQuote(tokens, pos) + 1 : pos + 1;
+        }
+        return pos;
+    }
+
+    // The function `name` or `ns::...::name` at `pos` refers to when it is called there, with `pos`
+    // moved to the last name
+    inline const Function* callee(const std::vector<Token> &tokens, size_t &pos, const Table &table) {
+        const Table* scope = &table;
+        size_t at = pos;
+        while (true) {
+            const auto it = scope->find(tokens[at].value);
+            if (it == scope->end()) return nullptr;
+            if (const auto* ns = std::get_if<Namespace>(&it->second); ns != nullptr && at + 2 < tokens.size() && tokens[at + 1].value == "::") {
+                scope = ns->symbols.get();
+                at += 2;
+                continue;
+            }
+            const auto* func = std::get_if<Function>(&it->second);
+            if (func == nullptr || at + 1 >= tokens.size() || tokens[at + 1].value != "(") return nullptr;
+            pos = at;
+            return func;
+        }
+    }
+
+    // A call made by a pure function or its callees, `ns::...::name`, and the body it was bound to
+    struct Callee {
+        std::vector<std::string> path;
+        std::shared_ptr<const std::vector<Token>> body;
+    };
+
+    // Whether calls of `func` depend on its arguments alone. `self` is the function being declared,
+    // which has no body yet and is never pure. Every call it was decided for is added to `callees`.
+    inline bool pure(const Function &func, const Table &table, const tiering::Profile* self, std::unordered_set<const tiering::Profile*> &visited,
+                     std::vector<Callee>* callees = nullptr) {
+        if (func.profile.get() == self) return false;
+        if (!visited.insert(func.profile.get()).second) return true; // Recursion, or already known to be pure
+        const auto &body = *func.body;
+        std::unordered_set<std::string> locals;
+        for (const auto &parameter : func.localVariables) locals.insert(parameter.identifier);
+        for (size_t i = 0; i < body.size(); i++) {
+            const Token &token = body[i];
+            if (token.value == "\"") {
+                i = closingQuote(body, i);
+                continue;
+            }
+            if (token.type == TokenType::KEYWORD) {
+                if (token.value == "extern" || token.value == "merge" || token.value == "fn") return false;
+                if ((token.value == "var" || token.value == "const") && i + 1 < body.size()) {
+                    locals.insert(body[++i].value);
+                }
+                continue;
+            }
+            if (token.type != TokenType::IDENTIFIER || locals.contains(token.value)) continue;
+            const size_t start = i;
+            const Function* called = callee(body, i, table);
+            if (called == nullptr || !pure(*called, table, self, visited, callees)) return false;
+            if (callees == nullptr) continue;
+            std::vector<std::string> path;
+            for (size_t at = start; at <= i; at += 2) path.push_back(body[at].value);
+            if (std::ranges::none_of(*callees, [&](const Callee &known) { return known.path == path; })) {
+                callees->push_back({std::move(path), called->body});
+            }
+        }
+        return true;
+    }
+
+    inline bool pure(const Function &func, const Table &table, const tiering::Profile* self = nullptr, std::vector<Callee>* callees = nullptr) {
+        std::unordered_set<const tiering::Profile*> visited;
+        return pure(func, table, self, visited, callees);
+    }
+
+    // Whether tokens [begin, end) are a constant initializer, given the consts in `constants`
+    inline bool constant(const std::vector<Token> &tokens, const size_t begin, const size_t end, const Table &table,
+                         const std::unordered_set<std::string> &constants, const tiering::Profile* self) {
+        if (begin >= end) return false;
+        for (size_t i = begin; i < end; i++) {
+            const Token &token = tokens[i];
+            if (token.value == "\"") {
+                i = closingQuote(tokens, i);
+                continue;
+            }
+            if (token.type == TokenType::KEYWORD) {
+                if (token.value != "true" && token.value != "false") return false;
+                continue;
+            }
+            if (token.type != TokenType::IDENTIFIER || constants.contains(token.value)) continue;
+            const Function* called = callee(tokens, i, table);
+            if (called == nullptr || !pure(*called, table, self)) return false;
+        }
+        return true;
+    }
+
+    // Whether tokens [begin, end) are a single call of a pure function with constant arguments
+    inline bool staticCall(const std::vector<Token> &tokens, const size_t begin, const size_t end, const Table &table,
+                           const std::unordered_set<std::string> &constants, const tiering::Profile* self) {
+        size_t last = begin;
+        if (begin >= end || tokens[begin].type != TokenType::IDENTIFIER || callee(tokens, last, table) == nullptr) return false;
+        // The call's `)` ends the initializer
+        int depth = 0;
+        for (size_t i = last + 1; i < end; i++) {
+            if (tokens[i].value == "\"") {
+                i = closingQuote(tokens, i);
+                continue;
+            }
+            if (tokens[i].value == "(") ++depth;
+            if (tokens[i].value == ")" && --depth == 0 && i + 1 != end) return false;
+        }
+        return depth == 0 && constant(tokens, begin, end, table, constants, self);
+    }
+
+    inline void reject(const Token &at, const std::string &expected) {
+        ErrInfo errInfo = { ErrorType::EXPECTED_VALID_EXPRESSION, at.line, at.column, context().unfilteredLines[at.line], expected, context().currfilePath };
+        error::gen(errInfo);
+    }
+
+    // `func`'s body with every `const` and `static` initializer evaluated and replaced by its value.
+    // `func` is the declaration being parsed, `table` what its calls resolve to.
+    inline void fold(Function &func, const Table &table, const std::string &filePath, const Evaluate evaluate) {
+        const auto original = func.body;
+        const auto originalUnfiltered = func.unfilteredBody;
+        const auto &tokens = *original;
+        const auto &unfiltered = *originalUnfiltered;
+        const bool folds = std::ranges::any_of(tokens, [](const Token &token) {
+            return token.type == TokenType::KEYWORD && (token.value == "const" || token.value == "static");
+        });
+        if (!folds) return;
+
+        // Only a name declared once is known to hold its const value everywhere after it
+        std::unordered_map<std::string, int> declarations;
+        for (const auto &parameter : func.localVariables) ++declarations[parameter.identifier];
+        for (size_t i = 0; i + 1 < tokens.size(); i++) {
+            if (tokens[i].type == TokenType::KEYWORD && (tokens[i].value == "var" || tokens[i].value == "const")) ++declarations[tokens[i + 1].value];
+        }
+
+        Table symbols = table;
+        std::unordered_set<std::string> constants;
+        std::vector<Token> body;
+        std::vector<Token> unfilteredBody;
+        const auto copy = [&](const size_t begin, const size_t end) {
+            body.insert(body.end(), tokens.begin() + static_cast<long>(begin), tokens.begin() + static_cast<long>(end));
+            unfilteredBody.insert(unfilteredBody.end(), unfiltered.begin() + static_cast<long>(begin), unfiltered.begin() + static_cast<long>(end));
+        };
+        // The value of the initializer [begin, end) as a `type`, appended as a literal
+        const auto literal = [&](const size_t begin, const size_t end, const std::string &type) {
+            std::vector<Token> initializer(tokens.begin() + static_cast<long>(begin), tokens.begin() + static_cast<long>(end) + 1);
+            std::vector<Token> unfilteredInitializer(unfiltered.begin() + static_cast<long>(begin), unfiltered.begin() + static_cast<long>(end) + 1);
+            initializer.push_back({TokenType::eof, "", tokens[end].line, 0});
+            unfilteredInitializer.push_back({TokenType::eof, "", tokens[end].line, 0});
+            std::string value = evaluate(initializer, unfilteredInitializer, type, symbols, filePath);
+            body.push_back({TokenType::LITERAL, value, tokens[begin].line, tokens[begin].column});
+            unfilteredBody.push_back({TokenType::LITERAL, std::move(value), tokens[begin].line, tokens[begin].column});
+            return body.back().value;
+        };
+
+        int depth = 0;
+        size_t pos = 0;
+        while (pos < tokens.size()) {
+            const Token &token = tokens[pos];
+            if (token.value == "\"") {
+                const size_t close = std::min(closingQuote(tokens, pos) + 1, tokens.size());
+                copy(pos, close);
+                pos = close;
+                continue;
+            }
+            if (token.value == "{") ++depth;
+            if (token.value == "}") --depth;
+
+            const bool declaration = token.type == TokenType::KEYWORD && (token.value == "const" || token.value == "var");
+            if (declaration && pos + 5 < tokens.size() && tokens[pos + 2].value == ":" && tokens[pos + 4].value == "=" &&
+                (token.value == "const" || tokens[pos + 5].value == "static")) {
+                // `const name: type = ...;` or `var name: type = static ...;`, both become `var name: type = <value>;`
+                const std::string &name = tokens[pos + 1].value;
+                const std::string &type = tokens[pos + 3].value;
+                const bool isStatic = tokens[pos + 5].value == "static";
+                const size_t begin = pos + (isStatic ? 6 : 5);
+                const size_t end = terminator(tokens, begin);
+                if (isStatic ? !staticCall(tokens, begin, end, table, constants, func.profile.get())
+                             : !constant(tokens, begin, end, table, constants, func.profile.get())) {
+                    reject(tokens[begin < end ? begin : pos], isStatic ? "Call of a pure function with constant arguments" : "Constant expression");
+                }
+                body.push_back({TokenType::KEYWORD, "var", token.line, token.column});
+                unfilteredBody.push_back({TokenType::KEYWORD, "var", token.line, token.column});
+                copy(pos + 1, pos + 5);
+                const std::string value = literal(begin, end, type);
+                copy(end, end + 1);
+                if (token.value == "const" && depth == 0 && declarations[name] == 1) {
+                    constants.insert(name);
+                    symbols[name] = Variable{name, type, value, func.identifier};
+                }
+                pos = end + 1;
+                continue;
+            }
+            if (token.type == TokenType::KEYWORD && token.value == "return" && pos + 1 < tokens.size() && tokens[pos + 1].value == "static") {
+                const size_t begin = pos + 2;
+                const size_t end = terminator(tokens, begin);
+                if (!staticCall(tokens, begin, end, table, constants, func.profile.get())) {
+                    reject(tokens[begin < end ? begin : pos], "Call of a pure function with constant arguments");
+                }
+                copy(pos, pos + 1);
+                literal(begin, end, "any");
+                copy(end, end + 1);
+                pos = end + 1;
+                continue;
+            }
+            if (token.type == TokenType::KEYWORD && token.value == "static") {
+                reject(token, "static call as an initializer or return value");
+            }
+            copy(pos, pos + 1);
+            ++pos;
+        }
+
+        func.body = std::make_shared<const std::vector<Token>>(std::move(body));
+        func.unfilteredBody = std::make_shared<const std::vector<Token>>(std::move(unfilteredBody));
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+// Command line entry points, shared by main() and processes forked by the fork server.
+namespace driver {
+    inline void usage(const std::string &program) {
+        std::cout << "Usage: " << program << " [options] [input file]" << std::endl;
+        std::cout << "  --tree-shake          Drop unreachable functions, variables and namespaces before execution" << std::endl;
+        std::cout << "  --auto-parallel       Run independent top-level statements concurrently, output stays in order" << std::endl;
+        std::cout << "  --tier-threshold <n>  Calls before a function is compiled to bytecode in the background (default 1000, 0 never)" << std::endl;
+        std::cout << "  --tier-log            Report on stderr which functions get compiled" << std::endl;
+        std::cout << "  --max-specializations <n> Programs compiled per function for the argument types of its `any` parameters (default 4, 0 none)" << std::endl;
+        std::cout << "  --jit                 Compile the arithmetic of compiled functions to native code (x86-64)" << std::endl;
+        std::cout << "  -O0, -O1, -O2         Optimize compiled code: none, folding and dead code (default), also CSE and top-level code" << std::endl;
+        std::cout << "  --dump-ir             Print the SSA form of every program compiled, once optimized, on stderr" << std::endl;
+        std::cout << "  --time-passes         Report the time spent in each optimization pass on stderr" << std::endl;
+        std::cout << "  --memoize             Cache the results of every pure function by its arguments" << std::endl;
+        std::cout << "  --memo-stats          Report the hit rate of every memoized function on stderr" << std::endl;
+        std::cout << "  --emit-cpp <file>     Translate the program and its modules to C++ instead of running it" << std::endl;
+        std::cout << "  --build <file>        Translate the program and compile it with g++ (or $CXX) to an executable" << std::endl;
+        std::cout << "  --snapshot-out <file> Save the functions and merged modules the script declares to an image" << std::endl;
+        std::cout << "  --snapshot-in <file>  Restore the global state from an image instead of rebuilding it" << std::endl;
+        std::cout << "  --profile-out <file>  Record call counts, branches and operand types to a profile when done" << std::endl;
+        std::cout << "  --profile-in <file>   Start from a recorded profile: compile hot functions on first call" << std::endl;
+        std::cout << "  --fork-server <sock>  Preload and serve script launches on a Unix socket" << std::endl;
+        std::cout << "  --preload <file>      Script run once by the fork server, its merges stay loaded" << std::endl;
+        std::cout << "  --connect <sock> ...  Run the rest of the command line through a fork server" << std::endl;
+    }
+
+    inline int runFile(Interpreter &interpreter, const std::string &input) {
+        std::cout << "Input: " << input << std::endl;
+
+        const auto result = interpreter.run(input);
+        if (!result) error::render(result.error(), std::cerr);
+        if (interpreter.options().timePasses) ssa::report(std::cerr);
+        if (interpreter.options().memoStats) memo::report(std::cerr);
+        return result.code();
+    }
+
+    // args[0] is the program name, like argv
+    inline int run(const std::vector<std::string> &args) {
+        Interpreter interpreter;
+        Options &options = interpreter.options();
+        std::string input;
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            if (args[i] == "-h" || args[i] == "--help") {
+                usage(args[0]);
+                continue;
+            } else if (args[i] == "-v" || args[i] == "--version") {
+                std::cout << "ICVAST version " << ICVAST_VERSION << std::endl;
+                continue;
+            } else if (args[i] == "--tree-shake") {
+                options.treeShake = true;
+                continue;
+            } else if (args[i] == "--auto-parallel") {
+                options.autoParallel = true;
+                continue;
+            } else if (args[i] == "--tier-threshold" && i + 1 < args.size()) {
+                const std::string &count = args[++i];
+                if (count.empty() || !std::ranges::all_of(count, [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+                    std::cerr << INTERPRETER_NAME << ": ";
+                    std::cerr << "\033[31m" << "error: " << "--tier-threshold expects a number of calls" << "\033[0m" << std::endl;
+                    return 1;
+                }
+                options.tierThreshold = std::stoull(count);
+                continue;
+            } else if (args[i] == "--max-specializations" && i + 1 < args.size()) {
+                const std::string &count = args[++i];
+                if (count.empty() || !std::ranges::all_of(count, [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+                    std::cerr << INTERPRETER_NAME << ": ";
+                    std::cerr << "\033[31m" << "error: " << "--max-specializations expects a number of programs" << "\033[0m" << std::endl;
+                    return 1;
+                }
+                options.maxSpecializations = std::stoull(count);
+                continue;
+            } else if (args[i] == "--tier-log") {
+                options.tierLog = true;
+                continue;
+            } else if (args[i] == "--jit") {
+                options.jit = true;
+                continue;
+            } else if (args[i] == "-O0" || args[i] == "-O1" || args[i] == "-O2") {
+                options.optimize = args[i][2] - '0';
+                continue;
+            } else if (args[i] == "--dump-ir") {
+                options.dumpIr = true;
+                continue;
+            } else if (args[i] == "--time-passes") {
+                options.timePasses = true;
+                continue;
+            } else if (args[i] == "--memoize") {
+                options.memoize = true;
+                continue;
+            } else if (args[i] == "--memo-stats") {
+                options.memoStats = true;
+                continue;
+            } else if (args[i] == "--emit-cpp" && i + 1 < args.size()) {
+                options.emitCpp = args[++i];
+                continue;
+            } else if (args[i] == "--build" && i + 1 < args.size()) {
+                options.build = args[++i];
+                continue;
+            } else if (args[i] == "--snapshot-out" && i + 1 < args.size()) {
+                options.snapshotOut = args[++i];
+                continue;
+            } else if (args[i] == "--snapshot-in" && i + 1 < args.size()) {
+                options.snapshotIn = args[++i];
+                continue;
+            } else if (args[i] == "--profile-out" && i + 1 < args.size()) {
+                options.profileOut = args[++i];
+                continue;
+            } else if (args[i] == "--profile-in" && i + 1 < args.size()) {
+                options.profileIn = args[++i];
+                continue;
+            } else if (args[i] == "--fork-server" && i + 1 < args.size()) {
+                options.forkServer = args[++i];
+                continue;
+            } else if (args[i] == "--preload" && i + 1 < args.size()) {
+                options.preload.push_back(args[++i]);
+                continue;
+            } else if (args[i] == "--connect" && i + 2 < args.size()) {
+                // Everything after the socket belongs to the script launched by the server
+                std::vector<std::string> forwarded = {args[0]};
+                forwarded.insert(forwarded.end(), args.begin() + static_cast<long>(i) + 2, args.end());
+                return forkserver::connect(args[i + 1], forwarded);
+            }
+            input = args[i];
+        }
+
+        if (!options.forkServer.empty()) {
+            // Nothing compiles in the background while preloading, children only inherit one thread
+            options.tierThreshold = 0;
+            options.maxSpecializations = 0;
+            for (const auto &script : options.preload) {
+                if (const int code = runFile(interpreter, script); code != 0) return code;
+            }
+            return forkserver::serve(options.forkServer, run);
+        }
+
+        if (input.empty()) {
+            // TODO: instead of this, in the future, we can use a REPL
+            std::cerr << INTERPRETER_NAME << ": ";
+            std::cerr << "\033[31m" << "error: " << "No input file provided" << "\033[0m" << std::endl;
+            return 0;
+        }
+
+        if (!options.emitCpp.empty() || !options.build.empty()) {
+            return aot::compile(input, options.emitCpp, options.build, options.optimize);
+        }
+
+        return runFile(interpreter, input);
+    }
+}
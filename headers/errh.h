@@ -10,9 +10,6 @@ struct SEGFAULTErrContext {
     int column_number;
 };
 
-// Use a single atomic pointer for thread safety
-inline std::atomic<SEGFAULTErrContext*> error_context{nullptr};
-
 inline void signalHandler(int signal) {
     constexpr auto red = "\033[1;31m";
     constexpr auto reset = "\033[0m";
@@ -20,9 +17,9 @@ inline void signalHandler(int signal) {
     std::cerr << red << "\n⚠️ FATAL RUNTIME ERROR ⚠️\n" << reset;
     std::cerr << red << "Received signal: " << reset << signal << " (SIGSEGV)\n";
 
-    std::cout << "Error context: " << error_context.load()->column_number << std::endl;
+    std::cout << "Error context: " << context().crashContext->column_number << std::endl;
 
-    if (const SEGFAULTErrContext* ctx = error_context.load()) {
+    if (const SEGFAULTErrContext* ctx = context().crashContext) {
         std::cerr << red << "Crash location: " << reset
                   << "Line " << ctx->line_number
                   << ":" << ctx->column_number << "\n";
@@ -78,10 +75,12 @@ enum class ErrorType {
     INVALID_TYPE_CAST = 3013,
     INVALID_NUMBER = 3014,
 
-    // File system errors (4000-4002)
+    // File system errors (4000-4003)
     FILE_NOT_FOUND = 4000,
     PERMISSION_DENIED = 4001,
     FILE_READ_ERROR = 4002,
+    DUPLICATE_MODULE_SYMBOL = 4003,
+    FILE_WRITE_ERROR = 4004,
 
     // Generic unknown error (9999)
     UNKNOWN = 9999
@@ -97,6 +96,30 @@ struct ErrInfo {
     std::string filePath;
 };
 
+// What an Interpreter hands back when a script fails, instead of ending the process
+using Diagnostic = ErrInfo;
+
+// Either the value a script produced or the diagnostic that stopped it
+template<typename T>
+class Result {
+private:
+    std::variant<T, Diagnostic> data;
+
+public:
+    Result(T value) : data(std::move(value)) {}
+    Result(Diagnostic diagnostic) : data(std::move(diagnostic)) {}
+
+    [[nodiscard]] bool ok() const { return data.index() == 0; }
+    explicit operator bool() const { return ok(); }
+
+    T& value() { return std::get<0>(data); }
+    const T& value() const { return std::get<0>(data); }
+    [[nodiscard]] const Diagnostic& error() const { return std::get<1>(data); }
+
+    // Exit status for a process that ran the script: 0, or the diagnostic's code
+    [[nodiscard]] int code() const { return ok() ? 0 : static_cast<int>(error().errType); }
+};
+
 inline std::string bold_red = "\033[1;31m";
 inline std::string cyan = "\033[0;36m";
 inline std::string green = "\033[0;32m";
@@ -112,7 +135,9 @@ namespace error {
         return "'" + expected + "'";
     }
 
-    inline int gen(ErrInfo &errInfo) {
+    // The terminal renderer: category, location, source snippet and a hint
+    inline void render(const Diagnostic &errInfo, std::ostream &out) {
+        std::ostream* stream = &out;
         std::string message;
         std::string category;
         int code = static_cast<int>(errInfo.errType);
@@ -165,45 +190,55 @@ namespace error {
             case ErrorType::FILE_NOT_FOUND:                message = "File not found error"; break;
             case ErrorType::PERMISSION_DENIED:             message = "Permission denied error"; break;
             case ErrorType::FILE_READ_ERROR:               message = "File read error"; break;
+            case ErrorType::DUPLICATE_MODULE_SYMBOL:       message = "Symbol defined by more than one module file"; break;
+            case ErrorType::FILE_WRITE_ERROR:              message = "File write error"; break;
 
             case ErrorType::UNKNOWN:                       message = "Unknown error"; break;
             default:                                       message = "Unknown error [Default Case]"; break;
         }
 
         // Error header
-        std::cerr << bold_red << "➔ " << category << ": " << reset
+        *stream << bold_red << "➔ " << category << ": " << reset
                   << message << " " << cyan << "[" << code << "]" << reset << "\n";
 
         // Location information (updated to include filePath)
-        std::cerr << cyan << "  ╰─▶ " << reset
+        *stream << cyan << "  ╰─▶ " << reset
                   << "In file '" << errInfo.filePath << "' at line " << errInfo.line;
-        if (errInfo.column > 0) std::cerr << ":" << errInfo.column;
-        std::cerr << "\n";
+        if (errInfo.column > 0) *stream << ":" << errInfo.column;
+        *stream << "\n";
 
         // Source code snippet (remains unchanged)
         if (!errInfo.sourceLine.empty()) {
-            std::cerr << yellow << "   │ " << reset << errInfo.sourceLine << "\n";
+            *stream << yellow << "   │ " << reset << errInfo.sourceLine << "\n";
             if (errInfo.column > 0 && errInfo.column <= static_cast<int>(errInfo.sourceLine.length())) {
-                std::cerr << yellow << "   ╰─" << std::string(std::max(0, errInfo.column - 2), '-')
+                *stream << yellow << "   ╰─" << std::string(std::max(0, errInfo.column - 2), '-')
                             << green << "^" << reset << "\n";
             }
         }
 
         // Expected information (remains unchanged)
         if (!errInfo.expected.empty()) {
-            std::cerr << green << "   ➔ " << reset << bold_red << "Help: " << reset;
+            *stream << green << "   ➔ " << reset << bold_red << "Help: " << reset;
 
             if (code >= 2000 && code < 3000) {
-                std::cerr << "Expected " << format_expected(errInfo.expected);
+                *stream << "Expected " << format_expected(errInfo.expected);
             } else if (code >= 3000 && code < 4000) {
-                std::cerr << "Required " << format_expected(errInfo.expected);
+                *stream << "Required " << format_expected(errInfo.expected);
             } else {
-                std::cerr << message << ": " << format_expected(errInfo.expected);
+                *stream << message << ": " << format_expected(errInfo.expected);
             }
 
-            std::cerr << "\n";
+            *stream << "\n";
         }
+    }
 
-        std::exit(code);
+    // Raise a diagnostic. Inside an Interpreter it unwinds to eval()/run(), which return it as a
+    // value; anywhere else it is rendered and ends the process.
+    inline int gen(ErrInfo &errInfo) {
+        if (!context().exitOnError) {
+            throw errInfo;
+        }
+        render(errInfo, std::cerr);
+        std::exit(static_cast<int>(errInfo.errType));
     }
 }
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+// Stackful fibers, the unit the scheduler runs tasks on.
+//
+// The interpreter evaluates calls by recursing on the native stack, so a task can only stop in the
+// middle of a blocking extern and carry on later if that whole stack is kept aside: each fiber gets
+// a stack of its own and switching between fibers swaps stacks (ucontext). A suspended fiber costs
+// its stack and nothing else, and may be resumed on any thread.
+#if !defined(_WIN32)
+
+#if defined(__SANITIZE_THREAD__)
+extern "C" {
+    void* __tsan_get_current_fiber();
+    void* __tsan_create_fiber(unsigned flags);
+    void __tsan_destroy_fiber(void* fiber);
+    void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+}
+#endif
+
+namespace fiber {
+    // Reserved up front but only touched pages are backed, like a thread's stack
+    constexpr size_t STACK_SIZE = 8 << 20;
+    constexpr size_t GUARD_SIZE = 64 << 10;
+    constexpr size_t CACHED_STACKS = 64; // Stacks of finished fibers kept for the next ones
+
+    class Stacks {
+    private:
+        std::mutex mutex;
+        std::vector<void*> cached;
+
+    public:
+        void* acquire() {
+            {
+                std::lock_guard lock(mutex);
+                if (!cached.empty()) {
+                    void* stack = cached.back();
+                    cached.pop_back();
+                    return stack;
+                }
+            }
+            void* region = mmap(nullptr, GUARD_SIZE + STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+            if (region == MAP_FAILED) throw std::bad_alloc();
+            mprotect(region, GUARD_SIZE, PROT_NONE); // Overflowing the stack faults instead of corrupting the heap
+            return static_cast<char*>(region) + GUARD_SIZE;
+        }
+
+        void release(void* stack) {
+            {
+                std::lock_guard lock(mutex);
+                if (cached.size() < CACHED_STACKS) {
+                    cached.push_back(stack);
+                    return;
+                }
+            }
+            munmap(static_cast<char*>(stack) - GUARD_SIZE, GUARD_SIZE + STACK_SIZE);
+        }
+    };
+
+    inline Stacks& stacks() {
+        static Stacks* instance = new Stacks();
+        return *instance;
+    }
+
+    class Fiber;
+
+    inline thread_local Fiber* current = nullptr; // Fiber running on this thread, if any
+
+    // Fibers move between threads, so code that may have been suspended reads `current` through a
+    // call instead of reusing a thread-local address computed before it was suspended
+    __attribute__((noinline)) inline Fiber* running() {
+        return current;
+    }
+
+    class Fiber {
+    private:
+        ucontext_t context{};
+        ucontext_t caller{}; // Whoever resumed us last, yield() goes back there
+        void* stack;
+        std::function<void()> entry;
+        bool done = false;
+#if defined(__SANITIZE_THREAD__)
+        void* tsanFiber = __tsan_create_fiber(0);
+        void* tsanCaller = nullptr;
+#endif
+
+        static void trampoline() {
+            Fiber* self = current;
+            self->entry();
+            self->entry = nullptr;
+            self->done = true;
+#if defined(__SANITIZE_THREAD__)
+            __tsan_switch_to_fiber(self->tsanCaller, 0);
+#endif
+            setcontext(&self->caller);
+        }
+
+    public:
+        explicit Fiber(std::function<void()> entry) : stack(stacks().acquire()), entry(std::move(entry)) {
+            getcontext(&context);
+            context.uc_stack.ss_sp = stack;
+            context.uc_stack.ss_size = STACK_SIZE;
+            context.uc_link = nullptr;
+            makecontext(&context, &Fiber::trampoline, 0);
+        }
+
+        ~Fiber() {
+            stacks().release(stack);
+#if defined(__SANITIZE_THREAD__)
+            __tsan_destroy_fiber(tsanFiber);
+#endif
+        }
+
+        Fiber(const Fiber&) = delete;
+        Fiber& operator=(const Fiber&) = delete;
+
+        // Run on the calling thread until the fiber yields or its entry returns
+        void resume() {
+            Fiber* outer = current;
+            current = this;
+#if defined(__SANITIZE_THREAD__)
+            tsanCaller = __tsan_get_current_fiber();
+            __tsan_switch_to_fiber(tsanFiber, 0);
+#endif
+            swapcontext(&caller, &context);
+            current = outer;
+        }
+
+        // Called on the fiber: go back to resume(), which returns
+        void yield() {
+#if defined(__SANITIZE_THREAD__)
+            __tsan_switch_to_fiber(tsanCaller, 0);
+#endif
+            swapcontext(&context, &caller);
+        }
+
+        [[nodiscard]] bool finished() const {
+            return done;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,334 @@
+#pragma once
+
+// Fork server.
+//
+// The server preloads modules once and then waits on a Unix socket. Each client connection
+// passes its stdin/stdout/stderr descriptors (SCM_RIGHTS), working directory and argv; the
+// server forks a child that inherits the warm interpreter state copy-on-write, runs the script
+// on the client's descriptors and the child's exit code is sent back to the client.
+//
+// Wire format (client -> server): uint32 payload size, sent together with the 3 descriptors,
+// followed by the payload: uint32 string count, then (uint32 length, bytes) per string where the
+// first string is the working directory and the rest is argv. Server -> client: int32 exit code.
+// Requests are read on the poll loop as they arrive, so a slow client holds up no other launch:
+// a client has TIMEOUT_SECONDS from connecting to send its whole request, and its argv can't hold
+// the options that start servers or run other programs.
+//
+// A forked child only inherits the thread that called fork(), so preloads never tier up and the
+// server refuses to start once a --preload script started the worker pool or the timer thread.
+namespace forkserver {
+    using Runner = std::function<int(const std::vector<std::string>&)>;
+
+    constexpr int TIMEOUT_SECONDS = 5;
+    constexpr uint32_t MAX_PAYLOAD = 1 << 20;
+    constexpr size_t MAX_INCOMING = 64; // Connections still sending their request, more are turned away
+    constexpr std::array<const char*, 4> SERVER_ONLY = {"--fork-server", "--preload", "--connect", "--build"};
+
+#if defined(_WIN32)
+    inline int serve(const std::string&, const Runner&) {
+        std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "--fork-server is not supported on this platform" << std::endl;
+        return 1;
+    }
+
+    inline int connect(const std::string&, const std::vector<std::string>&) {
+        std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "--connect is not supported on this platform" << std::endl;
+        return 1;
+    }
+#else
+    inline int selfPipe[2] = {-1, -1};
+
+    inline void onChild(int) {
+        const int saved = errno;
+        [[maybe_unused]] const auto _ = write(selfPipe[1], "c", 1);
+        errno = saved;
+    }
+
+    inline std::vector<char> encode(const std::vector<std::string> &strings) {
+        std::vector<char> payload;
+        const auto append = [&payload](const uint32_t value) {
+            const auto* bytes = reinterpret_cast<const char*>(&value);
+            payload.insert(payload.end(), bytes, bytes + sizeof(value));
+        };
+        append(static_cast<uint32_t>(strings.size()));
+        for (const auto &str : strings) {
+            append(static_cast<uint32_t>(str.size()));
+            payload.insert(payload.end(), str.begin(), str.end());
+        }
+        return payload;
+    }
+
+    inline std::optional<std::vector<std::string>> decode(const std::vector<char> &payload) {
+        size_t cursor = 0;
+        const auto take = [&](uint32_t &value) {
+            if (cursor + sizeof(value) > payload.size()) return false;
+            std::memcpy(&value, payload.data() + cursor, sizeof(value));
+            cursor += sizeof(value);
+            return true;
+        };
+
+        uint32_t count;
+        if (!take(count)) return std::nullopt;
+        std::vector<std::string> strings;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t length;
+            if (!take(length) || cursor + length > payload.size()) return std::nullopt;
+            strings.emplace_back(payload.data() + cursor, length);
+            cursor += length;
+        }
+        return strings;
+    }
+
+    enum class Progress {
+        PENDING,
+        COMPLETE,
+        FAILED
+    };
+
+    // A connection still sending its request
+    struct Incoming {
+        int client;
+        std::chrono::steady_clock::time_point deadline;
+        int fds[3] = {-1, -1, -1};
+        bool described = false; // The size header and descriptors arrived
+        std::vector<char> payload;
+        size_t received = 0;
+    };
+
+    // Receive the size header and the client's three standard descriptors
+    inline Progress receiveHeader(const int client, uint32_t &size, int (&fds)[3]) {
+        char control[CMSG_SPACE(sizeof(int) * 3)] = {};
+        iovec iov{&size, sizeof(size)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const ssize_t n = recvmsg(client, &msg, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return Progress::PENDING;
+        if (n != sizeof(size)) return Progress::FAILED;
+        const cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
+            return Progress::FAILED;
+        }
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+        return Progress::COMPLETE;
+    }
+
+    // Read what the (non-blocking) connection has to offer
+    inline Progress receive(Incoming &incoming) {
+        if (!incoming.described) {
+            uint32_t size = 0;
+            if (const Progress header = receiveHeader(incoming.client, size, incoming.fds); header != Progress::COMPLETE) return header;
+            if (size > MAX_PAYLOAD) return Progress::FAILED;
+            incoming.described = true;
+            incoming.payload.resize(size);
+        }
+        while (incoming.received < incoming.payload.size()) {
+            const ssize_t n = read(incoming.client, incoming.payload.data() + incoming.received, incoming.payload.size() - incoming.received);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return Progress::PENDING;
+            if (n <= 0) return Progress::FAILED;
+            incoming.received += n;
+        }
+        return Progress::COMPLETE;
+    }
+
+    inline void discard(const Incoming &incoming) {
+        for (const int fd : incoming.fds) if (fd >= 0) close(fd);
+        close(incoming.client);
+    }
+
+    // The first option of a request (working directory, then argv) that only the server's own
+    // command line may hold, if any
+    inline std::optional<std::string> serverOnly(const std::vector<std::string> &request) {
+        for (size_t i = 2; i < request.size(); i++) {
+            if (std::ranges::find(SERVER_ONLY, request[i]) != SERVER_ONLY.end()) return request[i];
+        }
+        return std::nullopt;
+    }
+
+    // Launch the complete request `incoming[index]`, the other connections are closed in the child
+    inline void handle(const int listener, const std::vector<Incoming> &incoming, const size_t index, const Runner &runner, std::unordered_map<pid_t, int> &children) {
+        const Incoming &connection = incoming[index];
+        const int client = connection.client;
+        const auto &fds = connection.fds;
+        const auto request = decode(connection.payload);
+        if (!request || request->empty()) {
+            discard(connection);
+            return;
+        }
+        sockets::setBlocking(client, true);
+        if (const auto option = serverOnly(*request)) {
+            const std::string message = std::string(INTERPRETER_NAME) + ": error: " + *option + " can't be passed through --connect\n";
+            sockets::writeAll(fds[2], message.data(), message.size());
+            for (const int fd : fds) close(fd);
+            const int32_t code = 1;
+            sockets::writeAll(client, &code, sizeof(code));
+            close(client);
+            return;
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+            // Child: become the client's process and run its command line on the warm state
+            close(listener);
+            close(selfPipe[0]);
+            close(selfPipe[1]);
+            for (size_t i = 0; i < incoming.size(); i++) {
+                if (i != index) discard(incoming[i]);
+            }
+            for (const int other : children | std::views::values) close(other);
+            signal(SIGCHLD, SIG_DFL);
+            for (int i = 0; i < 3; i++) {
+                dup2(fds[i], i);
+                close(fds[i]);
+            }
+            close(client);
+
+            std::error_code ec;
+            std::filesystem::current_path(request->front(), ec);
+            modules::index().setWorkingDirectory(request->front());
+            modules::index().revalidate();
+
+            const std::vector<std::string> args(request->begin() + 1, request->end());
+            const int code = runner(args);
+            std::cout.flush();
+            std::cerr.flush();
+            std::exit(code);
+        }
+
+        for (const int fd : fds) close(fd);
+        if (pid < 0) {
+            const int32_t code = 1;
+            sockets::writeAll(client, &code, sizeof(code));
+            close(client);
+            return;
+        }
+        children[pid] = client;
+    }
+
+    inline void reap(std::unordered_map<pid_t, int> &children) {
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            const auto it = children.find(pid);
+            if (it == children.end()) continue;
+
+            const int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            sockets::writeAll(it->second, &code, sizeof(code));
+            close(it->second);
+            children.erase(it);
+        }
+    }
+
+    inline int serve(const std::string &path, const Runner &runner) {
+        if (scheduler::threadsStarted) {
+            std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "a --preload script started worker threads, which forked children can't inherit" << std::endl;
+            return 1;
+        }
+
+        const int listener = sockets::listenOn(path);
+        if (listener < 0) {
+            std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "cannot listen on '" << path << "': " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        if (pipe(selfPipe) != 0) return 1;
+        fcntl(selfPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(selfPipe[1], F_SETFL, O_NONBLOCK);
+        fcntl(selfPipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(selfPipe[1], F_SETFD, FD_CLOEXEC);
+        signal(SIGCHLD, onChild);
+        signal(SIGPIPE, SIG_IGN);
+
+        std::cout << "Fork server listening on " << path << std::endl;
+
+        std::unordered_map<pid_t, int> children;
+        std::vector<Incoming> incoming;
+        while (true) {
+            std::vector<pollfd> fds = {{listener, POLLIN, 0}, {selfPipe[0], POLLIN, 0}};
+            auto deadline = std::chrono::steady_clock::time_point::max();
+            for (const auto &connection : incoming) {
+                fds.push_back({connection.client, POLLIN, 0});
+                deadline = std::min(deadline, connection.deadline);
+            }
+            if (poll(fds.data(), fds.size(), incoming.empty() ? -1 : sockets::until(deadline)) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                char drain[64];
+                while (read(selfPipe[0], drain, sizeof(drain)) > 0) {}
+                reap(children);
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t i = incoming.size(); i-- > 0;) {
+                Progress progress = fds[i + 2].revents != 0 ? receive(incoming[i]) : Progress::PENDING;
+                if (progress == Progress::PENDING && now >= incoming[i].deadline) progress = Progress::FAILED;
+                if (progress == Progress::PENDING) continue;
+
+                if (progress == Progress::COMPLETE) handle(listener, incoming, i, runner, children);
+                else discard(incoming[i]);
+                incoming.erase(incoming.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+
+            if (fds[0].revents & POLLIN) {
+                if (const int client = accept(listener, nullptr, nullptr); client >= 0) {
+                    if (incoming.size() >= MAX_INCOMING) {
+                        close(client);
+                        continue;
+                    }
+                    sockets::setBlocking(client, false);
+                    incoming.push_back({client, now + std::chrono::seconds(TIMEOUT_SECONDS), {-1, -1, -1}, false, {}, 0});
+                }
+            }
+        }
+
+        close(listener);
+        unlink(path.c_str());
+        return 1;
+    }
+
+    // Client side: hand our stdio, working directory and argv to the server, return the script's exit code
+    inline int connect(const std::string &path, const std::vector<std::string> &args) {
+        const int server = sockets::connectTo(path);
+        if (server < 0) {
+            std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "cannot connect to '" << path << "': " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        std::error_code ec;
+        std::vector<std::string> request = {std::filesystem::current_path(ec).string()};
+        request.insert(request.end(), args.begin(), args.end());
+        const std::vector<char> payload = encode(request);
+
+        uint32_t size = payload.size();
+        int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+        char control[CMSG_SPACE(sizeof(fds))] = {};
+        iovec iov{&size, sizeof(size)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        int32_t code = 1;
+        if (sendmsg(server, &msg, 0) != sizeof(size) || !sockets::writeAll(server, payload.data(), payload.size()) ||
+            !sockets::readAll(server, &code, sizeof(code))) {
+            std::cerr << INTERPRETER_NAME << ": " << bold_red << "error: " << reset << "fork server closed the connection" << std::endl;
+            code = 1;
+        }
+        close(server);
+        return code;
+    }
+#endif
+}
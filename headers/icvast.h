@@ -0,0 +1,92 @@
+#pragma once
+
+// Everything the interpreter needs, shared by the InterpretedCVast and icvastd executables
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <csignal>
+#include <thread>
+#include <future>
+#include <variant>
+#include <optional>
+#include <filesystem>
+#include <unordered_map>
+#include <cstdlib>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <cctype>
+#include <unordered_set>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <queue>
+#include <charconv>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #include <csignal>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/time.h>
+    #include <sys/un.h>
+    #include <sys/wait.h>
+    #include <ucontext.h>
+#endif
+
+#define ICVAST_VERSION "1.0.0"
+
+#define INTERPRETER_NAME "ICVAST"
+
+#define PARGS (pos, *tokens);
+
+#include "options.h"
+#include "context.h"
+#include "errh.h"
+#include "lexer.h"
+#include "modules.h"
+#include "parsers.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "channels.h"
+#include "treeshake.h"
+#include "ctfe.h"
+#include "autoparallel.h"
+#include "snapshot.h"
+#include "jit.h"
+#include "bytecode.h"
+#include "quicken.h"
+#include "specialize.h"
+#include "pgo.h"
+#include "ssa.h"
+#include "tiering.h"
+#include "memo.h"
+#include "inlinecache.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "aot.h"
+#include "sockets.h"
+#include "forkserver.h"
+#include "driver.h"
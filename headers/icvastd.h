@@ -0,0 +1,308 @@
+#pragma once
+
+// icvastd, a long-running daemon that executes scripts over a Unix socket.
+//
+// Merged modules stay resident in the process between requests, and are parsed again once their
+// files change on disk. Each request runs on a worker thread in its own interpreter instance:
+// script output and diagnostics are captured per request and errors are thrown back to the
+// worker instead of ending the process.
+//
+// Requests are one header line, optionally followed by a body:
+//   RUN <path>\n             run the script at <path> (absolute, or relative to the daemon)
+//   EVAL <bytes>\n<source>   run inline source
+//   STATS\n                  latency histogram and counters
+// Responses are `<exit code> <bytes>\n<output>`, or `BUSY\n` when the queue is full. A client has
+// `timeout` seconds from connecting to send its whole request, and a body over `maxRequestBytes`
+// is refused.
+namespace icvastd {
+    struct Config {
+        std::string socket = "/tmp/icvastd.sock";
+        size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        size_t queueCapacity = 64;
+        size_t maxRequestBytes = size_t{16} << 20;
+        int timeout = 5; // Seconds
+    };
+
+    constexpr size_t MAX_HEADER = 4096;
+
+    // Request latencies (queue wait included) in power of two microsecond buckets
+    class Histogram {
+    private:
+        static constexpr size_t BUCKETS = 40;
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+        std::atomic<uint64_t> total{0};
+
+    public:
+        void record(const std::chrono::microseconds latency) {
+            const auto us = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 1));
+            buckets[std::min<size_t>(std::bit_width(us) - 1, BUCKETS - 1)]++;
+            total++;
+        }
+
+        // Upper bound of the bucket containing the given percentile
+        [[nodiscard]] uint64_t percentile(const double p) const {
+            const uint64_t count = total.load();
+            if (count == 0) return 0;
+            const auto target = static_cast<uint64_t>(p * static_cast<double>(count));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; i++) {
+                seen += buckets[i].load();
+                if (seen > target) return uint64_t{1} << (i + 1);
+            }
+            return uint64_t{1} << BUCKETS;
+        }
+
+        void print(std::ostream &out) const {
+            out << "requests " << total.load() << "\n";
+            out << "p50_us " << percentile(0.50) << "\np90_us " << percentile(0.90) << "\np99_us " << percentile(0.99) << "\n";
+            for (size_t i = 0; i < BUCKETS; i++) {
+                if (const uint64_t n = buckets[i].load()) {
+                    out << "bucket_us[" << (uint64_t{1} << i) << "," << (uint64_t{1} << (i + 1)) << ") " << n << "\n";
+                }
+            }
+        }
+    };
+
+    struct Request {
+        int client;
+        std::string path;   // Empty for inline source
+        std::string source;
+        std::chrono::steady_clock::time_point received;
+    };
+
+#if !defined(_WIN32)
+    class Server {
+    private:
+        Config config;
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<Request> queue;
+        std::vector<std::thread> workers;
+        Histogram latency;
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> failed{0};
+
+        static void respond(const int client, const int code, const std::string &output) {
+            const std::string header = std::to_string(code) + " " + std::to_string(output.size()) + "\n";
+            sockets::writeAll(client, header.data(), header.size());
+            sockets::writeAll(client, output.data(), output.size());
+            close(client);
+        }
+
+        // Run one script in a fresh interpreter on this thread, with its output captured
+        static int execute(const Request &request, std::string &output) {
+            std::ostringstream captured;
+            modules::index().revalidate();
+            Interpreter interpreter;
+            interpreter.setOutput(captured);
+
+            const auto result = request.path.empty() ? interpreter.eval(request.source) : interpreter.run(request.path);
+            if (!result) error::render(result.error(), captured);
+            output = captured.str();
+            return result.code();
+        }
+
+        void work() {
+            while (true) {
+                Request request;
+                {
+                    std::unique_lock lock(mutex);
+                    available.wait(lock, [this] { return !queue.empty(); });
+                    request = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                std::string output;
+                const int code = execute(request, output);
+                if (code != 0) failed++;
+                respond(request.client, code, output);
+                latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.received));
+            }
+        }
+
+        // Everything a connection sent so far, read on the accept loop as it arrives
+        struct Incoming {
+            int client;
+            std::string data;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        void reply(const int client, const int code, const std::string &output) {
+            sockets::setBlocking(client, true);
+            respond(client, code, output);
+        }
+
+        // Backpressure: tell the client to retry instead of queueing without bound
+        void busy(const int client) {
+            rejected++;
+            sockets::setBlocking(client, true);
+            sockets::writeAll(client, "BUSY\n", 5);
+            close(client);
+        }
+
+        // Read what `incoming` has to offer, false once its connection was answered or closed
+        bool receive(Incoming &incoming) {
+            std::array<char, 65536> chunk;
+            while (true) {
+                const ssize_t n = read(incoming.client, chunk.data(), chunk.size());
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+                if (n > 0) incoming.data.append(chunk.data(), n);
+                if (dispatch(incoming)) return false;
+                if (n <= 0) {
+                    close(incoming.client);
+                    return false;
+                }
+            }
+        }
+
+        // Act on a complete request, false while more of it is still to come
+        bool dispatch(Incoming &incoming) {
+            const int client = incoming.client;
+            const size_t newline = incoming.data.find('\n');
+            if (newline == std::string::npos || newline >= MAX_HEADER) {
+                if (newline == std::string::npos && incoming.data.size() < MAX_HEADER) return false;
+                reply(client, 1, "malformed request\n");
+                return true;
+            }
+
+            const std::string header = incoming.data.substr(0, newline);
+            Request request{client, "", "", std::chrono::steady_clock::now()};
+            if (header == "STATS") {
+                std::ostringstream stats;
+                latency.print(stats);
+                stats << "rejected " << rejected.load() << "\nfailed " << failed.load() << "\n";
+                {
+                    std::lock_guard lock(mutex);
+                    stats << "queued " << queue.size() << "/" << config.queueCapacity << "\n";
+                }
+                reply(client, 0, stats.str());
+                return true;
+            } else if (header.starts_with("RUN ")) {
+                request.path = header.substr(4);
+            } else if (header.starts_with("EVAL ")) {
+                size_t size = 0;
+                if (!sockets::parseSize(header.substr(5), size)) {
+                    reply(client, 1, "malformed request\n");
+                    return true;
+                }
+                if (size > config.maxRequestBytes) {
+                    reply(client, 1, "request too large\n");
+                    return true;
+                }
+                if (incoming.data.size() - newline - 1 < size) return false;
+                request.source = incoming.data.substr(newline + 1, size);
+            } else {
+                reply(client, 1, "unknown request\n");
+                return true;
+            }
+
+            sockets::setBlocking(client, true);
+            {
+                std::lock_guard lock(mutex);
+                if (queue.size() < config.queueCapacity) {
+                    queue.push_back(std::move(request));
+                    available.notify_one();
+                    return true;
+                }
+            }
+            busy(client);
+            return true;
+        }
+
+    public:
+        explicit Server(Config config) : config(std::move(config)) {}
+
+        int run() {
+            const int listener = sockets::listenOn(config.socket);
+            if (listener < 0) {
+                std::cerr << "icvastd: " << bold_red << "error: " << reset << "cannot listen on '" << config.socket << "': " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            signal(SIGPIPE, SIG_IGN);
+
+            for (size_t i = 0; i < config.workers; i++) {
+                workers.emplace_back([this] { work(); });
+            }
+            std::cout << "icvastd listening on " << config.socket << " with " << config.workers << " worker(s)" << std::endl;
+
+            // Requests are read here without blocking, each within `timeout` seconds of its connection
+            // being accepted, so a slow client delays nobody and can't hold on to its connection
+            std::vector<Incoming> incoming;
+            while (true) {
+                std::vector<pollfd> fds{{listener, POLLIN, 0}};
+                auto deadline = std::chrono::steady_clock::time_point::max();
+                for (const auto &connection : incoming) {
+                    fds.push_back({connection.client, POLLIN, 0});
+                    deadline = std::min(deadline, connection.deadline);
+                }
+                if (poll(fds.data(), fds.size(), incoming.empty() ? -1 : sockets::until(deadline)) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                for (size_t i = incoming.size(); i-- > 0;) {
+                    bool open = true;
+                    if (fds[i + 1].revents != 0) open = receive(incoming[i]);
+                    if (open && now >= incoming[i].deadline) {
+                        close(incoming[i].client);
+                        open = false;
+                    }
+                    if (!open) incoming.erase(incoming.begin() + static_cast<std::ptrdiff_t>(i));
+                }
+
+                if (fds[0].revents & POLLIN) {
+                    const int client = ::accept(listener, nullptr, nullptr);
+                    if (client < 0) continue;
+                    if (incoming.size() >= config.queueCapacity) {
+                        busy(client);
+                        continue;
+                    }
+                    sockets::setBlocking(client, false);
+                    incoming.push_back({client, "", now + std::chrono::seconds(config.timeout)});
+                }
+            }
+
+            close(listener);
+            return 1;
+        }
+    };
+
+    // Client side, used by `icvastd --run/--eval/--stats`
+    inline int submit(const std::string &socket, const std::string &request) {
+        const int server = sockets::connectTo(socket);
+        if (server < 0) {
+            std::cerr << "icvastd: " << bold_red << "error: " << reset << "cannot connect to '" << socket << "': " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        std::string header;
+        int code = 1;
+        if (sockets::writeAll(server, request.data(), request.size()) && sockets::readLine(server, header)) {
+            if (header == "BUSY") {
+                std::cerr << "icvastd: server busy, try again" << std::endl;
+                code = 75; // EX_TEMPFAIL
+            } else if (const auto space = header.find(' '); space != std::string::npos) {
+                size_t exit = 0;
+                size_t size = 0;
+                if (!sockets::parseSize(header.substr(0, space), exit) || exit > static_cast<size_t>(std::numeric_limits<int>::max()) || !sockets::parseSize(header.substr(space + 1), size)) {
+                    std::cerr << "icvastd: " << bold_red << "error: " << reset << "malformed reply from the server" << std::endl;
+                } else {
+                    // Streamed, the reply is only trusted as far as it goes
+                    std::array<char, 65536> chunk;
+                    while (size > 0 && sockets::readAll(server, chunk.data(), std::min(size, chunk.size()))) {
+                        std::cout.write(chunk.data(), static_cast<std::streamsize>(std::min(size, chunk.size())));
+                        size -= std::min(size, chunk.size());
+                    }
+                    std::cout << std::flush;
+                    if (size == 0) code = static_cast<int>(exit);
+                    else std::cerr << "icvastd: " << bold_red << "error: " << reset << "truncated reply from the server" << std::endl;
+                }
+            }
+        }
+        close(server);
+        return code;
+    }
+#endif
+}
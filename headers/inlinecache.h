@@ -0,0 +1,80 @@
+#pragma once
+
+// Inline caches for the qualified names (`ns::...::name`) of function bodies.
+//
+// Every call runs its body against a fresh copy of the caller's table, but the namespaces in those
+// copies share their members (see Namespace), so a namespace's member table is the same object in
+// every call until the name is bound to something else. Each token of a body that starts a
+// qualified name gets a Site remembering the member table of the namespace it started with and the
+// variable or function the name resolved to there. Once filled, a site costs one lookup of the
+// namespace's name in the caller's table and a pointer compare, however deep the name is. It is
+// refilled only when the namespace really was rebound, and a site that has been filled
+// MAX_MISSES times (a body reached from callers with different modules under the same name) goes
+// back to walking the namespaces.
+namespace inlinecache {
+    using Table = std::unordered_map<std::string, SymbolInfo>;
+
+    constexpr int MAX_MISSES = 4; // Fills before a site stops caching
+
+    // What a qualified name resolved to, valid while its namespace is bound to `members`
+    struct Entry {
+        std::shared_ptr<const Table> members; // Keeps `target` alive
+        const SymbolInfo* target = nullptr;
+        int last = 0; // Offset of the last name from the first
+    };
+
+    struct Site {
+        std::atomic<const Entry*> entry{nullptr};
+        std::atomic<int> misses{0};
+    };
+
+    // One site per token of a body. Entries are only freed with the body's sites, so a call that
+    // read one keeps using it while another thread refills the site.
+    struct Sites {
+        explicit Sites(const size_t count) : count(count), sites(std::make_unique<Site[]>(count)) {}
+
+        const size_t count;
+        std::unique_ptr<Site[]> sites;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<const Entry>> entries;
+
+        const Entry* publish(Site &site, Entry entry) {
+            std::lock_guard lock(mutex);
+            entries.push_back(std::make_unique<const Entry>(std::move(entry)));
+            site.entry.store(entries.back().get(), std::memory_order_release);
+            return entries.back().get();
+        }
+    };
+
+    // The sites of `func`'s body, made on first use
+    inline const std::shared_ptr<Sites>& sites(const Function &func) {
+        tiering::Profile &profile = *func.profile;
+        std::call_once(profile.sited, [&] {
+            profile.sites = std::make_shared<Sites>(func.body->size());
+        });
+        return profile.sites;
+    }
+
+    // abstract::_pscope_resolve through the site of the name at tokens[pos], `index` being that
+    // token's index in the body
+    inline const SymbolInfo& resolve(Sites &sites, const size_t index, int &pos, const std::vector<Token> &tokens, const Table &table) {
+        if (index >= sites.count) return abstract::_pscope_resolve(pos, tokens, table);
+        Site &site = sites.sites[index];
+        const auto it = table.find(tokens[pos].value);
+        const auto* ns = it == table.end() ? nullptr : std::get_if<Namespace>(&it->second);
+        if (ns == nullptr) return abstract::_pscope_resolve(pos, tokens, table);
+
+        const Entry* entry = site.entry.load(std::memory_order_acquire);
+        if (entry != nullptr && entry->members.get() == ns->symbols.get()) {
+            pos += entry->last;
+            return *entry->target;
+        }
+
+        const int first = pos;
+        const SymbolInfo &target = abstract::_pscope_resolve(pos, tokens, table);
+        if (site.misses.fetch_add(1, std::memory_order_relaxed) < MAX_MISSES) {
+            sites.publish(site, Entry{ns->symbols, &target, pos - first});
+        }
+        return target;
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+// An embeddable interpreter.
+//
+// Each instance owns its diagnostics state, output streams and options, so any number of them can
+// run at the same time as long as every thread uses its own. Errors never end the host process:
+// eval() and run() return the Diagnostic that stopped the script, for the host to render or inspect.
+class Interpreter {
+private:
+    Context ctx;
+
+    // Lex, parse and execute a program, `name` is the path used for diagnostics and relative merges
+    Result<std::unordered_map<std::string, SymbolInfo>> execute(std::istream &source, const std::string &name) {
+        auto lex = Lexer(source);
+
+        auto [tokenizedOutput, unfilteredTokens, unfilteredLines] = lex.tokenize();
+
+        set_unfilteredLines(unfilteredLines);
+
+        Parser parser(std::make_unique<std::vector<Token>>(tokenizedOutput), std::make_unique<std::vector<Token>>(unfilteredTokens), name);
+
+        if (!ctx.profile && (!ctx.options.profileIn.empty() || !ctx.options.profileOut.empty())) {
+            ctx.profile = pgo::open(ctx.options.profileIn);
+        }
+
+        if (!ctx.options.snapshotIn.empty()) {
+            if (auto image = snapshot::read(ctx.options.snapshotIn, snapshot::fingerprint(tokenizedOutput))) {
+                parser.restore(image->table, image->sources);
+            }
+        }
+
+        std::optional<treeshake::Pass> shaker;
+        if (ctx.options.treeShake) {
+            shaker.emplace(tokenizedOutput);
+            parser.set_treeShaker(&*shaker);
+        }
+
+        if (ctx.options.autoParallel) {
+            parser.parseParallel();
+        } else if (ctx.options.optimize >= 2) {
+            parser.parseOptimized();
+        } else {
+            parser.parse();
+        }
+
+        if (!ctx.options.snapshotOut.empty() &&
+            !snapshot::write(ctx.options.snapshotOut, snapshot::declarations(parser.getSymbolTable(), tokenizedOutput), snapshot::fingerprint(tokenizedOutput),
+                             parser.getSources())) {
+            return Diagnostic{ ErrorType::FILE_WRITE_ERROR, 0, -1, "", ctx.options.snapshotOut, name };
+        }
+
+        if (shaker) {
+            std::cerr << "Tree shaking removed " << shaker->getReport().symbols << " symbol(s)\n" << std::flush;
+        }
+        return parser.getSymbolTable();
+    }
+
+    // Diagnostics raised anywhere below unwind to here and become the returned value
+    Result<std::unordered_map<std::string, SymbolInfo>> guarded(std::istream &source, const std::string &name) {
+        ContextScope scope(ctx);
+        std::optional<Result<std::unordered_map<std::string, SymbolInfo>>> result;
+        try {
+            result = execute(source, name);
+        } catch (const Diagnostic &diagnostic) {
+            result = diagnostic;
+        } catch (const std::exception &e) {
+            result = Diagnostic{ ErrorType::UNKNOWN, 0, -1, "", e.what(), name };
+        }
+
+        // Tasks the script never joined still write to this instance's streams
+        if (auto failure = scheduler::joinAll(ctx); failure && result->ok()) {
+            result = std::move(*failure);
+        }
+
+        // Once every task is done calling
+        if (result->ok() && !ctx.options.profileOut.empty() && !pgo::write(*ctx.profile, ctx.options.profileOut)) {
+            result = Diagnostic{ ErrorType::FILE_WRITE_ERROR, 0, -1, "", ctx.options.profileOut, name };
+        }
+        return std::move(*result);
+    }
+
+public:
+    Interpreter() {
+        ctx.exitOnError = false;
+        ctx.channels = std::make_shared<channels::Registry>();
+    }
+
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    Options& options() {
+        return ctx.options;
+    }
+
+    // Where `extern "writescr"` output goes, stdout by default
+    void setOutput(std::ostream &out) {
+        ctx.output = &out;
+    }
+
+    // Run inline source, the result holds the global symbol table it left behind
+    Result<std::unordered_map<std::string, SymbolInfo>> eval(const std::string &source, const std::string &name = "<inline>") {
+        std::istringstream stream(source);
+        return guarded(stream, name);
+    }
+
+    // Run the script at `path`, the result holds the global symbol table it left behind
+    Result<std::unordered_map<std::string, SymbolInfo>> run(const std::string &path) {
+        const auto file = modules::open(path);
+        if (!*file) {
+            return Diagnostic{ ErrorType::FILE_NOT_FOUND, 0, -1, "", path, path };
+        }
+        return guarded(*file, path);
+    }
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+// Template JIT for arithmetic, used by tiering with --jit.
+//
+// Each bytecode expression becomes one native function, one machine code template per op: the
+// expression stack lives in xmm0-xmm6, xmm7 is scratch. A function reads its operands, already
+// converted to doubles, from the array in its first argument and stores the result through the
+// second. It returns 0 on success and 1 whenever the interpreter has to take over, which is on
+// every path that ends in an error, so native code never has to report one. Functions are copied
+// into executable pages once assembled and listed in /tmp/perf-<pid>.map for perf.
+//
+// Only x86-64 on POSIX systems is supported, anywhere else nothing gets compiled.
+namespace jit {
+    using Entry = int (*)(const double* operands, double* result);
+
+    inline thread_local bool failed = false; // Set by helpers called from native code
+
+    // Condition operands go through their string form, see tiering::Op::ROUND_TRIP
+    inline double roundTrip(const double value) {
+        try {
+            return std::stod(std::to_string(value));
+        } catch (const std::exception &) {
+            failed = true;
+            return 0;
+        }
+    }
+
+    // Machine code of one expression, built one op at a time
+    class Function {
+    private:
+        static constexpr int REGISTERS = 7; // xmm0-xmm6 hold the stack
+        static constexpr int SCRATCH = 7;
+        static constexpr int32_t SPILL = 72; // Spill slots for xmm0-xmm6, keeps rsp 16-aligned at calls
+
+        std::vector<uint8_t> bytes;
+        std::vector<size_t> failures; // rel32 fields of jumps to the failure exit
+        int depth = 0;
+        int operands = 0;
+        bool valid = true;
+
+        void emit(const std::initializer_list<uint8_t> code) {
+            bytes.insert(bytes.end(), code);
+        }
+
+        void emit32(const uint32_t value) {
+            for (int i = 0; i < 4; i++) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        void emit64(const uint64_t value) {
+            for (int i = 0; i < 8; i++) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        static uint8_t registers(const int reg, const int rm) {
+            return static_cast<uint8_t>(0xC0 | (reg << 3) | rm);
+        }
+
+        // F2/66 0F <op> between two xmm registers
+        void sse(const uint8_t prefix, const uint8_t op, const int dst, const int src) {
+            emit({prefix, 0x0F, op, registers(dst, src)});
+        }
+
+        // movsd xmm, [base + disp32] / movsd [base + disp32], xmm, base is rbx or rsp
+        void memory(const uint8_t op, const int xmm, const bool stack, const int32_t disp) {
+            if (stack) {
+                emit({0xF2, 0x0F, op, static_cast<uint8_t>(0x80 | (xmm << 3) | 4), 0x24});
+            } else {
+                emit({0xF2, 0x0F, op, static_cast<uint8_t>(0x80 | (xmm << 3) | 3)});
+            }
+            emit32(static_cast<uint32_t>(disp));
+        }
+
+        void fail() {
+            emit({0x0F, 0x84}); // je rel32
+            failures.push_back(bytes.size());
+            emit32(0);
+        }
+
+        bool push() {
+            if (depth == REGISTERS) valid = false;
+            return valid && ++depth;
+        }
+
+        bool binary() {
+            if (depth < 2) valid = false;
+            return valid;
+        }
+
+        // Compare the top two and leave 1.0 or 0.0 in their place
+        void compare(const bool swap, const uint8_t set, const uint8_t combine = 0, const uint8_t with = 0) {
+            if (!binary()) return;
+            const int left = depth - 2, right = depth - 1;
+            emit({0x66, 0x0F, 0x2E, swap ? registers(right, left) : registers(left, right)}); // ucomisd
+            emit({0x0F, set, 0xC0});                  // setcc al
+            if (combine != 0) {
+                emit({0x0F, with, 0xC1});             // setcc cl
+                emit({combine, 0xC8});                // and/or al, cl
+            }
+            truth(left);
+            depth--;
+        }
+
+        // xmm = al ? 1.0 : 0.0
+        void truth(const int xmm) {
+            emit({0x0F, 0xB6, 0xC0});                 // movzx eax, al
+            emit({0xF2, 0x0F, 0x2A, registers(xmm, 0)}); // cvtsi2sd xmm, eax
+        }
+
+        // al (or cl) = xmm != 0, NaN included like in C++
+        void nonzero(const int xmm, const bool second) {
+            sse(0x66, 0x57, SCRATCH, SCRATCH); // xorpd xmm7, xmm7
+            emit({0x66, 0x0F, 0x2E, registers(xmm, SCRATCH)});
+            if (second) {
+                emit({0x0F, 0x95, 0xC1, 0x0F, 0x9A, 0xC2, 0x08, 0xD1}); // setne cl, setp dl, or cl, dl
+            } else {
+                emit({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8}); // setne al, setp cl, or al, cl
+            }
+        }
+
+        void logical(const uint8_t combine) {
+            if (!binary()) return;
+            const int left = depth - 2, right = depth - 1;
+            nonzero(left, false);
+            nonzero(right, true);
+            emit({combine, 0xC8});
+            truth(left);
+            depth--;
+        }
+
+    public:
+        Function() {
+            emit({0x53, 0x41, 0x54});                 // push rbx, push r12
+            emit({0x48, 0x81, 0xEC});                 // sub rsp, SPILL
+            emit32(SPILL);
+            emit({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4}); // mov rbx, rdi; mov r12, rsi
+        }
+
+        explicit operator bool() const {
+            return valid;
+        }
+
+        void number(const double value) {
+            if (!push()) return;
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof bits);
+            emit({0x48, 0xB8});                       // mov rax, imm64
+            emit64(bits);
+            emit({0x66, 0x48, 0x0F, 0x6E, registers(depth - 1, 0)}); // movq xmm, rax
+        }
+
+        // The next value of the operand array
+        void operand() {
+            if (!push()) return;
+            memory(0x10, depth - 1, false, operands++ * 8);
+        }
+
+        void add() { if (binary()) sse(0xF2, 0x58, depth - 2, depth - 1), depth--; }
+        void subtract() { if (binary()) sse(0xF2, 0x5C, depth - 2, depth - 1), depth--; }
+        void multiply() { if (binary()) sse(0xF2, 0x59, depth - 2, depth - 1), depth--; }
+
+        // Division by zero is the interpreter's to report
+        void divide() {
+            if (!binary()) return;
+            sse(0x66, 0x57, SCRATCH, SCRATCH);
+            emit({0x66, 0x0F, 0x2E, registers(depth - 1, SCRATCH)}); // ucomisd divisor, 0
+            emit({0x7A, 0x06});                                      // jp over the je: NaN isn't zero
+            fail();
+            sse(0xF2, 0x5E, depth - 2, depth - 1);
+            depth--;
+        }
+
+        void less() { compare(true, 0x97); }           // seta with the operands swapped
+        void greater() { compare(false, 0x97); }
+        void lessEqual() { compare(true, 0x93); }      // setae
+        void greaterEqual() { compare(false, 0x93); }
+        void equal() { compare(false, 0x94, 0x20, 0x9B); }    // sete and setnp
+        void notEqual() { compare(false, 0x95, 0x08, 0x9A); } // setne or setp
+        void both() { logical(0x20); }
+        void either() { logical(0x08); }
+
+        void roundTrip() {
+            if (depth < 1) valid = false;
+            if (!valid) return;
+            const int top = depth - 1;
+            for (int i = 0; i < top; i++) memory(0x11, i, true, i * 8); // Caller-saved, spill them
+            if (top != 0) sse(0xF2, 0x10, 0, top);
+            emit({0x48, 0xB8});
+            emit64(reinterpret_cast<uint64_t>(&jit::roundTrip));
+            emit({0xFF, 0xD0});                       // call rax
+            if (top != 0) sse(0xF2, 0x10, top, 0);
+            for (int i = 0; i < top; i++) memory(0x10, i, true, i * 8);
+        }
+
+        void unsupported() {
+            valid = false;
+        }
+
+        // Finish with the result on the stack and hand over the code
+        std::vector<uint8_t> finish() {
+            if (depth != 1) valid = false;
+            if (!valid) return {};
+            emit({0xF2, 0x41, 0x0F, 0x11, 0x04, 0x24}); // movsd [r12], xmm0
+            emit({0x31, 0xC0});                       // xor eax, eax
+            const auto epilogue = [this] {
+                emit({0x48, 0x81, 0xC4});             // add rsp, SPILL
+                emit32(SPILL);
+                emit({0x41, 0x5C, 0x5B, 0xC3});       // pop r12, pop rbx, ret
+            };
+            epilogue();
+            const size_t failure = bytes.size();
+            emit({0xB8, 0x01, 0x00, 0x00, 0x00});     // mov eax, 1
+            epilogue();
+            for (const size_t field : failures) {
+                const auto rel = static_cast<uint32_t>(static_cast<int64_t>(failure) - static_cast<int64_t>(field + 4));
+                for (int i = 0; i < 4; i++) bytes[field + i] = static_cast<uint8_t>(rel >> (8 * i));
+            }
+            return std::move(bytes);
+        }
+    };
+
+    // Executable copy of the functions of one program, unmapped with it
+    class Code {
+    private:
+        void* memory = nullptr;
+        size_t size = 0;
+        std::vector<Entry> entries;
+
+    public:
+        Code(const std::vector<std::vector<uint8_t>> &functions, const std::string &name) {
+#if defined(__x86_64__) && !defined(_WIN32)
+            std::vector<size_t> offsets;
+            size_t total = 0;
+            for (const auto &function : functions) {
+                offsets.push_back(total);
+                total += (function.size() + 15) & ~size_t{15};
+            }
+            if (total == 0) {
+                entries.assign(functions.size(), nullptr);
+                return;
+            }
+            const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size = (total + page - 1) / page * page;
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                memory = nullptr;
+                entries.assign(functions.size(), nullptr);
+                return;
+            }
+            auto* base = static_cast<uint8_t*>(memory);
+            for (size_t i = 0; i < functions.size(); i++) {
+                std::memcpy(base + offsets[i], functions[i].data(), functions[i].size());
+                entries.push_back(functions[i].empty() ? nullptr : reinterpret_cast<Entry>(base + offsets[i]));
+            }
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+                // W^X policies can refuse executable pages, every evaluation falls back to the bytecode then
+                munmap(memory, size);
+                memory = nullptr;
+                entries.assign(functions.size(), nullptr);
+                return;
+            }
+
+            // perf reads the map of a process by pid, a line per symbol: start, size, name
+            static std::mutex mapMutex;
+            std::lock_guard lock(mapMutex);
+            std::ofstream map("/tmp/perf-" + std::to_string(getpid()) + ".map", std::ios::app);
+            for (size_t i = 0; i < functions.size(); i++) {
+                if (functions[i].empty()) continue;
+                map << std::hex << reinterpret_cast<uintptr_t>(base + offsets[i]) << " " << functions[i].size() << std::dec
+                    << " cvast::" << name << "[expression " << i << "]\n";
+            }
+#else
+            entries.assign(functions.size(), nullptr);
+#endif
+        }
+
+        ~Code() {
+#if !defined(_WIN32)
+            if (memory != nullptr) munmap(memory, size);
+#endif
+        }
+
+        Code(const Code&) = delete;
+        Code& operator=(const Code&) = delete;
+
+        // Native code of function `index`, nullptr when it couldn't be compiled
+        [[nodiscard]] Entry entry(const size_t index) const {
+            return index < entries.size() ? entries[index] : nullptr;
+        }
+
+        [[nodiscard]] size_t compiled() const {
+            return std::ranges::count_if(entries, [](const Entry entry) { return entry != nullptr; });
+        }
+    };
+
+    // Whether native code can run here at all
+    constexpr bool supported() {
+#if defined(__x86_64__) && !defined(_WIN32)
+        return true;
+#else
+        return false;
+#endif
+    }
+}
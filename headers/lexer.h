@@ -6,7 +6,8 @@ enum class TokenType {
     IDENTIFIER,
     NUMBER,
     UNKNOWN,
-    eof
+    eof,
+    LITERAL // A value folded into a function body by ctfe.h, never produced by the lexer
 };
 
 struct Token {
@@ -0,0 +1,117 @@
+#pragma once
+
+// Memoization of pure functions, behind --memoize and @memoize.
+//
+// A function declared `@memoize fn ...`, or every function with --memoize, has its results cached
+// once it is known to be pure (ctfe::pure): a call with the same argument types and values returns
+// the cached result instead of running the body. Purity is decided on the first call, against the
+// names visible to that caller, so callees declared after the function count too. Calls bind
+// dynamically, so a caller that sees another function under one of those names runs the body
+// instead of using the table. Each function has a table of its own holding at most CAPACITY
+// results, the oldest are dropped first.
+// --memo-stats reports the hit rate of every table on stderr once the script is done.
+namespace memo {
+    constexpr size_t CAPACITY = 4096; // Results kept per function
+
+    struct Cache {
+        std::string name;
+        std::mutex mutex;
+        std::unordered_map<std::string, Variable> results;
+        std::deque<std::string> order; // Keys of `results`, oldest first
+        std::vector<tiering::Free> callees; // Functions the results were computed with, see bound()
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+
+        std::optional<Variable> find(const std::string &key) {
+            std::lock_guard lock(mutex);
+            const auto it = results.find(key);
+            if (it == results.end()) {
+                misses.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+
+        void insert(const std::string &key, const Variable &result) {
+            std::lock_guard lock(mutex);
+            if (!results.try_emplace(key, result).second) return; // Another thread got there first
+            order.push_back(key);
+            if (order.size() > CAPACITY) {
+                results.erase(order.front());
+                order.pop_front();
+            }
+        }
+    };
+
+    // Every cache made in this process, for --memo-stats
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Cache>> caches;
+    };
+
+    inline Registry& registry() {
+        static Registry all;
+        return all;
+    }
+
+    // The arguments of a call, each type and value prefixed with its length so no two lists share a key
+    inline std::string key(const std::vector<Variable> &arguments) {
+        std::string joined;
+        for (const Variable &argument : arguments) {
+            for (const std::string* part : {&argument.type, &argument.value}) {
+                joined += std::to_string(part->size());
+                joined += ':';
+                joined += *part;
+            }
+        }
+        return joined;
+    }
+
+    // Whether every call the cached results made binds to the same function from `scope`
+    inline bool bound(const Cache &cache, const tiering::Scope &scope) {
+        return std::ranges::all_of(cache.callees, [&](const tiering::Free &callee) {
+            return tiering::matches(tiering::resolve(scope, callee.path), callee);
+        });
+    }
+
+    // The cache for calls of `func` from `scope`, nullptr when they are not cached
+    inline Cache* cache(const Function &func, const tiering::Scope &scope) {
+        if (!func.memoize && !context().options.memoize) return nullptr;
+        tiering::Profile &profile = *func.profile;
+        std::call_once(profile.memoized, [&] {
+            std::vector<ctfe::Callee> callees;
+            if (!ctfe::pure(func, tiering::materialize(scope), nullptr, &callees)) {
+                if (func.memoize) std::cerr << "memoize: " + func.identifier + " is not pure, its results are not cached\n" << std::flush;
+                return;
+            }
+            profile.memo = std::make_shared<Cache>();
+            profile.memo->name = func.identifier;
+            for (auto &callee : callees) {
+                profile.memo->callees.push_back({std::move(callee.path), tiering::Kind::FUNCTION, std::move(callee.body)});
+            }
+            Registry &all = registry();
+            std::lock_guard lock(all.mutex);
+            all.caches.push_back(profile.memo);
+        });
+        if (profile.memo == nullptr || !bound(*profile.memo, scope)) return nullptr;
+        return profile.memo.get();
+    }
+
+    // --memo-stats, once the program is done
+    inline void report(std::ostream &out) {
+        Registry &all = registry();
+        std::lock_guard lock(all.mutex);
+        std::ostringstream text;
+        text << "memo: " << all.caches.size() << " function(s) cached\n";
+        for (const auto &cache : all.caches) {
+            const uint64_t hits = cache->hits.load(std::memory_order_relaxed);
+            const uint64_t calls = hits + cache->misses.load(std::memory_order_relaxed);
+            const uint64_t permille = calls == 0 ? 0 : hits * 1000 / calls;
+            std::lock_guard entries(cache->mutex);
+            text << "  " << cache->name << ": " << hits << " of " << calls << " calls hit (" << permille / 10 << "." << permille % 10 << "%), "
+                 << cache->results.size() << " result(s) kept\n";
+        }
+        out << text.str() << std::flush;
+    }
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+// Module resolution.
+//
+// Every directory that module lookups touch is listed once and the listing is cached for the
+// rest of the run, so resolving a module is a couple of hash lookups instead of a stat() per
+// candidate path. Long-running servers revalidate the cache between requests. Resolved modules are identified by their canonical path, so the same file
+// reached through different relative paths is recognized as one module.
+namespace modules {
+    enum class Kind {
+        FILE,
+        DIRECTORY
+    };
+
+    // Sources compiled into an executable built with --build, by canonical path. Filled once at
+    // start-up, they stand in for files (and the directories holding them) that may not exist
+    // where the executable runs.
+    inline std::unordered_map<std::string, std::string>& bundle() {
+        static std::unordered_map<std::string, std::string> sources;
+        return sources;
+    }
+
+    // The source at `path`, bundled or on disk
+    inline std::unique_ptr<std::istream> open(const std::string &path) {
+        if (const auto it = bundle().find(path); it != bundle().end()) {
+            return std::make_unique<std::istringstream>(it->second);
+        }
+        return std::make_unique<std::ifstream>(path);
+    }
+
+    // What a source file looked like when it was read, to tell whether it changed since
+    struct Stamp {
+        std::filesystem::file_time_type modified{};
+        uintmax_t size = 0;
+
+        bool operator==(const Stamp&) const = default;
+    };
+
+    inline Stamp stamp(const std::string &path) {
+        if (bundle().contains(path)) return {};
+        std::error_code ec;
+        const auto modified = std::filesystem::last_write_time(path, ec);
+        return {modified, std::filesystem::file_size(path, ec)};
+    }
+
+    class Index {
+    private:
+        std::mutex mutex;
+        bool initialized = false;
+        std::filesystem::path workingDirectory;
+        std::vector<std::filesystem::path> searchPath;
+        struct Listing {
+            std::filesystem::file_time_type modified;
+            std::unordered_map<std::string, Kind> entries;
+        };
+
+        std::unordered_map<std::string, Listing> listings;
+        std::unordered_map<std::string, std::string> canonicalPaths;
+        std::unordered_map<std::string, std::optional<std::string>> resolved;
+
+        void initialize() {
+            if (initialized) return;
+            initialized = true;
+
+            std::error_code ec;
+            workingDirectory = std::filesystem::current_path(ec);
+
+            // CVAST_PATH holds several roots, separated the same way PATH is on this platform
+#if defined(_WIN32)
+            constexpr char separator = ';';
+#else
+            constexpr char separator = ':';
+#endif
+            if (const char* env = std::getenv("CVAST_PATH")) {
+                std::istringstream roots(env);
+                std::string root;
+                while (std::getline(roots, root, separator)) {
+                    if (!root.empty()) searchPath.emplace_back(std::filesystem::absolute(root, ec).lexically_normal());
+                }
+            }
+        }
+
+        const std::unordered_map<std::string, Kind>& list(const std::filesystem::path &directory) {
+            auto [it, inserted] = listings.try_emplace(directory.string());
+            auto &entries = it->second.entries;
+            if (inserted) {
+                std::error_code ec;
+                it->second.modified = std::filesystem::last_write_time(directory, ec);
+                for (const auto &entry : std::filesystem::directory_iterator(directory, ec)) {
+                    entries[entry.path().filename().string()] = entry.is_directory(ec) ? Kind::DIRECTORY : Kind::FILE;
+                }
+                for (const auto &path : bundle() | std::views::keys) {
+                    // The file itself, or the directory on its way that sits in `directory`
+                    for (std::filesystem::path entry = path; entry.has_relative_path(); entry = entry.parent_path()) {
+                        if (entry.parent_path() == directory) {
+                            entries.try_emplace(entry.filename().string(), entry.string() == path ? Kind::FILE : Kind::DIRECTORY);
+                            break;
+                        }
+                    }
+                }
+            }
+            return entries;
+        }
+
+        std::optional<Kind> lookup(const std::filesystem::path &path) {
+            const auto &entries = list(path.parent_path());
+            if (const auto it = entries.find(path.filename().string()); it != entries.end()) {
+                return it->second;
+            }
+            return std::nullopt;
+        }
+
+        std::string canonicalize(const std::filesystem::path &path) {
+            auto [it, inserted] = canonicalPaths.try_emplace(path.string());
+            if (inserted) {
+                std::error_code ec;
+                const auto canonical = std::filesystem::weakly_canonical(path, ec);
+                it->second = ec ? path.string() : canonical.string();
+            }
+            return it->second;
+        }
+
+        std::filesystem::path absolute(const std::filesystem::path &base, const std::string &location) const {
+            const std::filesystem::path path(location);
+            return (path.is_absolute() ? path : base / path).lexically_normal();
+        }
+
+    public:
+        // Used when a forked child takes over a client's working directory. Directory listings and
+        // canonical paths are absolute and stay warm, only results of relative lookups are dropped.
+        void setWorkingDirectory(const std::filesystem::path &directory) {
+            std::lock_guard lock(mutex);
+            initialize();
+            workingDirectory = directory;
+            resolved.clear();
+        }
+
+        // Drop the listings of directories modified since they were listed, and with them every
+        // lookup result, so files added, removed or renamed since are seen. Servers call this before
+        // each request, it costs a stat() per directory listed so far.
+        void revalidate() {
+            std::lock_guard lock(mutex);
+            bool changed = false;
+            for (auto it = listings.begin(); it != listings.end();) {
+                std::error_code ec;
+                if (std::filesystem::last_write_time(it->first, ec) != it->second.modified) {
+                    it = listings.erase(it);
+                    changed = true;
+                } else {
+                    ++it;
+                }
+            }
+            if (changed) {
+                canonicalPaths.clear();
+                resolved.clear();
+            }
+        }
+
+        // Canonical path of the file `merge "location"` refers to when written inside `importer`.
+        // Candidates are tried relative to the working directory, the importing file and then
+        // every CVAST_PATH root, in that order.
+        std::optional<std::string> resolve(const std::string &location, const std::string &importer) {
+            std::lock_guard lock(mutex);
+            initialize();
+
+            const std::filesystem::path importerDirectory = absolute(workingDirectory, importer).parent_path();
+            const std::string key = importerDirectory.string() + '\n' + location;
+            if (const auto it = resolved.find(key); it != resolved.end()) {
+                return it->second;
+            }
+
+            std::vector<std::filesystem::path> candidates = {absolute(workingDirectory, location), absolute(importerDirectory, location)};
+            for (const auto &root : searchPath) {
+                candidates.push_back(absolute(root, location));
+            }
+
+            std::optional<std::string> result;
+            for (const auto &candidate : candidates) {
+                if (lookup(candidate) == Kind::FILE) {
+                    result = canonicalize(candidate);
+                    break;
+                }
+            }
+            return resolved[key] = result;
+        }
+
+        // Resolve `stdlib@"location"` below `root`, a directory wins over `location.cv`
+        std::optional<std::pair<std::string, Kind>> resolveStdlib(const std::string &root, const std::string &location) {
+            std::lock_guard lock(mutex);
+            initialize();
+
+            const std::filesystem::path path = absolute(absolute(workingDirectory, root), location);
+            if (lookup(path) == Kind::DIRECTORY) {
+                return std::make_pair(canonicalize(path), Kind::DIRECTORY);
+            }
+
+            auto file = path;
+            file += ".cv";
+            if (lookup(file) == Kind::FILE) {
+                return std::make_pair(canonicalize(file), Kind::FILE);
+            }
+            return std::nullopt;
+        }
+
+        // Canonical paths of every .cv file directly inside `directory`, sorted by name
+        std::vector<std::string> moduleFiles(const std::string &directory) {
+            std::lock_guard lock(mutex);
+            initialize();
+
+            std::vector<std::string> files;
+            for (const auto &[name, kind] : list(directory)) {
+                if (kind == Kind::FILE && std::filesystem::path(name).extension() == ".cv") {
+                    files.push_back(name);
+                }
+            }
+            std::ranges::sort(files);
+            for (auto &file : files) {
+                file = canonicalize(std::filesystem::path(directory) / file);
+            }
+            return files;
+        }
+    };
+
+    inline Index& index() {
+        static Index instance;
+        return instance;
+    }
+}
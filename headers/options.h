@@ -0,0 +1,24 @@
+#pragma once
+
+// Command line switches that change how a program is loaded or executed.
+struct Options {
+    bool treeShake = false; // --tree-shake: drop symbols the entry file can never reach.
+    bool autoParallel = false; // --auto-parallel: run independent top-level statements concurrently.
+    uint64_t tierThreshold = 1000; // --tier-threshold: calls before a function is compiled to bytecode, 0 never compiles.
+    bool tierLog = false;      // --tier-log: report functions being compiled (or left interpreted) on stderr.
+    bool jit = false;          // --jit: also compile the arithmetic of compiled functions to x86-64 code.
+    int optimize = 1;          // -O0/-O1/-O2: passes run over compiled code, -O2 also compiles top-level statements.
+    bool dumpIr = false;       // --dump-ir: print the IR of every program once optimized, on stderr.
+    bool timePasses = false;   // --time-passes: report the time spent in each optimization pass.
+    bool memoize = false;      // --memoize: cache the results of every pure function, not only @memoize ones.
+    bool memoStats = false;    // --memo-stats: report the hit rate of every memoized function.
+    size_t maxSpecializations = 4; // --max-specializations: programs per function for the argument types of its calls, 0 none.
+    std::string emitCpp;     // --emit-cpp: translate the program to this C++ file instead of running it.
+    std::string build;       // --build: translate the program and compile it to this executable.
+    std::string snapshotIn;  // --snapshot-in: restore declarations and merges from this image.
+    std::string snapshotOut; // --snapshot-out: write the initialized global state to this image.
+    std::string profileIn;   // --profile-in: start from the call counts, branches and types this profile recorded.
+    std::string profileOut;  // --profile-out: record them to this profile once the script is done.
+    std::string forkServer;  // --fork-server: serve script launches on this Unix socket.
+    std::vector<std::string> preload; // --preload: scripts run by the fork server before it starts listening.
+};
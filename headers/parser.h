@@ -14,18 +14,29 @@ inline std::vector<std::string> split(const std::string &str, const char delimit
     return tokens;
 }
 
+// Thrown by `return` and caught by the call running the function body
+struct ReturnValue {
+    std::string value;
+};
+
 class Parser {
 private:
-    std::unique_ptr<std::vector<Token>> tokens; // Change to unique_ptr
-    std::unique_ptr<std::vector<Token>> unfilteredTokens;
+    std::shared_ptr<const std::vector<Token>> tokens; // Shared with the Function the body belongs to
+    std::shared_ptr<const std::vector<Token>> unfilteredTokens;
     int currentToken;
     std::unordered_map<std::string, SymbolInfo> globalSymbolTable;
     std::string scope;
     std::vector<std::string> types = {"int", "float", "double", "char", "string", "bool", "void", "any"};
     std::string filePath;
+    treeshake::Pass* shaker = nullptr; // Only set on the entry file's parser when --tree-shake is on
+    std::shared_ptr<const std::unordered_set<std::string>> restored; // Names a snapshot image declared, their `fn` and `merge` are skipped
+    bool inFunction = false; // Parsing a function body (or a block inside one), where `return` is allowed
+    std::shared_ptr<inlinecache::Sites> sites; // Set for function bodies and the blocks inside them
+    size_t siteBase = 0; // Index in the body of tokens[0]
+    std::vector<std::string> sources; // Files of every module this parser merged, see Module
 
 public:
-    explicit Parser(std::unique_ptr<std::vector<Token>> tokens, std::unique_ptr<std::vector<Token>> unfilteredTokens, const std::string& filePath, std::string scope = "global")
+    explicit Parser(std::shared_ptr<const std::vector<Token>> tokens, std::shared_ptr<const std::vector<Token>> unfilteredTokens, const std::string& filePath, std::string scope = "global")
         : tokens(std::move(tokens)), unfilteredTokens(std::move(unfilteredTokens)), currentToken(0), scope(std::move(scope)), filePath(filePath)
     {
         set_filePath(filePath);
@@ -34,12 +45,12 @@ public:
     // This would mean to ignore function internals until used
     static std::tuple<std::vector<Token>, std::vector<Token>> getScope(int& pos, const std::vector<Token> &tokens, const std::vector<Token> &unfilteredTokens) {
         int amount = 0;
-        SEGFAULTErrContext ctx = {unfilteredLines[tokens[pos].line].c_str(), tokens[pos].line, tokens[pos].column};
+        SEGFAULTErrContext ctx = {context().unfilteredLines[tokens[pos].line].c_str(), tokens[pos].line, tokens[pos].column};
         const int initialPos = pos;
         do {
             if (tokens[pos].column != 0) {
-                ctx = {unfilteredLines[tokens[pos].line].c_str(), tokens[pos].line, tokens[pos].column};
-                error_context.store(&ctx);
+                ctx = {context().unfilteredLines[tokens[pos].line].c_str(), tokens[pos].line, tokens[pos].column};
+                context().crashContext = &ctx;
             }
 
             if (tokens[pos].value == "{") {
@@ -50,7 +61,12 @@ public:
             ++pos;
         } while (amount != 0);
         pos--;
-        return {{tokens.begin() + initialPos + 1, tokens.begin() + pos}, {unfilteredTokens.begin() + initialPos + 1, unfilteredTokens.begin() + pos}};
+        // Terminated like a whole file, so lookahead at the end of a block stays in bounds
+        std::vector<Token> body(tokens.begin() + initialPos + 1, tokens.begin() + pos);
+        std::vector<Token> unfilteredBody(unfilteredTokens.begin() + initialPos + 1, unfilteredTokens.begin() + pos);
+        body.push_back({TokenType::eof, "", tokens[pos].line, 0});
+        unfilteredBody.push_back({TokenType::eof, "", tokens[pos].line, 0});
+        return {body, unfilteredBody};
     }
 
     static void setPos2ScopeEnd(int &pos, const std::vector<Token> &tokens) {
@@ -69,8 +85,26 @@ public:
     void parseFunction(int& pos) {
         std::cout << "Parsing function" << std::endl;
         keyword::_pfn PARGS // fn
+        const size_t line = (*tokens)[pos].line;
         const std::string name = ascii::_aname PARGS // Function name
 
+        if (restored && restored->contains(name)) {
+            // Already declared by the snapshot image
+            combinators::_pparse_until(pos, *tokens, "{");
+            setPos2ScopeEnd(pos, *tokens);
+            pos--;
+            return;
+        }
+
+        if (shaker != nullptr && !shaker->keepFunction(name)) {
+            // Never called from anywhere reachable, skip the declaration entirely
+            combinators::_pparse_until(pos, *tokens, "{");
+            setPos2ScopeEnd(pos, *tokens);
+            shaker->dropFunction();
+            pos--;
+            return;
+        }
+
         globalSymbolTable[name] = Function(name); // Instantiating a new function object (_pparams require pre-existing function instance to add too it)
 
         abstract::_pparams(pos, *tokens, types, name, globalSymbolTable, *unfilteredTokens); // Parameters
@@ -81,59 +115,218 @@ public:
         auto [body, unfilteredBody] = getScope (pos, *tokens, *unfilteredTokens); // Function body
 
         std::get<Function>(globalSymbolTable[name]).returnType = returnType;
-        std::get<Function>(globalSymbolTable[name]).body = body;
-        std::get<Function>(globalSymbolTable[name]).unfilteredBody = unfilteredBody;
+        std::get<Function>(globalSymbolTable[name]).body = std::make_shared<const std::vector<Token>>(std::move(body));
+        std::get<Function>(globalSymbolTable[name]).unfilteredBody = std::make_shared<const std::vector<Token>>(std::move(unfilteredBody));
         std::get<Function>(globalSymbolTable[name]).scopeLevel = this->scope;
+        ctfe::fold(std::get<Function>(globalSymbolTable[name]), globalSymbolTable, filePath, &Parser::evaluate); // const and static initializers
+        std::get<Function>(globalSymbolTable[name]).profile->precompiled = tiering::findPrecompiled(filePath, name);
+        pgo::attach(std::get<Function>(globalSymbolTable[name]), filePath, line);
+    }
+
+    // `@memoize fn ...`: the function's results are cached when it is pure, see memo.h
+    void parseAnnotation(int &pos) {
+        std::cout << "Parsing annotation" << std::endl;
+        symbol::_patsign PARGS // @
+        const int at = pos;
+        const std::string annotation = ascii::_aname PARGS // Annotation
+        if (annotation != "memoize" || (*tokens)[pos].value != "fn") {
+            ErrInfo errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[at].line, (*tokens)[at].column, context().unfilteredLines[(*tokens)[at].line], "@memoize fn", context().currfilePath };
+            error::gen(errInfo);
+        }
+        const std::string name = (*tokens)[pos + 1].value;
+        parseFunction(pos);
+        if (const auto it = globalSymbolTable.find(name); it != globalSymbolTable.end() && std::holds_alternative<Function>(it->second)) {
+            std::get<Function>(it->second).memoize = true;
+        }
     }
 
     void parseVariable(int& pos) {
         std::cout << "Parsing variable" << std::endl;
-        keyword::_pvar PARGS // var
+        if ((*tokens)[pos].value == "const") {
+            keyword::_pconst PARGS // const, already folded in function bodies
+        } else {
+            keyword::_pvar PARGS // var
+        }
         const std::string name = ascii::_aname PARGS // Variable name
         symbol::_pcolon PARGS // :
         const std::string type = abstract::_isType((*tokens)[pos].value, types, pos, *tokens); // Type
         symbol::_peq PARGS // =
-        const std::string value = abstract::_value(pos, *tokens, type, *unfilteredTokens, globalSymbolTable); // Value
+        const std::string value = parseInitializer(pos, type); // Value
 
         globalSymbolTable[name] = Variable(name, type, value, this->scope);
     }
 
+    // The value of a declaration's initializer, as a `type`
+    std::string parseInitializer(int &pos, const std::string &type) {
+        if ((*tokens)[pos].type == TokenType::LITERAL) {
+            return (*tokens)[pos++].value; // Folded when the function was declared, see ctfe.h
+        }
+        if ((*tokens)[pos].value == "static") {
+            // Runs now either way at the top level, only the callee is checked
+            keyword::_pstatic PARGS // static
+            size_t at = pos;
+            const Function* func = ctfe::callee(*tokens, at, globalSymbolTable);
+            if (func == nullptr || !ctfe::pure(*func, globalSymbolTable)) {
+                ErrInfo errInfo = { ErrorType::EXPECTED_VALID_EXPRESSION, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "Call of a pure function", context().currfilePath };
+                error::gen(errInfo);
+            }
+        }
+        if ((*tokens)[pos].value == "extern") {
+            return parseExtern(pos);
+        }
+        if (isOperand(pos)) {
+            return coerce(parseOperand(pos).value, type);
+        }
+        return abstract::_value(pos, *tokens, type, *unfilteredTokens, globalSymbolTable);
+    }
+
+    // ctfe::Evaluate: run an initializer on its own, against `symbols`
+    static std::string evaluate(const std::vector<Token> &tokens, const std::vector<Token> &unfilteredTokens, const std::string &type,
+                                const std::unordered_map<std::string, SymbolInfo> &symbols, const std::string &filePath) {
+        Parser parser(std::make_shared<const std::vector<Token>>(tokens), std::make_shared<const std::vector<Token>>(unfilteredTokens), filePath);
+        parser.set_globalSymbolTable(symbols);
+        int pos = 0;
+        return parser.parseInitializer(pos, type);
+    }
+
+    // Modules already parsed by any interpreter in this process, keyed by canonical path and alias:
+    // a module's functions and variables record the alias they were merged under as their scope, so
+    // the same file merged under another alias is parsed again. A cached table is never modified,
+    // so after the lookup it is read without holding the lock, and merging it binds a namespace to
+    // the same table. A module whose files changed on disk since they were parsed is parsed again,
+    // interpreters still running the old table keep it.
+    struct Module {
+        std::shared_ptr<const std::unordered_map<std::string, SymbolInfo>> symbols;
+        std::vector<std::string> sources; // Canonical paths of its file and of every module it merges
+        std::vector<modules::Stamp> stamps; // Of `sources`, as they were parsed
+
+        [[nodiscard]] bool current() const {
+            for (size_t i = 0; i < stamps.size(); i++) {
+                if (modules::stamp(sources[i]) != stamps[i]) return false;
+            }
+            return true;
+        }
+    };
+    static inline std::mutex loadedModulesMutex;
+    static inline std::unordered_map<std::string, std::shared_ptr<const Module>> loadedModules;
+
+    // Lex and parse the module at (canonical) `path`, or reuse it if it was merged before
+    std::shared_ptr<const Module> loadModule(const std::string& path, const std::string& alias) {
+        const std::string key = path + '\n' + alias;
+        {
+            std::lock_guard lock(loadedModulesMutex);
+            if (const auto it = loadedModules.find(key); it != loadedModules.end() && it->second->current()) {
+                return it->second;
+            }
+        }
+
+        const modules::Stamp stamp = modules::stamp(path);
+        const auto file = modules::open(path);
+        Lexer lexer(*file);
+        auto [moduleTokens, moduleUnfiltered, moduleUnfilteredLines] = lexer.tokenize();
+
+        // Save the original unfiltered lines and set the new ones
+        auto originalUnfilteredLines = context().unfilteredLines;
+        set_unfilteredLines(moduleUnfilteredLines);
+
+        std::string originalFilePath = filePath;
+        set_filePath(path);
+
+        Parser parser(std::make_unique<std::vector<Token>>(moduleTokens), std::make_unique<std::vector<Token>>(moduleUnfiltered), path, alias);
+        parser.parse();
+
+        // Restore the original unfiltered lines
+        set_unfilteredLines(originalUnfilteredLines);
+
+        // Restore the original file path
+        set_filePath(originalFilePath);
+
+        // Get the symbol table
+        auto module = std::make_shared<Module>();
+        module->symbols = std::make_shared<const std::unordered_map<std::string, SymbolInfo>>(parser.getSymbolTable());
+        module->sources.push_back(path);
+        module->stamps.push_back(stamp);
+        for (const auto &source : parser.sources) {
+            module->sources.push_back(source);
+            module->stamps.push_back(modules::stamp(source));
+        }
+
+        // Another interpreter may have finished the same version of the module first, everyone shares its copy
+        std::lock_guard lock(loadedModulesMutex);
+        auto &loaded = loadedModules[key];
+        if (!loaded || loaded->stamps != module->stamps) loaded = std::move(module);
+        return loaded;
+    }
+
+    // Merge every .cv file of a directory into one namespace. Files are loaded and parsed concurrently,
+    // then combined in file name order so that a symbol defined twice is always reported the same way.
+    Module loadDirectory(const std::string& path, const std::string& alias, const int pos) {
+        const auto files = modules::index().moduleFiles(path);
+
+        const Context &parent = context();
+        std::vector<std::future<std::shared_ptr<const Module>>> pending;
+        for (const auto &file : files) {
+            pending.push_back(std::async(std::launch::async, [this, file, alias, &parent] {
+                // Workers report errors and output the same way the merging thread does, but track
+                // the file they parse in a context of their own
+                Context worker = parent;
+                ContextScope scope(worker);
+                return loadModule(file, alias);
+            }));
+        }
+
+        std::unordered_map<std::string, SymbolInfo> symbols;
+        std::vector<std::string> sources;
+        std::vector<modules::Stamp> stamps;
+        std::unordered_map<std::string, std::string> definedIn;
+        for (size_t i = 0; i < files.size(); i++) {
+            const auto module = pending[i].get();
+            const auto &moduleSymbols = module->symbols;
+            std::ranges::copy(module->sources, std::back_inserter(sources));
+            std::ranges::copy(module->stamps, std::back_inserter(stamps));
+
+            std::vector<std::string> names;
+            for (const auto &name : *moduleSymbols | std::views::keys) {
+                names.push_back(name);
+            }
+            std::ranges::sort(names);
+
+            for (const auto &name : names) {
+                if (const auto [it, inserted] = definedIn.try_emplace(name, files[i]); !inserted) {
+                    ErrInfo errInfo = { ErrorType::DUPLICATE_MODULE_SYMBOL, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line],
+                                name + "' in '" + it->second + "' and '" + files[i], context().currfilePath };
+                    error::gen(errInfo);
+                }
+                symbols[name] = moduleSymbols->at(name);
+            }
+        }
+        return {std::make_shared<const std::unordered_map<std::string, SymbolInfo>>(std::move(symbols)), std::move(sources), std::move(stamps)};
+    }
+
     void parseMerge(int& pos) {
         std::cout << "Parsing merge" << std::endl;
+        if (restored) {
+            // The snapshot image already holds the merged namespace, skip past `as alias;`
+            int end = pos;
+            combinators::_pparse_until(end, *tokens, ";");
+            if (restored->contains((*tokens)[end - 1].value)) {
+                pos = end;
+                return;
+            }
+        }
         keyword::_pmerge PARGS // merge
         if (const auto [val, func] =
             combinators::_ror<abstract::noErr::_pmodule, keyword::noErr::_rpstdlib> PARGS func == abstract::noErr::_pmodule)
             {
 
-            std::string moduleLoc = val; // Module location
+            std::string moduleLoc = val; // Module location (canonical)
             keyword::_pas PARGS
             std::string alias = ascii::_aname PARGS
 
-            std::ifstream file(moduleLoc);
-            Lexer lexer(file);
-            auto [moduleTokens, moduleUnfiltered, moduleUnfilteredLines] = lexer.tokenize();
-
-            // Save the original unfiltered lines and set the new ones
-            auto originalUnfilteredLines = unfilteredLines;
-            set_unfilteredLines(moduleUnfilteredLines);
-
-            std::string originalFilePath = filePath;
-            set_filePath(moduleLoc);
-
-            Parser parser(std::make_unique<std::vector<Token>>(moduleTokens), std::make_unique<std::vector<Token>>(moduleUnfiltered), moduleLoc, alias);
-            parser.parse();
-
-            // Restore the original unfiltered lines
-            set_unfilteredLines(originalUnfilteredLines);
-
-            // Restore the original file path
-            set_filePath(originalFilePath);
-
-            // Get the symbol table
-            auto moduleSymbolTable = parser.getSymbolTable();
-
-            auto ns = Namespace(alias, moduleSymbolTable);
-            globalSymbolTable[alias] = ns;
+            const auto module = loadModule(moduleLoc, alias);
+            std::ranges::copy(module->sources, std::back_inserter(sources));
+            globalSymbolTable[alias] = Namespace(alias, module->symbols);
+            if (shaker != nullptr) shaker->merged(alias, globalSymbolTable);
         } else if (func == keyword::noErr::_rpstdlib) {
             symbol::_patsign PARGS
             std::string loc = ascii::_pstring PARGS
@@ -142,55 +335,29 @@ public:
 
             const char* stdlibPath = std::getenv("CVAST_STDLIB");
             if (stdlibPath == nullptr) {
-                errInfo = { ErrorType::EXPECTED_ENV_VAR, (*tokens)[pos].line, (*tokens)[pos].column, unfilteredLines[(*tokens)[pos].line], "CVAST_STDLIB", currfilePath };
+                ErrInfo errInfo = { ErrorType::EXPECTED_ENV_VAR, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "CVAST_STDLIB", context().currfilePath };
                 error::gen(errInfo);
             }
             std::cout << "stdlib path: " << stdlibPath << std::endl;
-            // check if is a directory (foulder) first, if not, add .cv and check again
-            std::string fullPath = std::string(stdlibPath) + "/" + loc;
-            if (!std::filesystem::is_directory(fullPath)) {
-                fullPath += ".cv";
-            } else {
-                // TODO: handle directory merging later (merge all files in directory), error for now
-                errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[pos].line, (*tokens)[pos].column, unfilteredLines[(*tokens)[pos].line], "File, not directory", currfilePath };
-                error::gen(errInfo);
-            }
+            // a directory takes precedence over loc + ".cv"
+            const auto resolved = modules::index().resolveStdlib(stdlibPath, loc);
 
             // check if file exists
-            if (!std::filesystem::exists(fullPath)) {
-                errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[pos - 3].line, (*tokens)[pos - 3].column, unfilteredLines[(*tokens)[pos - 3].line], "Invalid stdlib file", currfilePath };
+            if (!resolved) {
+                ErrInfo errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[pos - 3].line, (*tokens)[pos - 3].column, context().unfilteredLines[(*tokens)[pos - 3].line], "Invalid stdlib file", context().currfilePath };
                 error::gen(errInfo);
             }
 
-            std::ifstream file(fullPath);
-            Lexer lexer(file);
-            auto [moduleTokens, moduleUnfiltered, moduleUnfilteredLines] = lexer.tokenize();
-
-            // Save the original unfiltered lines and set the new ones
-            auto originalUnfilteredLines = unfilteredLines;
-            set_unfilteredLines(moduleUnfilteredLines);
-
-            std::string originalFilePath = filePath;
-            set_filePath(fullPath);
-
-            Parser parser(std::make_unique<std::vector<Token>>(moduleTokens), std::make_unique<std::vector<Token>>(moduleUnfiltered), fullPath, alias);
-            parser.parse();
-
-            // Restore the original unfiltered lines
-            set_unfilteredLines(originalUnfilteredLines);
-
-            // Restore the original file path
-            set_filePath(originalFilePath);
-
-            // Get the symbol table
-            auto moduleSymbolTable = parser.getSymbolTable();
-
-            auto ns = Namespace(alias, moduleSymbolTable);
-            globalSymbolTable[alias] = ns;
+            const auto [fullPath, kind] = *resolved;
+            const Module module = kind == modules::Kind::DIRECTORY ? loadDirectory(fullPath, alias, pos - 3) : *loadModule(fullPath, alias);
+            std::ranges::copy(module.sources, std::back_inserter(sources));
+            globalSymbolTable[alias] = Namespace(alias, module.symbols);
+            if (shaker != nullptr) shaker->merged(alias, globalSymbolTable);
         }
     }
 
-    void parseExtern(int &pos) {
+    // Returns the value the extern produces, empty for the ones that produce none
+    std::string parseExtern(int &pos) {
         std::cout << "Parsing extern" << std::endl;
         keyword::_pextern PARGS // extern
         const std::string action = ascii::_pstring PARGS // Action
@@ -198,19 +365,131 @@ public:
             symbol::_popen PARGS // (
             const std::string message = abstract::_pvar_val(pos, *tokens, globalSymbolTable); // Message
             symbol::_pclose PARGS // )
-            std::cout << message << "\n";
+            std::lock_guard lock(*context().outputMutex);
+            *context().output << message << "\n";
         } else if (action == "readscr") {
             symbol::_popen PARGS // (
             symbol::_pclose PARGS // )
+        } else if (action == "spawn") {
+            symbol::_popen PARGS // (
+            const int at = pos;
+            const Function func = parseCallee(pos); // Function
+            std::vector<Variable> arguments;
+            while ((*tokens)[pos].value == ",") {
+                symbol::_pcomma PARGS // ,
+                arguments.push_back(abstract::_pcall_arg(pos, *tokens, globalSymbolTable, *unfilteredTokens)); // Argument
+            }
+            symbol::_pclose PARGS // )
+            checkArguments(at, func, arguments);
+            return spawn(func, arguments);
+        } else if (action == "join") {
+            symbol::_popen PARGS // (
+            const int at = pos;
+            const std::string handle = abstract::_pvar_val(pos, *tokens, globalSymbolTable); // Task handle
+            symbol::_pclose PARGS // )
+            join(at, handle);
+        } else if (action == "par_for" || action == "par_reduce") {
+            symbol::_popen PARGS // (
+            const int at = pos;
+            const int64_t begin = parseBound(pos); // Start
+            symbol::_pcomma PARGS // ,
+            const int64_t end = parseBound(pos); // End
+            symbol::_pcomma PARGS // ,
+            const Function fn = parseCallee(pos); // Body, called with the index
+            if (action == "par_for") {
+                symbol::_pclose PARGS // )
+                return parallelLoop(at, begin, end, fn, nullptr, Variable{});
+            }
+            symbol::_pcomma PARGS // ,
+            const Variable init = abstract::_pcall_arg(pos, *tokens, globalSymbolTable, *unfilteredTokens); // Initial value
+            symbol::_pcomma PARGS // ,
+            const Function op = parseCallee(pos); // Combining function
+            symbol::_pclose PARGS // )
+            return parallelLoop(at, begin, end, fn, &op, init);
+        } else if (action == "sleep") {
+            symbol::_popen PARGS // (
+            const int64_t milliseconds = parseBound(pos); // Duration in milliseconds
+            symbol::_pclose PARGS // )
+            scheduler::sleepFor(std::chrono::milliseconds(std::max<int64_t>(milliseconds, 0)));
+        } else if (action == "chan_new") {
+            symbol::_popen PARGS // (
+            const int64_t capacity = parseBound(pos); // Capacity
+            symbol::_pclose PARGS // )
+            return channels::registry().create(static_cast<size_t>(std::max<int64_t>(capacity, 1)));
+        } else if (action == "chan_send") {
+            symbol::_popen PARGS // (
+            const auto channel = parseChannel(pos); // Channel
+            symbol::_pcomma PARGS // ,
+            const int at = pos;
+            const Variable value = abstract::_pcall_arg(pos, *tokens, globalSymbolTable, *unfilteredTokens); // Value
+            symbol::_pclose PARGS // )
+            if (!channel->send(value.value)) {
+                ErrInfo errInfo = { ErrorType::INVALID_OPERATION, (*tokens)[at].line, (*tokens)[at].column, context().unfilteredLines[(*tokens)[at].line], "Send on a closed channel", context().currfilePath };
+                error::gen(errInfo);
+            }
+        } else if (action == "chan_recv") {
+            symbol::_popen PARGS // (
+            const auto channel = parseChannel(pos); // Channel
+            symbol::_pclose PARGS // )
+            return channel->receive().value_or(""); // Empty once closed and drained
+        } else if (action == "chan_close") {
+            symbol::_popen PARGS // (
+            const auto channel = parseChannel(pos); // Channel
+            symbol::_pclose PARGS // )
+            channel->close();
         } else {
-            errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[pos].line, (*tokens)[pos].column, unfilteredLines[(*tokens)[pos].line], "writescr, readscr", currfilePath };
+            ErrInfo errInfo = { ErrorType::EXPECTED_ONE_OF, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "writescr, readscr, sleep, spawn, join, par_for, par_reduce, chan_new, chan_send, chan_recv, chan_close", context().currfilePath };
             error::gen(errInfo);
         }
+        return "";
     }
 
     void parseReturn(int &pos) {
         std::cout << "Parsing return" << std::endl;
+        const int at = pos;
         keyword::_preturn PARGS // return
+        if (!inFunction) {
+            ErrInfo errInfo = { ErrorType::INVALID_RETURN, (*tokens)[at].line, (*tokens)[at].column, context().unfilteredLines[(*tokens)[at].line], "Return inside a function body", context().currfilePath };
+            error::gen(errInfo);
+        }
+        throw ReturnValue{ parseExpression(pos) }; // Value
+    }
+
+    // The value of the expression from `pos` up to the next `;`: a string literal, a variable, a call
+    // or an arithmetic expression
+    std::string parseExpression(int &pos) {
+        int end = pos;
+        combinators::_pparse_until(end, *tokens, ";");
+        if (end == pos) {
+            return "";
+        }
+        if ((*tokens)[pos].value == "\"") {
+            return abstract::_value(pos, *tokens, "string", *unfilteredTokens, globalSymbolTable);
+        }
+        if ((*tokens)[pos].type == TokenType::LITERAL) {
+            const std::string value = (*tokens)[pos].value; // `return static ...;`, folded when the function was declared
+            pos = end;
+            return value;
+        }
+        if (isOperand(pos)) {
+            const std::string value = parseOperand(pos).value;
+            pos = end;
+            return value;
+        }
+        if (end - pos == 1) {
+            if (const auto it = globalSymbolTable.find((*tokens)[pos].value); it != globalSymbolTable.end() && std::holds_alternative<Variable>(it->second)) {
+                pos = end;
+                return std::get<Variable>(it->second).value;
+            }
+        }
+
+        std::string value = abstract::_value(pos, *tokens, "any", *unfilteredTokens, globalSymbolTable);
+        if (value.starts_with("Error: ")) {
+            ErrInfo errInfo = { ErrorType::EXPECTED_VALID_EXPRESSION, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], value.substr(7), context().currfilePath };
+            error::gen(errInfo);
+        }
+        pos = end;
+        return value;
     }
 
     void parseElseIf(int &pos) {
@@ -237,11 +516,15 @@ public:
 
         if (conditionResult) {
             // Parse then-block
+            const int open = pos;
             auto [body, unfilteredBody] = getScope(pos, *tokens, *unfilteredTokens);
             Parser bodyParser(std::make_unique<std::vector<Token>>(body),
                              std::make_unique<std::vector<Token>>(unfilteredBody),
                              filePath, scope);
             bodyParser.set_globalSymbolTable(globalSymbolTable);
+            bodyParser.inFunction = inFunction;
+            bodyParser.sites = sites;
+            bodyParser.siteBase = siteBase + open + 1;
             bodyParser.parse();
             symbol::_pcurly_close PARGS // }
             // Skip else and else if blocks if present
@@ -273,11 +556,15 @@ public:
             keyword::noErr::_pelse PARGS
             if (!conditionResult) {
                 // Parse else-block
+                const int open = pos;
                 auto [body, unfilteredBody] = getScope(pos, *tokens, *unfilteredTokens);
                 Parser bodyParser(std::make_unique<std::vector<Token>>(body),
                                  std::make_unique<std::vector<Token>>(unfilteredBody),
                                  filePath, scope);
                 bodyParser.set_globalSymbolTable(globalSymbolTable);
+                bodyParser.inFunction = inFunction;
+                bodyParser.sites = sites;
+                bodyParser.siteBase = siteBase + open + 1;
                 bodyParser.parse();
             } else {
                 // Skip then block if present
@@ -291,7 +578,79 @@ public:
     //                                              Helper functions
     // ========================================================================================================
 
-    void parseFunctionCall(int &pos) {
+    // Arguments must match the declared parameter types, `any` accepts everything
+    void checkArguments(const int pos, const Function &func, const std::vector<Variable> &arguments) const {
+        for (size_t i = 0; i < arguments.size(); i++) {
+            if (i >= func.parameters.size() || (func.parameters[i] != arguments[i].type && func.parameters[i] != "any")) {
+                ErrInfo errInfo = { ErrorType::INVALID_TYPE, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "Valid type", context().currfilePath };
+                error::gen(errInfo);
+            }
+        }
+    }
+
+    // Call `func` with `symbols` as the caller's table. Returns what the body returned, converted to
+    // the declared return type.
+    static Variable invoke(const Function &func, const std::vector<Variable> &arguments, const std::unordered_map<std::string, SymbolInfo> &symbols, const std::string &filePath, const std::string &name) {
+        return call(func, arguments, tiering::Scope{nullptr, &symbols}, filePath, name);
+    }
+
+    // Every call, interpreted or made by compiled code, comes through here: answers it from the memo
+    // cache when the function has one (see memo.h), runs the compiled form when there is one,
+    // otherwise counts the call and queues the function for compilation once it is hot
+    static Variable call(const Function &func, const std::vector<Variable> &arguments, const tiering::Scope &scope, const std::string &filePath, const std::string &name) {
+        if (memo::Cache* cache = memo::cache(func, scope)) {
+            const std::string key = memo::key(arguments);
+            if (auto cached = cache->find(key)) {
+                return std::move(*cached);
+            }
+            Variable result = execute(func, arguments, scope, filePath, name);
+            cache->insert(key, result);
+            return result;
+        }
+        return execute(func, arguments, scope, filePath, name);
+    }
+
+    // A call that is not served from a memo cache
+    static Variable execute(const Function &func, const std::vector<Variable> &arguments, const tiering::Scope &scope, const std::string &filePath, const std::string &name) {
+        if (func.profile->recording) func.profile->runs.fetch_add(1, std::memory_order_relaxed);
+        const tiering::Program* program = func.profile->program.load(std::memory_order_acquire);
+        if (program == nullptr && (func.profile->precompiled != nullptr || func.profile->eager)) {
+            tiering::prepare(func, scope);
+            program = func.profile->program.load(std::memory_order_acquire);
+        }
+        if (program != nullptr) {
+            if (const tiering::Program* specialized = tiering::specialization(func, arguments, scope, name)) program = specialized;
+            if (auto result = tiering::run(*program, func, arguments, scope, filePath, name, &Parser::call, func.profile->body)) {
+                return *result;
+            }
+        } else if (const uint64_t threshold = context().options.tierThreshold;
+                   threshold != 0 && func.profile->calls.fetch_add(1, std::memory_order_relaxed) + 1 == threshold) {
+            tiering::background().enqueue(func, scope, name, threshold, context().options);
+        }
+        return interpret(func, arguments, tiering::materialize(scope), filePath, name);
+    }
+
+    // Run `func` in a frame of its own: a copy of the caller's table with the arguments bound to its
+    // parameters
+    static Variable interpret(const Function &func, const std::vector<Variable> &arguments, std::unordered_map<std::string, SymbolInfo> symbols, const std::string &filePath, const std::string &name) {
+        for (size_t i = 0; i < arguments.size(); i++) {
+            symbols[func.localVariables[i].identifier] = arguments[i];
+        }
+
+        Parser parser(func.body, func.unfilteredBody, filePath, name);
+        parser.set_globalSymbolTable(symbols);
+        parser.inFunction = true;
+        parser.sites = inlinecache::sites(func);
+        try {
+            parser.parse();
+        } catch (const ReturnValue &returned) {
+            return Variable{"", func.returnType, coerce(returned.value, func.returnType), ""};
+        }
+        return Variable{"", func.returnType, "", ""};
+    }
+
+    // A call of `func`, which the name at `pos` was just looked up to
+    Variable parseFunctionCall(int &pos, const Function &func) {
         std::cout << "Parsing function call" << std::endl;
         const std::string name = ascii::_aname PARGS // Function name
         const std::vector<Variable> arguments = abstract::_pcall_params(pos, *tokens, globalSymbolTable, *unfilteredTokens);
@@ -301,105 +660,433 @@ public:
         }
         std::cout << std::endl;
 
-        // Validate function call parameter types
-        for (size_t i = 0; i < arguments.size(); i++) {
-            if (std::get<Function>(globalSymbolTable[name]).parameters[i] != arguments[i].type && std::get<Function>(globalSymbolTable[name]).parameters[i] != "any") {
-                errInfo = { ErrorType::INVALID_TYPE, (*tokens)[pos].line, (*tokens)[pos].column, unfilteredLines[(*tokens)[pos].line], "Valid type", currfilePath };
-                error::gen(errInfo);
-            }
+        checkArguments(pos, func, arguments);
+        return invoke(func, arguments, globalSymbolTable, filePath, name);
+    }
+
+    Variable parseScopedFunctionCall(int &pos, const Function& func) {
+        const std::string name = ascii::_aname PARGS // Function name
+        const std::vector<Variable> arguments = abstract::_pcall_params(pos, *tokens, globalSymbolTable, *unfilteredTokens);
+
+        checkArguments(pos, func, arguments);
+        return invoke(func, arguments, globalSymbolTable, filePath, name);
+    }
+
+    // A call or a namespace member, where a value is expected
+    [[nodiscard]] bool isOperand(const int pos) const {
+        const auto it = globalSymbolTable.find((*tokens)[pos].value);
+        return (*tokens)[pos].type == TokenType::IDENTIFIER && it != globalSymbolTable.end() && !std::holds_alternative<Variable>(it->second);
+    }
+
+    Variable parseOperand(int &pos) {
+        if (const auto* func = std::get_if<Function>(&globalSymbolTable.at((*tokens)[pos].value))) {
+            return parseFunctionCall(pos, *func);
         }
+        const SymbolInfo &result = resolveScoped(pos);
+        if (const auto* func = std::get_if<Function>(&result)) {
+            return parseScopedFunctionCall(pos, *func);
+        }
+        ascii::_aname PARGS // Variable name
+        return std::get<Variable>(result);
+    }
 
-        // create a copy of the global symbol table and add the function arguments to it
-        std::unordered_map<std::string, SymbolInfo> localSymbolTable = globalSymbolTable;
+    // What `namespace::...::name` at `pos` refers to, with `pos` left on the last name
+    const SymbolInfo& resolveScoped(int &pos) {
+        if (sites) {
+            return inlinecache::resolve(*sites, siteBase + pos, pos, *tokens, globalSymbolTable);
+        }
+        return abstract::_pscope_resolve(pos, *tokens, globalSymbolTable);
+    }
 
-        for (size_t i = 0; i < arguments.size(); i++) {
-            localSymbolTable[std::get<Function>(globalSymbolTable[name]).localVariables[i].identifier] = arguments[i];
+    // A function named by `name` or `namespace::name`
+    Function parseCallee(int &pos) {
+        if (const auto it = globalSymbolTable.find((*tokens)[pos].value); it != globalSymbolTable.end()) {
+            if (std::holds_alternative<Function>(it->second)) {
+                ascii::_aname PARGS // Function name
+                return std::get<Function>(it->second);
+            }
+            if (std::holds_alternative<Namespace>(it->second)) {
+                if (const auto* func = std::get_if<Function>(&resolveScoped(pos))) {
+                    ascii::_aname PARGS // Function name
+                    return *func;
+                }
+            }
         }
+        ErrInfo errInfo = { ErrorType::EXPECTED_IDENTIFIER, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "FUNCTION", context().currfilePath };
+        error::gen(errInfo);
+        return {};
+    }
 
-        Parser parser(std::make_unique<std::vector<Token>>(std::get<Function>(globalSymbolTable[name]).body), std::make_unique<std::vector<Token>>(std::get<Function>(globalSymbolTable[name]).unfilteredBody), filePath, name);
-        parser.set_globalSymbolTable(localSymbolTable);
-        parser.parse();
+    // Queue `work` on the worker pool with a context of its own, cloned from this thread's. With
+    // `output`, writescr in the task goes there instead of to this context's output.
+    std::shared_ptr<scheduler::Task> submit(std::function<void()> work, std::ostream* output = nullptr) const {
+        channels::registry(); // Created before the copy so the task sees the same channels
+        Context taskContext = context();
+        if (output != nullptr) {
+            taskContext.output = output;
+            taskContext.outputMutex = std::make_shared<std::mutex>();
+        }
+        taskContext.tasks.clear();
+        taskContext.crashContext = nullptr;
+        taskContext.exitOnError = false; // Failures are kept for whoever waits on the task
+
+        auto task = std::make_shared<scheduler::Task>();
+        task->body = [work = std::move(work), path = filePath, ctx = std::move(taskContext)](scheduler::Task &self) mutable {
+            ContextScope scope(ctx);
+            try {
+                work();
+            } catch (const Diagnostic &diagnostic) {
+                self.failure = diagnostic;
+            } catch (const std::exception &e) {
+                self.failure = Diagnostic{ ErrorType::UNKNOWN, 0, -1, "", e.what(), path };
+            }
+            if (auto failure = scheduler::joinAll(ctx); failure && !self.failure) {
+                self.failure = std::move(failure);
+            }
+        };
+        scheduler::pool().submit(task);
+        return task;
     }
 
-    void parseScopedFunctionCall(int &pos, const Function& func) {
-        const std::string name = ascii::_aname PARGS // Function name
-        const std::vector<Variable> arguments = abstract::_pcall_params(pos, *tokens, globalSymbolTable, *unfilteredTokens);
+    // Queue `func` on the worker pool and return its handle. The task runs on a copy of this
+    // frame's symbols, so it never shares mutable state with the script that spawned it.
+    std::string spawn(const Function &func, const std::vector<Variable> &arguments) {
+        auto task = submit([func, arguments, symbols = globalSymbolTable, path = filePath] {
+            invoke(func, arguments, symbols, path, func.identifier);
+        });
 
-        // Validate function call parameter types
-        for (size_t i = 0; i < arguments.size(); i++) {
-            if (func.parameters[i] != arguments[i].type && func.parameters[i] != "any") {
-                errInfo = { ErrorType::INVALID_TYPE, (*tokens)[pos].line, (*tokens)[pos].column, unfilteredLines[(*tokens)[pos].line], "Valid type", currfilePath };
-                error::gen(errInfo);
+        auto &tasks = context().tasks;
+        tasks.push_back(std::move(task));
+        return std::to_string(tasks.size());
+    }
+
+    // Run fn(i) for every i in [begin, end) on the pool. The first iteration runs here and is timed
+    // to pick the chunking, a range that is cheap overall never leaves this thread. With `op` the
+    // results are folded: each chunk left to right, then the chunk results onto `init` in index
+    // order, so an associative `op` gives the same result however the range was split.
+    std::string parallelLoop(const int pos, const int64_t begin, const int64_t end, const Function &fn, const Function *op, const Variable &init) {
+        if (begin >= end) return init.value;
+
+        const auto iterate = [this, &fn](const int64_t i) {
+            return invoke(fn, {Variable{"", "int", std::to_string(i), ""}}, globalSymbolTable, filePath, fn.identifier);
+        };
+        const auto combine = [this, op](const Variable &left, const Variable &right) {
+            return op == nullptr ? right : invoke(*op, {left, right}, globalSymbolTable, filePath, op->identifier);
+        };
+        const auto fold = [&](const std::pair<int64_t, int64_t> &range) {
+            Variable result = iterate(range.first);
+            for (int64_t i = range.first + 1; i < range.second; i++) {
+                result = combine(result, iterate(i));
             }
+            return result;
+        };
+
+        checkArguments(pos, fn, {Variable{"", "int", std::to_string(begin), ""}});
+        const auto started = std::chrono::steady_clock::now();
+        const Variable first = iterate(begin);
+        const auto perIteration = std::chrono::steady_clock::now() - started;
+        if (op != nullptr) {
+            checkArguments(pos, *op, {init, first});
         }
 
-        std::unordered_map<std::string, SymbolInfo> localSymbolTable = globalSymbolTable;
-        for (size_t i = 0; i < arguments.size(); i++) {
-            localSymbolTable[func.localVariables[i].identifier] = arguments[i];
+        const auto plan = scheduler::chunks(begin + 1, end, perIteration, scheduler::pool().size());
+        std::vector<std::optional<Variable>> partials(plan.size());
+        if (plan.size() == 1) {
+            partials[0] = fold(plan[0]);
+        } else {
+            std::vector<std::shared_ptr<scheduler::Task>> tasks;
+            for (size_t i = 0; i < plan.size(); i++) {
+                tasks.push_back(submit([&, i] { partials[i] = fold(plan[i]); }));
+            }
+            // Every chunk finishes before anything is raised, they all refer to this frame
+            for (const auto &task : tasks) {
+                scheduler::pool().wait(task);
+            }
+            for (const auto &task : tasks) {
+                if (task->failure) {
+                    ErrInfo failure = *task->failure;
+                    error::gen(failure);
+                }
+            }
         }
 
-        Parser parser(std::make_unique<std::vector<Token>>(func.body), std::make_unique<std::vector<Token>>(func.unfilteredBody), filePath, name);
-        parser.set_globalSymbolTable(localSymbolTable);
-        parser.parse();
+        Variable result = combine(init, first);
+        for (const auto &partial : partials) {
+            result = combine(result, *partial);
+        }
+        return op == nullptr ? "" : result.value;
     }
 
-    void scope_resolve(int &pos) {
-        if (const std::variant<Variable, Function> result = abstract::_pscope_resolve(pos, *tokens, globalSymbolTable);
-            std::holds_alternative<Variable>(result)) {
+    // A loop bound: an integer literal or variable
+    int64_t parseBound(int &pos) {
+        const Variable bound = abstract::_pcall_arg(pos, *tokens, globalSymbolTable, *unfilteredTokens);
+        try {
+            return std::llround(std::stod(bound.value));
+        } catch (const std::exception &) {
+            ErrInfo errInfo = { ErrorType::INVALID_NUMBER, (*tokens)[pos - 1].line, (*tokens)[pos - 1].column, context().unfilteredLines[(*tokens)[pos - 1].line], "Integer loop bound", context().currfilePath };
+            error::gen(errInfo);
+        }
+        return 0;
+    }
+
+    // A channel handle returned by `extern "chan_new"`
+    std::shared_ptr<channels::Channel<std::string>> parseChannel(int &pos) {
+        const int at = pos;
+        const std::string handle = abstract::_pvar_val(pos, *tokens, globalSymbolTable);
+        auto channel = channels::registry().find(handle);
+        if (!channel) {
+            ErrInfo errInfo = { ErrorType::INVALID_ARGUMENT, (*tokens)[at].line, (*tokens)[at].column, context().unfilteredLines[(*tokens)[at].line], "Channel handle", context().currfilePath };
+            error::gen(errInfo);
+        }
+        return channel;
+    }
 
+    // Wait for a task spawned from this context, an error it raised is raised again here
+    void join(const int pos, const std::string &handle) {
+        auto &tasks = context().tasks;
+        size_t index = 0;
+        if (!handle.empty() && std::ranges::all_of(handle, [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+            index = std::stoul(handle);
+        }
+        if (index == 0 || index > tasks.size() || !tasks[index - 1]) {
+            ErrInfo errInfo = { ErrorType::INVALID_ARGUMENT, (*tokens)[pos].line, (*tokens)[pos].column, context().unfilteredLines[(*tokens)[pos].line], "Unjoined task handle", context().currfilePath };
+            error::gen(errInfo);
+        }
+
+        const auto task = std::move(tasks[index - 1]);
+        scheduler::pool().wait(task);
+        if (task->failure) {
+            ErrInfo failure = *task->failure;
+            error::gen(failure);
+        }
+    }
+
+    void scope_resolve(int &pos) {
+        if (const SymbolInfo &result = resolveScoped(pos); std::holds_alternative<Variable>(result)) {
             std::cout << "Variable found" << std::endl;
-        } else if (std::holds_alternative<Function>(result)) {
-            parseScopedFunctionCall(pos, std::get<Function>(result));
+        } else if (const auto* func = std::get_if<Function>(&result)) {
+            parseScopedFunctionCall(pos, *func);
         }
     }
 
     void parse() {
         for (currentToken = 0; currentToken < tokens->size(); ++currentToken) {
-            if ((*tokens)[currentToken].type == TokenType::KEYWORD) {
-                if ((*tokens)[currentToken].value == "fn")
-                    parseFunction(currentToken);
-                else if ((*tokens)[currentToken].value == "var")
-                    parseVariable(currentToken);
-                else if ((*tokens)[currentToken].value == "merge")
-                    parseMerge(currentToken);
-                else if ((*tokens)[currentToken].value == "extern")
-                    parseExtern(currentToken);
-                else if ((*tokens)[currentToken].value == "if") {
-                    parseIf(currentToken);
+            parseStatement(currentToken);
+
+            if ((*tokens)[currentToken].type == TokenType::eof) {
+                return;
+            }
+        }
+    }
+
+    // Run the statement starting at `pos`, which is left on its last token
+    void parseStatement(int &pos) {
+        if ((*tokens)[pos].type == TokenType::SYMBOL && (*tokens)[pos].value == "@") {
+            parseAnnotation(pos);
+        } else if ((*tokens)[pos].type == TokenType::KEYWORD) {
+            if ((*tokens)[pos].value == "fn")
+                parseFunction(pos);
+            else if ((*tokens)[pos].value == "var" || (*tokens)[pos].value == "const")
+                parseVariable(pos);
+            else if ((*tokens)[pos].value == "merge")
+                parseMerge(pos);
+            else if ((*tokens)[pos].value == "extern")
+                parseExtern(pos);
+            else if ((*tokens)[pos].value == "return")
+                parseReturn(pos);
+            else if ((*tokens)[pos].value == "if") {
+                parseIf(pos);
+            }
+        }
+
+        if ((*tokens)[pos].type == TokenType::IDENTIFIER) {
+            auto it = globalSymbolTable.find((*tokens)[pos].value);
+            if (it == globalSymbolTable.end()) {
+                // Do nothing
+            } else {
+                // Match found
+                if (std::holds_alternative<Function>(it->second)) {
+                    // Function
+                    std::cout << "Function found" << std::endl;
+                    parseFunctionCall(pos, std::get<Function>(it->second));
+                } else if (std::holds_alternative<Variable>(it->second)) {
+                    // Variable
+                    std::cout << "Variable found" << std::endl;
+                } else if (std::holds_alternative<Namespace>(it->second)) {
+                    // Namespace
+                    std::cout << "Namespace found" << std::endl;
+                    scope_resolve(pos);
                 }
             }
+        }
+    }
 
-            if ((*tokens)[currentToken].type == TokenType::IDENTIFIER) {
-                auto it = globalSymbolTable.find((*tokens)[currentToken].value);
-                if (it == globalSymbolTable.end()) {
-                    // Do nothing
-                } else {
-                    // Match found
-                    if (std::holds_alternative<Function>(it->second)) {
-                        // Function
-                        std::cout << "Function found" << std::endl;
-                        parseFunctionCall(currentToken);
-                    } else if (std::holds_alternative<Variable>(it->second)) {
-                        // Variable
-                        std::cout << "Variable found" << std::endl;
-                    } else if (std::holds_alternative<Namespace>(it->second)) {
-                        // Namespace
-                        std::cout << "Namespace found" << std::endl;
-                        scope_resolve(currentToken);
+    // Run tokens [begin, end) the way parse() steps through them. A statement can run on into the
+    // tokens after it (an `if` leaves its else block to the loop), so this is not always one call.
+    void parseRange(const int begin, const int end) {
+        for (int pos = begin; pos < end; ++pos) {
+            parseStatement(pos);
+        }
+    }
+
+    // -O2: run the top-level statements like parse(), except that each run of statements the tiering
+    // compiler handles is compiled, optimized (see ssa.h) and run as one program instead
+    void parseOptimized() {
+        if (restored) {
+            parse(); // Declarations already in the table are skipped one by one
+            return;
+        }
+        const auto compilable = [this](const autoparallel::Statement &statement) {
+            const Token &token = (*tokens)[statement.begin];
+            if (token.type == TokenType::IDENTIFIER) return true;
+            return token.type == TokenType::KEYWORD && (token.value == "var" || token.value == "if" || token.value == "extern");
+        };
+        const auto statements = autoparallel::split(*tokens);
+        Function file;
+        file.body = tokens;
+        file.unfilteredBody = unfilteredTokens;
+        size_t i = 0;
+        while (i < statements.size()) {
+            size_t j = i;
+            while (j < statements.size() && compilable(statements[j])) ++j;
+            if (j == i) {
+                parseRange(static_cast<int>(statements[i].begin), static_cast<int>(statements[i].end));
+                ++i;
+                continue;
+            }
+            const auto program = tiering::compileTopLevel(file, statements[i].begin, statements[j - 1].end, globalSymbolTable, context().options);
+            if (!program || !tiering::runTopLevel(*program, file, globalSymbolTable, filePath, scope, &Parser::call)) {
+                for (size_t k = i; k < j; k++) {
+                    parseRange(static_cast<int>(statements[k].begin), static_cast<int>(statements[k].end));
+                }
+            }
+            i = j;
+        }
+    }
+
+    // --auto-parallel: run the top-level statements like parse(), but start each one as soon as the
+    // statements it depends on are done. Statements that call functions run as tasks on a copy of
+    // the symbol table and their declarations are copied back when they finish, cheap ones run
+    // inline. Output is buffered per statement and written in program order, and so are errors: a
+    // failing statement is reported after the output of every statement before it.
+    void parseParallel() {
+        struct Outcome {
+            std::ostringstream output;
+            std::unordered_map<std::string, SymbolInfo> declared; // Filled in by the task
+        };
+        struct Pending {
+            autoparallel::Effects effects;
+            std::shared_ptr<scheduler::Task> task; // Reset once settled
+            std::shared_ptr<Outcome> outcome = std::make_shared<Outcome>();
+            std::optional<Diagnostic> failure;
+        };
+        std::deque<Pending> pending;
+        const size_t window = scheduler::pool().size() * 4;
+
+        // Wait for a statement and copy its declarations into the table
+        const auto settle = [this](Pending &statement) {
+            if (!statement.task) return;
+            scheduler::pool().wait(statement.task);
+            if (statement.task->failure) statement.failure = statement.task->failure;
+            for (auto &[name, symbol] : statement.outcome->declared) {
+                globalSymbolTable[name] = std::move(symbol);
+            }
+            statement.task.reset();
+        };
+        // Write out the finished statements at the front, all of them with `all`
+        const auto flush = [&](const bool all) {
+            while (!pending.empty() && (all || !pending.front().task || pending.front().task->finished)) {
+                Pending front = std::move(pending.front());
+                pending.pop_front();
+                settle(front);
+                {
+                    std::lock_guard lock(*context().outputMutex);
+                    *context().output << front.outcome->output.str();
+                }
+                if (front.failure) {
+                    for (auto &later : pending) {
+                        if (later.task) scheduler::pool().wait(later.task);
                     }
+                    ErrInfo failure = *front.failure;
+                    error::gen(failure);
                 }
             }
+        };
 
-            if ((*tokens)[currentToken].type == TokenType::eof) {
-                return;
+        for (const auto &statement : autoparallel::split(*tokens)) {
+            autoparallel::Effects effects = autoparallel::analyze(*tokens, statement, globalSymbolTable);
+            if (effects.barrier) {
+                flush(true);
+                parseRange(static_cast<int>(statement.begin), static_cast<int>(statement.end));
+                continue;
             }
+
+            for (auto &earlier : pending) {
+                if (earlier.task && autoparallel::conflicts(earlier.effects, effects)) settle(earlier);
+            }
+            while (pending.size() >= window) {
+                settle(pending.front());
+                flush(false);
+            }
+
+            Pending current{std::move(effects), nullptr, std::make_shared<Outcome>(), std::nullopt};
+            if (current.effects.calls) {
+                current.task = submit([outcome = current.outcome, writes = current.effects.writes, symbols = globalSymbolTable,
+                                       tokens = tokens, unfilteredTokens = unfilteredTokens, path = filePath, scope = scope,
+                                       restored = restored, statement]() mutable {
+                    Parser worker(tokens, unfilteredTokens, path, scope);
+                    worker.globalSymbolTable = std::move(symbols);
+                    worker.restored = restored;
+                    worker.parseRange(static_cast<int>(statement.begin), static_cast<int>(statement.end));
+                    for (const auto &name : writes) {
+                        if (const auto it = worker.globalSymbolTable.find(name); it != worker.globalSymbolTable.end()) {
+                            outcome->declared.insert(*it);
+                        }
+                    }
+                }, &current.outcome->output);
+            } else {
+                std::ostream* output = std::exchange(context().output, &current.outcome->output);
+                const bool exitOnError = std::exchange(context().exitOnError, false); // Raised again in order by flush()
+                try {
+                    parseRange(static_cast<int>(statement.begin), static_cast<int>(statement.end));
+                } catch (const Diagnostic &diagnostic) {
+                    current.failure = diagnostic;
+                } catch (...) {
+                    context().output = output;
+                    context().exitOnError = exitOnError;
+                    throw;
+                }
+                context().output = output;
+                context().exitOnError = exitOnError;
+            }
+            pending.push_back(std::move(current));
+            flush(false);
         }
+        flush(true);
+    }
+
+    [[nodiscard]] const std::vector<std::string>& getSources() const {
+        return sources;
     }
 
     [[nodiscard]] std::unordered_map<std::string, SymbolInfo> getSymbolTable() {
         return globalSymbolTable;
     }
 
+    // Start from a table restored from a snapshot image instead of re-running declarations
+    // `moduleSources` are the files the image's namespaces were merged from
+    void restore(const std::unordered_map<std::string, SymbolInfo>& symbolTable, const std::vector<std::string>& moduleSources) {
+        globalSymbolTable = symbolTable;
+        sources = moduleSources;
+        auto names = std::make_shared<std::unordered_set<std::string>>();
+        for (const auto &name : symbolTable | std::views::keys) names->insert(name);
+        restored = std::move(names);
+    }
+
+    void set_treeShaker(treeshake::Pass* pass) {
+        shaker = pass;
+    }
+
     void set_globalSymbolTable(const std::unordered_map<std::string, SymbolInfo>& symbolTable) {
         globalSymbolTable = symbolTable;
     }
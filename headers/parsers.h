@@ -4,23 +4,17 @@
 
 #pragma once
 
-inline ErrInfo errInfo;
-
-inline std::map<int, std::string> unfilteredLines;
-
 inline void set_unfilteredLines(const std::map<int, std::string>& lines) {
-    unfilteredLines = lines;
+    context().unfilteredLines = lines;
 }
 
-inline std::string currfilePath;
-
 inline void set_filePath(const std::string& path) {
-    currfilePath = path;
+    context().currfilePath = path;
 }
 
 #define SET_ERRINFO(TYPE, EXP_TOKEN) \
     do { \
-    errInfo = { TYPE, tokens[pos].line, tokens[pos].column, unfilteredLines[tokens[pos].line], EXP_TOKEN, currfilePath }; \
+    ErrInfo errInfo = { TYPE, tokens[pos].line, tokens[pos].column, context().unfilteredLines[tokens[pos].line], EXP_TOKEN, context().currfilePath }; \
     error::gen(errInfo); \
     } while (0)
 
@@ -28,7 +22,10 @@ using SymbolInfo = std::variant<struct Variable, struct Function, struct Namespa
 
 struct Namespace {
     std::string identifier; // Name of the namespace.
-    std::unordered_map<std::string, SymbolInfo> symbols; // Variables and functions declared in the namespace.
+    // Variables and functions declared in the namespace. Never changed once the namespace is bound and
+    // shared by every copy of the tables it is in, so copying a table (every call does) never copies a
+    // module, and the address stands for the namespace's contents.
+    std::shared_ptr<const std::unordered_map<std::string, SymbolInfo>> symbols;
 };
 
 struct Variable {
@@ -38,16 +35,75 @@ struct Variable {
     std::string scopeLevel; // Name of its parent function/namespace (global if in global scope).
 };
 
+namespace memo {
+    struct Cache;
+}
+
+namespace inlinecache {
+    struct Sites;
+}
+
+namespace pgo {
+    struct Record;
+}
+
+namespace specialize {
+    struct Specializations;
+}
+
+namespace tiering {
+    struct Program;
+    struct Precompiled;
+    class Machine;
+
+    using Body = Variable (*)(Machine &machine);
+
+    // Shared by every copy of a Function: how often it has been called, and its compiled form
+    // once it got hot enough to have one
+    struct Profile {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<const Program*> program{nullptr}; // Published once `compiled` holds it
+        std::shared_ptr<const Program> compiled;
+        const Precompiled* precompiled = nullptr; // Set on declaration in executables built with --build
+        std::once_flag prepared;
+        Body body = nullptr; // Runs `compiled` instead of the bytecode loop, published with it
+        std::once_flag memoized; // Purity is decided on the first call whose result could be cached
+        std::shared_ptr<memo::Cache> memo; // Set by then when results are cached, see memo.h
+        std::once_flag sited;
+        std::shared_ptr<inlinecache::Sites> sites; // Inline caches of the body's qualified names, made on its first interpreted call
+        std::shared_ptr<const pgo::Record> recorded; // What --profile-in has on the function, set on declaration
+        bool eager = false; // Hot in that profile, compiled on its first call
+        bool recording = false; // Written out by --profile-out, every call is counted in `runs`
+        std::atomic<uint64_t> runs{0};
+        std::once_flag specialized;
+        std::shared_ptr<specialize::Specializations> specializations; // Programs for the argument types of its calls, made once it is compiled
+    };
+}
+
 struct Function {
     std::string identifier; // Name of the function.
     std::string returnType; // Return type of the function.
     std::vector<std::string> parameters; // List of parameter types.
     std::vector<Variable> localVariables; // Variables declared in the function.
     std::string scopeLevel; // Name of its parent function/namespace (global if in global scope).
-    std::vector<Token> body; // List of tokens that make up the function body.
-    std::vector<Token> unfilteredBody; // List of unfiltered tokens that make up the function body.
+    bool memoize = false; // Declared with @memoize, its results are cached when it is pure.
+    // Tokens that make up the function body. Immutable once parsed and shared by every copy of the
+    // declaration, so copying a symbol table (every call does) or a cached module never copies code.
+    std::shared_ptr<const std::vector<Token>> body = std::make_shared<const std::vector<Token>>();
+    std::shared_ptr<const std::vector<Token>> unfilteredBody = std::make_shared<const std::vector<Token>>(); // Unfiltered tokens of the body.
+    std::shared_ptr<tiering::Profile> profile = std::make_shared<tiering::Profile>();
 };
 
+// Expressions compute in floating point, an int keeps only the rounded integer
+inline std::string coerce(const std::string &value, const std::string &type) {
+    if (type == "int" && !value.empty()) {
+        try {
+            return std::to_string(std::llround(std::stod(value)));
+        } catch (const std::exception &) {}
+    }
+    return value;
+}
+
 class RecursiveDescentParser {
 private:
     size_t currentToken = 0;
@@ -248,9 +304,9 @@ public:
             return result != 0.0;
         } catch (const std::exception& e) {
             // Use existing error handling infrastructure
-            errInfo = { ErrorType::INVALID_BOOL, input[currentToken].line,
-                        input[currentToken].column, unfilteredLines[input[currentToken].line],
-                        "Valid condition", currfilePath };
+            ErrInfo errInfo = { ErrorType::INVALID_BOOL, input[currentToken].line,
+                        input[currentToken].column, context().unfilteredLines[input[currentToken].line],
+                        "Valid condition", context().currfilePath };
             error::gen(errInfo);
             return false;
         }
@@ -835,11 +891,12 @@ namespace abstract {
 
     namespace noErr {
         inline std::string _pmodule(int &pos, const std::vector<Token> &tokens) {
-            std::string location = ascii::_pstring (pos, tokens);
-            if (!std::filesystem::exists(location)) {
+            const std::string location = ascii::_pstring (pos, tokens);
+            const auto resolved = modules::index().resolve(location, context().currfilePath);
+            if (!resolved) {
                 throw std::runtime_error("File not found");
             }
-            return location;
+            return *resolved;
         }
     }
 
@@ -1011,6 +1068,7 @@ namespace abstract {
         std::vector<Variable> arguments;
         if (tokens[pos].value == ")") {
             // No parameters found, return early
+            symbol::_pclose(pos, tokens);
             return arguments;
         }
         // Attempt to match an argument.
@@ -1050,29 +1108,32 @@ namespace abstract {
     }
 
     inline std::string _pmodule(int &pos, const std::vector<Token> &tokens) {
-        std::string location = ascii::_pstring (pos, tokens);
-        if (!std::filesystem::exists(location)) {
+        const std::string location = ascii::_pstring (pos, tokens);
+        const auto resolved = modules::index().resolve(location, context().currfilePath);
+        if (!resolved) {
             SET_ERRINFO(ErrorType::FILE_NOT_FOUND, "VALID MODULE FILE PATH");
         }
-        return location;
+        return resolved.value_or(location);
     }
 
-    inline std::variant<Variable, Function> _pscope_resolve(int &pos, const std::vector<Token> &tokens, std::unordered_map<std::string, SymbolInfo>& symbolTable) {
-        std::unordered_map<std::string, SymbolInfo> currentSymbolTable = std::get<Namespace>(symbolTable[tokens[pos].value]).symbols;
-        ++pos;
+    // The variable or function `ns::...::name` at `pos` refers to, with `pos` left on the last name.
+    // A member the namespace doesn't have reads as an empty variable.
+    inline const SymbolInfo& _pscope_resolve(int &pos, const std::vector<Token> &tokens, const std::unordered_map<std::string, SymbolInfo>& symbolTable) {
+        static const SymbolInfo absent = Variable{};
+        const std::unordered_map<std::string, SymbolInfo>* current = &symbolTable;
         while (true) {
+            const auto it = current->find(tokens[pos].value);
+            if (it == current->end()) {
+                return absent;
+            }
+            const auto* ns = std::get_if<Namespace>(&it->second);
+            if (ns == nullptr) {
+                return it->second;
+            }
+            current = ns->symbols.get();
+            ++pos;
             if (tokens[pos].type == TokenType::SYMBOL && tokens[pos].value == "::") {
-                pos++;
-                continue;
-            } else if (std::holds_alternative<Namespace>(currentSymbolTable[tokens[pos].value])) {
-                currentSymbolTable = std::get<Namespace>(currentSymbolTable[tokens[pos].value]).symbols;
                 ++pos;
-            } else if (std::holds_alternative<Variable>(currentSymbolTable[tokens[pos].value])) {
-                return std::get<Variable>(currentSymbolTable[tokens[pos].value]);
-            } else if (std::holds_alternative<Function>(currentSymbolTable[tokens[pos].value])) {
-                return std::get<Function>(currentSymbolTable[tokens[pos].value]);
-            } else {
-                SET_ERRINFO(ErrorType::EXPECTED_IDENTIFIER, "VALID IDENTIFIER");
             }
         }
     }
@@ -0,0 +1,200 @@
+#pragma once
+
+// Profile-guided optimization across runs, behind --profile-out and --profile-in.
+//
+// --profile-out writes down what a run saw of each function it called once the script is done:
+// how often it was called and, once it was compiled, how often each of its conditions held and
+// which of its expressions got quickened or gave up on it (see quicken.h). A function is known by
+// its file, line and name, a condition or expression by the token of the body it starts at, so the
+// profile stays good for the functions of a file that weren't edited since.
+//
+// --profile-in reads such a profile before the script runs. A function that was called
+// --tier-threshold times then is compiled on its first call instead of getting there again. An
+// if/else whose condition mostly held gets its then-block laid out last, where it runs on into
+// what follows without a jump. Expressions that were quickened start quickened, and the ones that
+// kept failing their guards start generic. A profile that can't be read is ignored.
+namespace pgo {
+    constexpr const char* MAGIC = "ICVPGO1";
+
+    struct Branch {
+        uint64_t taken = 0;   // The condition held
+        uint64_t skipped = 0;
+    };
+
+    // What one run saw of a function
+    struct Record {
+        uint64_t calls = 0;
+        std::map<size_t, Branch> branches;            // By token of the condition
+        std::map<size_t, quicken::State> expressions; // By token of the expression, QUICK or GENERIC
+    };
+
+    // How often the conditions of a compiled program held, by expression
+    struct Counts {
+        explicit Counts(const size_t count)
+            : taken(std::make_unique<std::atomic<uint64_t>[]>(count)), skipped(std::make_unique<std::atomic<uint64_t>[]>(count)) {}
+
+        std::unique_ptr<std::atomic<uint64_t>[]> taken;
+        std::unique_ptr<std::atomic<uint64_t>[]> skipped;
+
+        void count(const int expression, const bool held) {
+            (held ? taken : skipped)[expression].fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    // The profile of an interpreter, shared with the tasks it spawns
+    struct Session {
+        struct Declared {
+            std::string path;
+            size_t line;
+            std::string name;
+            std::shared_ptr<tiering::Profile> profile;
+        };
+
+        std::unordered_map<std::string, std::shared_ptr<const Record>> recorded; // Read from --profile-in
+        std::mutex mutex;
+        std::vector<Declared> declared; // For --profile-out
+    };
+
+    inline std::string key(const std::string &path, const size_t line, const std::string &name) {
+        return path + '\n' + std::to_string(line) + '\n' + name;
+    }
+
+    // `fn <calls> <line> <name> <path>`, then a `branch <token> <taken> <skipped>` or
+    // `expression <token> quick|generic` line for each of its records, empty when it can't be read
+    inline std::unordered_map<std::string, std::shared_ptr<const Record>> read(const std::string &path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!std::getline(file, line) || line != MAGIC) return {};
+
+        std::unordered_map<std::string, std::shared_ptr<const Record>> records;
+        std::shared_ptr<Record> current;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string kind;
+            fields >> kind;
+            if (kind == "fn") {
+                size_t at = 0;
+                std::string name;
+                std::string source;
+                current = std::make_shared<Record>();
+                if (!(fields >> current->calls >> at >> name) || fields.get() != ' ' || !std::getline(fields, source)) return {};
+                records[key(source, at, name)] = current;
+            } else if (kind == "branch" && current) {
+                size_t at = 0;
+                Branch branch;
+                if (!(fields >> at >> branch.taken >> branch.skipped)) return {};
+                current->branches[at] = branch;
+            } else if (kind == "expression" && current) {
+                size_t at = 0;
+                std::string state;
+                if (!(fields >> at >> state) || (state != "quick" && state != "generic")) return {};
+                current->expressions[at] = state == "quick" ? quicken::State::QUICK : quicken::State::GENERIC;
+            } else if (!kind.empty()) {
+                return {};
+            }
+        }
+        return records;
+    }
+
+    // A session for the interpreter about to run, with the records of `in` when there is one
+    inline std::shared_ptr<Session> open(const std::string &in) {
+        auto session = std::make_shared<Session>();
+        if (!in.empty()) session->recorded = read(in);
+        return session;
+    }
+
+    // On the declaration of `func`, at `line` of `path`: hand it what the profile has on it, and
+    // count its calls when the run is recorded
+    inline void attach(const Function &func, const std::string &path, const size_t line) {
+        const auto &session = context().profile;
+        if (!session) return;
+        const Options &options = context().options;
+        tiering::Profile &profile = *func.profile;
+        if (const auto it = session->recorded.find(key(path, line, func.identifier)); it != session->recorded.end()) {
+            profile.recorded = it->second;
+            profile.eager = options.tierThreshold != 0 && it->second->calls >= options.tierThreshold;
+        }
+        if (!options.profileOut.empty()) {
+            profile.recording = true;
+            std::lock_guard lock(session->mutex);
+            session->declared.push_back({path, line, func.identifier, func.profile});
+        }
+    }
+
+    // Whether the condition starting at token `at` mostly held
+    inline bool likely(const Record* record, const size_t at) {
+        if (record == nullptr) return false;
+        const auto it = record->branches.find(at);
+        return it != record->branches.end() && it->second.taken > it->second.skipped;
+    }
+
+    // Before `program` is published: start its expressions where the profile left them, and count
+    // its branches when the run is recorded
+    inline void instrument(tiering::Program &program, const Record* record, const bool recording) {
+        if (recording) program.counts = std::make_shared<Counts>(program.expressions.size());
+        if (record == nullptr || !program.feedback) return;
+        for (size_t i = 0; i < program.expressions.size(); i++) {
+            quicken::Site &site = program.feedback->sites[i];
+            const auto it = record->expressions.find(program.origins[i]);
+            if (!site.form || it == record->expressions.end()) continue;
+            site.state.store(it->second, std::memory_order_relaxed);
+        }
+    }
+
+    // --profile-out, once the script is done. False when the file can't be written.
+    inline bool write(Session &session, const std::string &path) {
+        struct Entry {
+            const Session::Declared* declared;
+            Record record;
+        };
+        std::map<std::string, Entry> entries; // A module merged twice declares its functions twice
+        std::lock_guard lock(session.mutex);
+        for (const auto &declared : session.declared) {
+            const tiering::Profile &profile = *declared.profile;
+            const uint64_t calls = profile.runs.load(std::memory_order_relaxed);
+            if (calls == 0) continue;
+            Record &record = entries.try_emplace(key(declared.path, declared.line, declared.name), Entry{&declared, {}}).first->second.record;
+            record.calls += calls;
+            std::vector<const tiering::Program*> programs = {profile.program.load(std::memory_order_acquire)};
+            if (profile.specializations) {
+                const specialize::Specializations &table = *profile.specializations;
+                for (size_t i = 0; i < table.count.load(std::memory_order_acquire); i++) {
+                    programs.push_back(table.entries[i].program.load(std::memory_order_acquire));
+                }
+            }
+            for (const tiering::Program* program : programs) {
+                if (program == nullptr) continue;
+                for (size_t i = 0; i < program->expressions.size(); i++) {
+                    const size_t at = program->origins[i];
+                    if (program->counts) {
+                        const uint64_t taken = program->counts->taken[i].load(std::memory_order_relaxed);
+                        const uint64_t skipped = program->counts->skipped[i].load(std::memory_order_relaxed);
+                        if (taken + skipped != 0) {
+                            record.branches[at].taken += taken;
+                            record.branches[at].skipped += skipped;
+                        }
+                    }
+                    if (program->feedback) {
+                        const quicken::State state = program->feedback->sites[i].state.load(std::memory_order_relaxed);
+                        if (state != quicken::State::WARMING) record.expressions[at] = state;
+                    }
+                }
+            }
+        }
+
+        std::ofstream file(path, std::ios::trunc);
+        if (!file) return false;
+        file << MAGIC << "\n";
+        for (const auto &[name, entry] : entries) {
+            const Record &record = entry.record;
+            file << "fn " << record.calls << " " << entry.declared->line << " " << entry.declared->name << " " << entry.declared->path << "\n";
+            for (const auto &[at, branch] : record.branches) {
+                file << "branch " << at << " " << branch.taken << " " << branch.skipped << "\n";
+            }
+            for (const auto &[at, state] : record.expressions) {
+                file << "expression " << at << " " << (state == quicken::State::QUICK ? "quick" : "generic") << "\n";
+            }
+        }
+        return static_cast<bool>(file.flush());
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// Quickening of the expressions of compiled functions.
+//
+// Every operand of a compiled expression is a string read as a number, and the generic evaluator
+// (Machine::evaluate) handles each one failing, on a stack of its own. An expression shaped like a
+// superinstruction, a chain of loads and arithmetic (`n * 3 + 1`) or a comparison of two such
+// chains (`n > 0`, what a branch tests), is watched while the generic code runs it. Once its
+// operands have read as numbers WARMUP times it is quickened: it runs as one fused step that reads
+// its operands straight from the frame, guarded by each of them still reading as a number and by no
+// division by zero. When a guard fails, that evaluation deoptimizes to the generic code, which
+// raises whatever error the expression has; after MAX_DEOPTS failures the expression stays generic.
+// With --jit, expressions assembled to native code run that instead.
+namespace quicken {
+    constexpr uint32_t WARMUP = 2;     // Generic evaluations before an expression is quickened
+    constexpr uint32_t MAX_DEOPTS = 8; // Guard failures before it stays generic
+
+    enum class State : uint8_t { WARMING, QUICK, GENERIC };
+
+    // A load and the arithmetic applying it to what the chain computed before it
+    struct Step {
+        tiering::Op op;   // ADD, SUBTRACT, MULTIPLY or DIVIDE, NUMBER for the first load
+        tiering::Op load; // NUMBER, LOCAL, FREE or LOCAL_OR_FREE, with its operands
+        int a;
+        int b;
+    };
+
+    // `x op y op z ...`, evaluated left to right
+    using Chain = std::vector<Step>;
+
+    struct Form {
+        Chain left;
+        tiering::Op compare = tiering::Op::NUMBER; // The comparison of `left` and `right`, NUMBER for arithmetic
+        Chain right;
+    };
+
+    struct Site {
+        std::optional<Form> form; // nullopt when no superinstruction covers the expression
+        std::atomic<State> state{State::WARMING};
+        std::atomic<uint32_t> seen{0};
+        std::atomic<uint32_t> deopts{0};
+    };
+
+    // One site per expression of a program
+    struct Feedback {
+        explicit Feedback(const size_t count) : sites(std::make_unique<Site[]>(count)) {}
+
+        std::unique_ptr<Site[]> sites;
+    };
+
+    inline bool load(const tiering::Op op) {
+        using tiering::Op;
+        return op == Op::NUMBER || op == Op::LOCAL || op == Op::FREE || op == Op::LOCAL_OR_FREE;
+    }
+
+    inline bool arithmetic(const tiering::Op op) {
+        using tiering::Op;
+        return op == Op::ADD || op == Op::SUBTRACT || op == Op::MULTIPLY || op == Op::DIVIDE;
+    }
+
+    inline bool comparison(const tiering::Op op) {
+        using tiering::Op;
+        return op == Op::LESS || op == Op::GREATER || op == Op::LESS_EQUAL || op == Op::GREATER_EQUAL || op == Op::EQUAL || op == Op::NOT_EQUAL;
+    }
+
+    // code[begin, end) as a chain
+    inline std::optional<Chain> chain(const std::vector<tiering::Instruction> &code, const size_t begin, const size_t end) {
+        if (begin >= end || !load(code[begin].op)) return std::nullopt;
+        Chain steps = {{tiering::Op::NUMBER, code[begin].op, code[begin].a, code[begin].b}};
+        for (size_t i = begin + 1; i < end; i += 2) {
+            if (i + 1 >= end || !load(code[i].op) || !arithmetic(code[i + 1].op)) return std::nullopt;
+            steps.push_back({code[i + 1].op, code[i].op, code[i].a, code[i].b});
+        }
+        return steps;
+    }
+
+    // The superinstruction `code` is, if any: a chain, or `OPERAND chain ROUND_TRIP OPERAND chain
+    // ROUND_TRIP comparison` like the compiler emits for conditions
+    inline std::optional<Form> form(const std::vector<tiering::Instruction> &code) {
+        using tiering::Op;
+        if (auto left = chain(code, 0, code.size())) return Form{std::move(*left), Op::NUMBER, {}};
+        if (code.size() < 7 || code[0].op != Op::OPERAND || !comparison(code.back().op) || code[code.size() - 2].op != Op::ROUND_TRIP) {
+            return std::nullopt;
+        }
+        for (size_t middle = 1; middle + 2 < code.size() - 2; middle++) {
+            if (code[middle].op != Op::ROUND_TRIP || code[middle + 1].op != Op::OPERAND) continue;
+            auto left = chain(code, 1, middle);
+            auto right = chain(code, middle + 2, code.size() - 2);
+            if (!left || !right) return std::nullopt;
+            return Form{std::move(*left), code.back().op, std::move(*right)};
+        }
+        return std::nullopt;
+    }
+
+    inline std::shared_ptr<Feedback> analyze(const tiering::Program &program) {
+        auto feedback = std::make_shared<Feedback>(program.expressions.size());
+        for (size_t i = 0; i < program.expressions.size(); i++) {
+            feedback->sites[i].form = form(program.expressions[i]);
+        }
+        return feedback;
+    }
+
+    // A generic evaluation of the site's expression went through
+    inline void observe(Site &site) {
+        if (!site.form || site.state.load(std::memory_order_relaxed) != State::WARMING) return;
+        if (site.seen.fetch_add(1, std::memory_order_relaxed) + 1 >= WARMUP) {
+            site.state.store(State::QUICK, std::memory_order_relaxed);
+        }
+    }
+
+    // A guard of the quickened expression failed
+    inline void deoptimize(Site &site) {
+        if (site.deopts.fetch_add(1, std::memory_order_relaxed) + 1 >= MAX_DEOPTS) {
+            site.state.store(State::GENERIC, std::memory_order_relaxed);
+        }
+    }
+
+    // std::stod, false where it would throw
+    inline bool parse(const std::string &text, double &value) {
+        const char* begin = text.c_str();
+        char* end = nullptr;
+        errno = 0;
+        value = std::strtod(begin, &end);
+        return end != begin && errno != ERANGE;
+    }
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+// Work-stealing task scheduler behind `extern "spawn"` / `extern "join"`.
+//
+// Every worker owns a deque: it pushes and pops its own tasks at the back (newest first, while
+// they are cache-warm) and other workers steal from the front when they run dry. Tasks submitted
+// from outside the pool are dealt round-robin. A thread outside the pool waiting on a task runs
+// queued tasks in the meantime instead of only blocking.
+//
+// Tasks run on fibers (many fibers on few workers). A task that has to wait, for another task, a
+// channel or a sleep, suspends its fiber and the worker moves on to the next task; whatever it
+// waited for submits the task again, and it resumes on whichever worker picks it up.
+namespace scheduler {
+    struct Task {
+        std::function<void(Task&)> body;
+        std::atomic<bool> finished{false};
+        std::optional<Diagnostic> failure; // Set when the task's script raised an error
+#if !defined(_WIN32)
+        std::unique_ptr<fiber::Fiber> fiber; // Created when the task first runs
+        Context* context = nullptr;          // The fiber's current context while it is suspended
+#endif
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Task>> waiters; // Suspended tasks joining this one
+    };
+
+    // Set by a fiber right before it suspends, the worker calls it with the task once the fiber's
+    // stack is no longer in use, to hand the task to whatever will submit it again
+    inline thread_local std::function<void(const std::shared_ptr<Task>&)> parking;
+
+    // Set once the worker pool, the timer thread or the background compiler started. A process
+    // forked after that only has the thread that called fork(), and would wait forever on the others.
+    inline std::atomic<bool> threadsStarted{false};
+
+    // True when running on a task's fiber, where waiting should suspend instead of block
+    inline bool inFiber() {
+#if !defined(_WIN32)
+        return fiber::running() != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Suspend the task running on this fiber, `park` decides who resumes it
+    inline void suspend(std::function<void(const std::shared_ptr<Task>&)> park) {
+#if !defined(_WIN32)
+        parking = std::move(park);
+        fiber::running()->yield();
+#endif
+    }
+
+    // One worker per hardware thread, capped by the cgroup CPU quota (v2 cpu.max, v1 cfs files)
+    // so a container limited to 2 CPUs doesn't run 64 busy workers on them
+    inline size_t workerCount() {
+        size_t count = std::max(1u, std::thread::hardware_concurrency());
+
+        double quota = 0;
+        if (std::ifstream max("/sys/fs/cgroup/cpu.max"); max) {
+            std::string limit;
+            double period = 0;
+            if (max >> limit >> period && limit != "max" && period > 0) {
+                quota = std::stod(limit) / period;
+            }
+        } else {
+            std::ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+            std::ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+            double limit = 0, period = 0;
+            if (quotaFile >> limit && periodFile >> period && limit > 0 && period > 0) {
+                quota = limit / period;
+            }
+        }
+
+        if (quota > 0) {
+            count = std::min(count, std::max<size_t>(1, static_cast<size_t>(std::ceil(quota))));
+        }
+        return count;
+    }
+
+    class Pool {
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<std::shared_ptr<Task>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> queued{0};
+        std::atomic<size_t> next{0};
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+
+        static inline thread_local const Pool* current = nullptr; // Pool the calling thread works for
+        static inline thread_local size_t self = 0;
+
+        [[nodiscard]] size_t home() {
+            return current == this ? self : next++ % workers.size();
+        }
+
+        // Newest task of our own deque, otherwise the oldest one of somebody else's
+        std::shared_ptr<Task> take(const size_t index) {
+            {
+                auto &own = *workers[index];
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    auto task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    queued--;
+                    return task;
+                }
+            }
+            for (size_t i = 1; i < workers.size(); i++) {
+                auto &victim = *workers[(index + i) % workers.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    auto task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    queued--;
+                    return task;
+                }
+            }
+            return nullptr;
+        }
+
+        // Run a task until it finishes or suspends
+        void execute(const std::shared_ptr<Task> &task) {
+#if !defined(_WIN32)
+            if (!task->fiber) {
+                task->fiber = std::make_unique<fiber::Fiber>([raw = task.get()] { raw->body(*raw); });
+            }
+            Context* own = activeContext;
+            activeContext = task->context;
+            task->fiber->resume();
+            task->context = activeContext;
+            activeContext = own;
+
+            if (!task->fiber->finished()) {
+                // May resume somewhere else right away, nothing here touches the task afterwards
+                std::exchange(parking, nullptr)(task);
+                return;
+            }
+            task->fiber.reset();
+#else
+            task->body(*task);
+#endif
+
+            std::vector<std::shared_ptr<Task>> waiters;
+            {
+                std::lock_guard lock(task->mutex);
+                task->finished = true;
+                waiters.swap(task->waiters);
+            }
+            task->finished.notify_all();
+            for (auto &waiter : waiters) {
+                submit(std::move(waiter));
+            }
+        }
+
+        void loop(const size_t index) {
+            current = this;
+            self = index;
+            while (true) {
+                if (const auto task = take(index)) {
+                    execute(task);
+                    continue;
+                }
+                std::unique_lock lock(sleepMutex);
+                wake.wait(lock, [this] { return queued.load() > 0; });
+            }
+        }
+
+    public:
+        explicit Pool(const size_t size) {
+            threadsStarted = true;
+            for (size_t i = 0; i < size; i++) {
+                workers.push_back(std::make_unique<Worker>());
+            }
+            for (size_t i = 0; i < size; i++) {
+                threads.emplace_back([this, i] { loop(i); });
+            }
+        }
+
+        [[nodiscard]] size_t size() const {
+            return workers.size();
+        }
+
+        void submit(std::shared_ptr<Task> task) {
+            auto &worker = *workers[home()];
+            {
+                std::lock_guard lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+            }
+            queued++;
+            {
+                std::lock_guard lock(sleepMutex);
+            }
+            wake.notify_one();
+        }
+
+        // Run one queued task on the calling thread, false when there was nothing to run
+        bool helpOnce() {
+            if (const auto task = take(home())) {
+                execute(task);
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool isWorker() const {
+            return current == this;
+        }
+
+        void wait(const std::shared_ptr<Task> &task) {
+            if (inFiber()) {
+                while (!task->finished) {
+                    suspend([this, &task](const std::shared_ptr<Task> &self) {
+                        std::unique_lock lock(task->mutex);
+                        if (!task->finished) {
+                            task->waiters.push_back(self);
+                            return;
+                        }
+                        lock.unlock();
+                        submit(self);
+                    });
+                }
+                return;
+            }
+            while (!task->finished) {
+                if (!helpOnce()) {
+                    task->finished.wait(false);
+                }
+            }
+        }
+    };
+
+    // Loops shorter than SERIAL_CUTOFF run serially, and no chunk is shorter than MIN_CHUNK_TIME
+    constexpr auto SERIAL_CUTOFF = std::chrono::microseconds(200);
+    constexpr auto MIN_CHUNK_TIME = std::chrono::microseconds(50);
+
+    // Split [begin, end) for a loop whose iterations take about `perIteration`: a few chunks per
+    // worker so one slow chunk doesn't leave the others idle, but never so short that scheduling
+    // costs more than the work. A single chunk means the loop should just run serially.
+    inline std::vector<std::pair<int64_t, int64_t>> chunks(const int64_t begin, const int64_t end, const std::chrono::nanoseconds perIteration, const size_t workers) {
+        const int64_t count = end - begin;
+        if (count <= 0) return {};
+
+        const int64_t cost = std::max<int64_t>(perIteration.count(), 1);
+        if (workers <= 1 || count * cost < std::chrono::nanoseconds(SERIAL_CUTOFF).count()) {
+            return {{begin, end}};
+        }
+
+        const auto perWorker = static_cast<int64_t>(workers) * 4;
+        const int64_t byBalance = (count + perWorker - 1) / perWorker;
+        const int64_t byTime = std::chrono::nanoseconds(MIN_CHUNK_TIME).count() / cost;
+        const int64_t grain = std::max<int64_t>({1, byBalance, byTime});
+
+        std::vector<std::pair<int64_t, int64_t>> result;
+        for (int64_t from = begin; from < end; from += grain) {
+            result.emplace_back(from, std::min(end, from + grain));
+        }
+        return result;
+    }
+
+    // Created on first use and never torn down: workers may still be parked when the process exits
+    inline Pool& pool() {
+        static Pool* instance = new Pool(workerCount());
+        return *instance;
+    }
+
+    // Tasks sleeping on a fiber, submitted again by one timer thread once their deadline passes
+    class Timers {
+    private:
+        using Entry = std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<Task>>;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<>> sleeping;
+        std::thread thread;
+
+        void loop() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                if (sleeping.empty()) {
+                    changed.wait(lock);
+                    continue;
+                }
+                const auto deadline = sleeping.top().first; // add() may move the entry while we wait
+                if (changed.wait_until(lock, deadline) == std::cv_status::no_timeout) {
+                    continue; // An earlier deadline may have arrived
+                }
+                while (!sleeping.empty() && sleeping.top().first <= std::chrono::steady_clock::now()) {
+                    auto task = sleeping.top().second;
+                    sleeping.pop();
+                    pool().submit(std::move(task));
+                }
+            }
+        }
+
+    public:
+        Timers() : thread([this] { loop(); }) {
+            threadsStarted = true;
+        }
+
+        void add(const std::chrono::steady_clock::time_point deadline, std::shared_ptr<Task> task) {
+            {
+                std::lock_guard lock(mutex);
+                sleeping.emplace(deadline, std::move(task));
+            }
+            changed.notify_one();
+        }
+    };
+
+    inline Timers& timers() {
+        static Timers* instance = new Timers();
+        return *instance;
+    }
+
+    // Only the calling task waits when it runs on a fiber, otherwise the whole thread sleeps
+    inline void sleepFor(const std::chrono::milliseconds duration) {
+        if (!inFiber()) {
+            std::this_thread::sleep_for(duration);
+            return;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + duration;
+        suspend([deadline](const std::shared_ptr<Task> &self) { timers().add(deadline, self); });
+    }
+
+    // Wait for every task `ctx` spawned and never joined. They may still write to the context's
+    // streams, so this runs before a frame that spawned them goes away; the first failure among
+    // them is returned so an error can't go unnoticed just because nobody joined the task.
+    inline std::optional<Diagnostic> joinAll(Context &ctx) {
+        std::optional<Diagnostic> failure;
+        for (auto &task : ctx.tasks) {
+            if (!task) continue;
+            pool().wait(task);
+            if (!failure) failure = task->failure;
+            task.reset();
+        }
+        ctx.tasks.clear();
+        return failure;
+    }
+}
@@ -0,0 +1,389 @@
+#pragma once
+
+// Process snapshot images.
+//
+// A snapshot holds what the declarations and merges of an entry file put in its global symbol
+// table: functions with their token bodies and merged namespaces. Variables are left out, a
+// restored run executes every other statement again and declares them in order, so nothing is
+// visible earlier than it would be without the image. Neither is a name declared by more than one
+// top-level statement, which must take each of its meanings in turn. Every string is stored
+// once in a constant pool and everything else refers to it by index, so the image contains no
+// pointers and can be mapped anywhere. Restoring is a single read-only mmap followed by a decode.
+// An image is only used while the entry file, every module file it merged and the settings that
+// decide which files a merge finds are unchanged.
+//
+// Layout: Header | string offsets (uint64 offset, uint32 length)[stringCount] | string bytes |
+//         merged files (string, uint64 digest)[] | symbols
+namespace snapshot {
+    constexpr char MAGIC[8] = {'I', 'C', 'V', 'S', 'N', 'A', 'P', '3'};
+    constexpr uint32_t ENDIAN_MARK = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        uint32_t byteOrder;
+        uint32_t stringCount;
+        uint64_t fingerprint;  // Fingerprint of the entry file the snapshot was taken from
+        uint64_t stringsOffset;
+        uint64_t symbolsOffset;
+        uint64_t size;
+    };
+
+    enum class Kind : uint8_t {
+        VARIABLE,
+        FUNCTION,
+        NAMESPACE
+    };
+
+    // FNV-1a
+    struct Hash {
+        uint64_t value = 14695981039346656037ull;
+
+        void mix(const void* data, const size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                value ^= static_cast<const unsigned char*>(data)[i];
+                value *= 1099511628211ull;
+            }
+        }
+
+        void mix(const std::string &str) {
+            mix(str.data(), str.size());
+            mix("", 1); // So that no two lists of strings hash the same
+        }
+    };
+
+    // Hash of the entry file's tokens and of where merges look for modules (the working directory,
+    // CVAST_STDLIB and CVAST_PATH), used to reject snapshots of a different program
+    inline uint64_t fingerprint(const std::vector<Token> &tokens) {
+        Hash hash;
+        for (const auto &[type, value, line, column] : tokens) {
+            hash.mix(value.data(), value.size());
+            hash.mix(&line, sizeof(line));
+            hash.mix(&column, sizeof(column));
+        }
+        std::error_code ec;
+        hash.mix(std::filesystem::current_path(ec).string());
+        for (const char* name : {"CVAST_STDLIB", "CVAST_PATH"}) {
+            const char* value = std::getenv(name);
+            hash.mix(value != nullptr ? value : "");
+        }
+        return hash.value;
+    }
+
+    // Hash of the contents of the module file at `path`
+    inline uint64_t digest(const std::string &path) {
+        const auto file = modules::open(path);
+        Hash hash;
+        char buffer[4096];
+        while (file->read(buffer, sizeof(buffer)) || file->gcount() > 0) {
+            hash.mix(buffer, static_cast<size_t>(file->gcount()));
+        }
+        return hash.value;
+    }
+
+    // The functions and namespaces of `table` that one top-level `fn` or `merge` of `tokens` declares
+    inline std::unordered_map<std::string, SymbolInfo> declarations(const std::unordered_map<std::string, SymbolInfo> &table, const std::vector<Token> &tokens) {
+        std::unordered_map<std::string, int> declared; // By any top-level statement, nested blocks included
+        std::unordered_set<std::string> once;          // By a single `fn` or `merge`
+        for (const auto &statement : autoparallel::split(tokens)) {
+            const Token &first = tokens[statement.begin];
+            std::string name;
+            if (first.value == "merge" && statement.end >= statement.begin + 2) {
+                name = tokens[statement.end - 2].value; // `merge ... as alias;`
+            } else if (first.value == "fn" || first.value == "@") {
+                for (size_t i = statement.begin; i + 1 < statement.end; i++) {
+                    if (tokens[i].value == "fn") {
+                        name = tokens[i + 1].value;
+                        break;
+                    }
+                }
+            }
+            if (!name.empty()) {
+                if (++declared[name] == 1) once.insert(name);
+                continue;
+            }
+            for (size_t i = statement.begin; i + 1 < statement.end; i++) {
+                if (tokens[i].type == TokenType::KEYWORD && (tokens[i].value == "var" || tokens[i].value == "fn")) declared[tokens[i + 1].value] += 2;
+            }
+        }
+
+        std::unordered_map<std::string, SymbolInfo> kept;
+        for (const auto &name : once) {
+            const auto it = table.find(name);
+            if (declared[name] == 1 && it != table.end() && !std::holds_alternative<Variable>(it->second)) kept.insert(*it);
+        }
+        return kept;
+    }
+
+    class Writer {
+    private:
+        std::unordered_map<std::string, uint32_t> pool;
+        std::vector<const std::string*> strings;
+        std::vector<char> symbols;
+
+        template<typename T>
+        void put(const T value) {
+            const auto* bytes = reinterpret_cast<const char*>(&value);
+            symbols.insert(symbols.end(), bytes, bytes + sizeof(T));
+        }
+
+        void put(const std::string &str) {
+            const auto [it, inserted] = pool.try_emplace(str, static_cast<uint32_t>(strings.size()));
+            if (inserted) strings.push_back(&it->first);
+            put(it->second);
+        }
+
+        void put(const std::vector<Token> &tokens) {
+            put(static_cast<uint32_t>(tokens.size()));
+            for (const auto &[type, value, line, column] : tokens) {
+                put(static_cast<uint8_t>(type));
+                put(value);
+                put(static_cast<int32_t>(line));
+                put(static_cast<int32_t>(column));
+            }
+        }
+
+        void put(const Variable &var) {
+            put(var.identifier);
+            put(var.type);
+            put(var.value);
+            put(var.scopeLevel);
+        }
+
+        void put(const std::unordered_map<std::string, SymbolInfo> &table) {
+            put(static_cast<uint32_t>(table.size()));
+            for (const auto &[name, info] : table) {
+                put(name);
+                if (const auto *var = std::get_if<Variable>(&info)) {
+                    put(Kind::VARIABLE);
+                    put(*var);
+                } else if (const auto *func = std::get_if<Function>(&info)) {
+                    put(Kind::FUNCTION);
+                    put(func->identifier);
+                    put(func->returnType);
+                    put(func->scopeLevel);
+                    put(static_cast<uint8_t>(func->memoize));
+                    put(static_cast<uint32_t>(func->parameters.size()));
+                    for (const auto &param : func->parameters) put(param);
+                    put(static_cast<uint32_t>(func->localVariables.size()));
+                    for (const auto &local : func->localVariables) put(local);
+                    put(*func->body);
+                    put(*func->unfilteredBody);
+                } else if (const auto *ns = std::get_if<Namespace>(&info)) {
+                    put(Kind::NAMESPACE);
+                    put(ns->identifier);
+                    put(*ns->symbols);
+                }
+            }
+        }
+
+    public:
+        bool write(const std::string &path, const std::unordered_map<std::string, SymbolInfo> &table, const uint64_t fingerprint, const std::vector<std::string> &sources) {
+            const std::set<std::string> files(sources.begin(), sources.end());
+            put(static_cast<uint32_t>(files.size()));
+            for (const auto &file : files) {
+                put(file);
+                put(digest(file));
+            }
+            put(table);
+
+            Header header{};
+            std::ranges::copy(MAGIC, header.magic);
+            header.byteOrder = ENDIAN_MARK;
+            header.stringCount = static_cast<uint32_t>(strings.size());
+            header.fingerprint = fingerprint;
+            header.stringsOffset = sizeof(Header);
+
+            std::vector<char> blob;
+            std::vector<std::pair<uint64_t, uint32_t>> offsets;
+            for (const auto* str : strings) {
+                offsets.emplace_back(blob.size(), static_cast<uint32_t>(str->size()));
+                blob.insert(blob.end(), str->begin(), str->end());
+            }
+            const uint64_t entrySize = sizeof(uint64_t) + sizeof(uint32_t);
+            header.symbolsOffset = header.stringsOffset + offsets.size() * entrySize + blob.size();
+            header.size = header.symbolsOffset + symbols.size();
+
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            for (const auto &[offset, length] : offsets) {
+                out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            }
+            out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+            out.write(symbols.data(), static_cast<std::streamsize>(symbols.size()));
+            return static_cast<bool>(out);
+        }
+    };
+
+    struct Image {
+        std::unordered_map<std::string, SymbolInfo> table;
+        std::vector<std::string> sources; // Module files the table was made from
+    };
+
+    class Reader {
+    private:
+        const char* data;
+        size_t size;
+        size_t cursor = 0;
+        std::vector<std::string> strings;
+
+        template<typename T>
+        T get() {
+            if (cursor + sizeof(T) > size) throw std::runtime_error("Truncated snapshot");
+            T value;
+            std::memcpy(&value, data + cursor, sizeof(T));
+            cursor += sizeof(T);
+            return value;
+        }
+
+        // Element counts can never exceed the bytes left, which keeps a corrupt image from allocating wildly
+        uint32_t getCount() {
+            const auto count = get<uint32_t>();
+            if (count > size - cursor) throw std::runtime_error("Corrupt snapshot count");
+            return count;
+        }
+
+        const std::string& getString() {
+            const auto id = get<uint32_t>();
+            if (id >= strings.size()) throw std::runtime_error("Corrupt snapshot string index");
+            return strings[id];
+        }
+
+        std::vector<Token> getTokens() {
+            std::vector<Token> tokens(getCount());
+            for (auto &token : tokens) {
+                token.type = static_cast<TokenType>(get<uint8_t>());
+                token.value = getString();
+                token.line = get<int32_t>();
+                token.column = get<int32_t>();
+            }
+            return tokens;
+        }
+
+        Variable getVariable() {
+            Variable var;
+            var.identifier = getString();
+            var.type = getString();
+            var.value = getString();
+            var.scopeLevel = getString();
+            return var;
+        }
+
+        std::unordered_map<std::string, SymbolInfo> getTable() {
+            std::unordered_map<std::string, SymbolInfo> table;
+            const auto count = getCount();
+            for (uint32_t i = 0; i < count; i++) {
+                const std::string &name = getString();
+                switch (get<Kind>()) {
+                    case Kind::VARIABLE:
+                        table[name] = getVariable();
+                        break;
+                    case Kind::FUNCTION: {
+                        Function func;
+                        func.identifier = getString();
+                        func.returnType = getString();
+                        func.scopeLevel = getString();
+                        func.memoize = get<uint8_t>() != 0;
+                        func.parameters.resize(getCount());
+                        for (auto &param : func.parameters) param = getString();
+                        func.localVariables.resize(getCount());
+                        for (auto &local : func.localVariables) local = getVariable();
+                        func.body = std::make_shared<const std::vector<Token>>(getTokens());
+                        func.unfilteredBody = std::make_shared<const std::vector<Token>>(getTokens());
+                        table[name] = std::move(func);
+                        break;
+                    }
+                    case Kind::NAMESPACE: {
+                        Namespace ns;
+                        ns.identifier = getString();
+                        ns.symbols = std::make_shared<const std::unordered_map<std::string, SymbolInfo>>(getTable());
+                        table[name] = std::move(ns);
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("Corrupt snapshot symbol");
+                }
+            }
+            return table;
+        }
+
+    public:
+        Reader(const char* data, const size_t size) : data(data), size(size) {}
+
+        Image read(const uint64_t fingerprint) {
+            const auto header = get<Header>();
+            if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic) || header.byteOrder != ENDIAN_MARK || header.size != size) {
+                throw std::runtime_error("Not a snapshot image for this interpreter");
+            }
+            if (header.fingerprint != fingerprint) {
+                throw std::runtime_error("Snapshot was taken from a different program");
+            }
+
+            // stringCount is 32 bits, its table can't overflow; every section has to lie inside the image
+            const uint64_t blobOffset = header.stringsOffset + uint64_t{header.stringCount} * (sizeof(uint64_t) + sizeof(uint32_t));
+            if (header.stringsOffset < sizeof(Header) || header.stringsOffset > size || blobOffset < header.stringsOffset || blobOffset > header.symbolsOffset ||
+                header.symbolsOffset > size) {
+                throw std::runtime_error("Corrupt snapshot layout");
+            }
+            cursor = header.stringsOffset;
+            const uint64_t blobSize = header.symbolsOffset - blobOffset;
+            strings.reserve(header.stringCount);
+            for (uint32_t i = 0; i < header.stringCount; i++) {
+                const auto offset = get<uint64_t>();
+                const auto length = get<uint32_t>();
+                if (offset > blobSize || length > blobSize - offset) throw std::runtime_error("Corrupt snapshot string");
+                strings.emplace_back(data + blobOffset + offset, length);
+            }
+
+            cursor = header.symbolsOffset;
+            Image image;
+            image.sources.resize(getCount());
+            for (auto &file : image.sources) {
+                file = getString();
+                if (get<uint64_t>() != digest(file)) throw std::runtime_error("Merged module '" + file + "' changed since the snapshot was taken");
+            }
+            image.table = getTable();
+            return image;
+        }
+    };
+
+    // `sources` are the module files the run merged, see Parser::getSources
+    inline bool write(const std::string &path, const std::unordered_map<std::string, SymbolInfo> &table, const uint64_t fingerprint, const std::vector<std::string> &sources) {
+        return Writer().write(path, table, fingerprint, sources);
+    }
+
+    // Map the whole image in one go and decode it, nullopt (with a warning) if it can't be used
+    inline std::optional<Image> read(const std::string &path, const uint64_t fingerprint) {
+        try {
+#if defined(_WIN32)
+            std::ifstream in(path, std::ios::binary);
+            const std::vector<char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (!in && !in.eof()) throw std::runtime_error("Cannot read snapshot");
+            return Reader(image.data(), image.size()).read(fingerprint);
+#else
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Cannot open snapshot");
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                throw std::runtime_error("Cannot read snapshot");
+            }
+            void* image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (image == MAP_FAILED) throw std::runtime_error("Cannot map snapshot");
+
+            try {
+                auto decoded = Reader(static_cast<const char*>(image), st.st_size).read(fingerprint);
+                munmap(image, st.st_size);
+                return decoded;
+            } catch (...) {
+                munmap(image, st.st_size);
+                throw;
+            }
+#endif
+        } catch (const std::runtime_error &e) {
+            std::cerr << INTERPRETER_NAME << ": " << yellow << "warning: " << reset << "ignoring snapshot '" << path << "': " << e.what() << std::endl;
+            return std::nullopt;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// Small helpers for the local Unix socket servers (fork server, icvastd)
+#if !defined(_WIN32)
+namespace sockets {
+    inline bool readAll(const int fd, void* buffer, size_t size) {
+        auto* bytes = static_cast<char*>(buffer);
+        while (size > 0) {
+            const ssize_t n = read(fd, bytes, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    inline bool writeAll(const int fd, const void* buffer, size_t size) {
+        const auto* bytes = static_cast<const char*>(buffer);
+        while (size > 0) {
+            const ssize_t n = write(fd, bytes, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Switch `fd` between blocking and non-blocking reads and writes
+    inline void setBlocking(const int fd, const bool blocking) {
+        const int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+    }
+
+    // Milliseconds left until `deadline`, as a poll() timeout
+    inline int until(const std::chrono::steady_clock::time_point deadline) {
+        const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return static_cast<int>(std::clamp<int64_t>(left.count(), 0, std::numeric_limits<int>::max()));
+    }
+
+    inline sockaddr_un address(const std::string &path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+
+    // A decimal size as a peer sent it, false unless `text` is nothing but digits that fit
+    inline bool parseSize(const std::string &text, size_t &value) {
+        const char* end = text.data() + text.size();
+        if (text.empty() || !std::ranges::all_of(text, [](const char c) { return c >= '0' && c <= '9'; })) return false;
+        const auto [stop, error] = std::from_chars(text.data(), end, value);
+        return error == std::errc() && stop == end;
+    }
+
+    // Read up to and excluding the next '\n'
+    inline bool readLine(const int fd, std::string &line, const size_t limit = 4096) {
+        line.clear();
+        char c;
+        while (line.size() < limit) {
+            if (!readAll(fd, &c, 1)) return false;
+            if (c == '\n') return true;
+            line.push_back(c);
+        }
+        return false;
+    }
+
+    inline int listenOn(const std::string &path) {
+        const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        const sockaddr_un addr = address(path);
+        unlink(path.c_str());
+        if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0) {
+            if (listener >= 0) close(listener);
+            return -1;
+        }
+        return listener;
+    }
+
+    inline int connectTo(const std::string &path) {
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        const sockaddr_un addr = address(path);
+        if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+// Specializations of compiled functions with `any` parameters, behind --max-specializations.
+//
+// The compiler knows the type of most arguments a body passes on: constants, locals declared with
+// a type, parameters that aren't `any`. A call whose argument types all pass the callee's
+// parameters is checked once, when compiled, and no longer at run time (tiering::Compiler). A
+// parameter declared `any` takes whatever type it is handed, so calls passing it on are checked at
+// run time. Once such a function is compiled, the first call with a new combination of argument
+// types queues a specialization: the same body compiled in the background with those types for
+// its parameters, whose calls are checked at compile time too. Calls with those types run it from
+// then on. A function gets at most --max-specializations of them (4 by default, 0 never), calls
+// with other types keep running the generic program.
+namespace specialize {
+    // A program for calls whose arguments have `types`, null until it is compiled
+    struct Entry {
+        std::vector<std::string> types;
+        std::shared_ptr<const tiering::Program> compiled; // Keeps `program` alive
+        std::atomic<const tiering::Program*> program{nullptr};
+    };
+
+    // The specializations of one function, entries [0, count) being claimed
+    struct Specializations {
+        explicit Specializations(const size_t capacity) : capacity(capacity), entries(std::make_unique<Entry[]>(capacity)) {}
+
+        const size_t capacity;
+        std::unique_ptr<Entry[]> entries;
+        std::atomic<size_t> count{0};
+        std::mutex mutex; // Held to claim an entry
+
+        [[nodiscard]] const Entry* find(const std::vector<Variable> &arguments) const {
+            const size_t claimed = count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < claimed; i++) {
+                const Entry &entry = entries[i];
+                if (entry.types.size() == arguments.size() &&
+                    std::ranges::equal(entry.types, arguments, [](const std::string &type, const Variable &argument) { return type == argument.type; })) {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        // The entry for the types of `arguments` once this call claimed it, nullopt when another
+        // call did or there is no room left
+        std::optional<size_t> claim(const std::vector<Variable> &arguments) {
+            if (count.load(std::memory_order_relaxed) >= capacity) return std::nullopt;
+            std::lock_guard lock(mutex);
+            const size_t claimed = count.load(std::memory_order_relaxed);
+            if (claimed >= capacity || find(arguments) != nullptr) return std::nullopt;
+            for (const Variable &argument : arguments) entries[claimed].types.push_back(argument.type);
+            count.store(claimed + 1, std::memory_order_release);
+            return claimed;
+        }
+    };
+
+    // Whether calls with `arguments` would get a program different from the generic one: an `any`
+    // parameter is handed something with a type of its own
+    inline bool worthwhile(const Function &func, const std::vector<Variable> &arguments) {
+        for (size_t i = 0; i < arguments.size() && i < func.parameters.size(); i++) {
+            if (func.parameters[i] == "any" && arguments[i].type != "any") return true;
+        }
+        return false;
+    }
+
+    // `int, string`, for --tier-log
+    inline std::string describe(const std::vector<std::string> &types) {
+        std::string text;
+        for (const auto &type : types) text += (text.empty() ? "" : ", ") + type;
+        return text;
+    }
+}
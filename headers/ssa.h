@@ -0,0 +1,1044 @@
+#pragma once
+
+// Mid-level IR for compiled programs, behind -O1 and -O2.
+//
+// A Program coming out of the tiering compiler is lifted to SSA form over basic blocks: each
+// declaration of a slot defines a new Value, every load knows which Value it reads, and where paths
+// merge a phi picks between theirs. There are no loops in the language, so the graph is acyclic
+// and blocks in bytecode order are already in topological order. The passes rewrite the graph,
+// which is then lowered back into the Program:
+//
+// - inline (-O1, done by tiering::Compiler): calls of small functions are replaced with their bodies,
+//   see tiering::inlinable.
+// - fold (-O1): constant folding and propagation. Loads of Values known at compile time become
+//   numbers, operations on numbers are computed, and a branch on a constant becomes a jump.
+// - dce (-O1): dead-code elimination. Unreachable blocks go, and so do declarations nobody reads.
+// - cse (-O2): an arithmetic declaration computing what an earlier one already holds becomes a copy.
+// - copies (-O2): reads of a copy read the original instead, which usually leaves the copy dead.
+//
+// Values are strings at run time. A known one is only propagated where std::stod reads it, the
+// same conversion a load makes, and an expression that raises is left to raise at run time.
+// Callees see their callers' locals (dynamic scoping), so a declaration stays while a call may
+// still run after it.
+namespace ssa {
+    using tiering::Op;
+    using tiering::Instruction;
+    using tiering::Program;
+
+    enum class Pass : uint8_t { INLINE, BUILD, FOLD, DCE, CSE, COPIES, LOWER };
+    constexpr std::array<const char*, 7> PASS_NAMES = {"inline", "build", "fold", "dce", "cse", "copies", "lower"};
+    constexpr int MAX_FOLD_ROUNDS = 4; // Folding a branch can make more Values known
+
+    // Totals over every program optimized in this process, for --time-passes
+    struct Statistics {
+        std::array<std::atomic<uint64_t>, PASS_NAMES.size()> nanoseconds{};
+        std::array<std::atomic<uint64_t>, PASS_NAMES.size()> changes{};
+        std::atomic<uint64_t> programs{0};
+        std::atomic<uint64_t> before{0}; // Instructions going in, all programs together
+        std::atomic<uint64_t> after{0};
+    };
+
+    inline Statistics& statistics() {
+        static Statistics totals;
+        return totals;
+    }
+
+    // A definition of a slot, or a merge of several
+    struct Value {
+        enum class Kind : uint8_t { UNDECLARED, PARAMETER, DECLARE, ARITHMETIC, CALL, COPY, PHI };
+        Kind kind;
+        int slot;
+        std::vector<int> inputs; // A phi's, one per predecessor, or the Value a copy copies (COPY values only
+                                 // for copies that don't convert, they hold the same string)
+        std::optional<std::string> known; // What it holds, when that is known at compile time
+    };
+
+    struct Statement {
+        Instruction in; // BRANCH, BRANCH_IF and JUMP name a block until lowered
+        std::vector<Instruction> expression; // Of the ops evaluating one, in.b is assigned when lowered
+        size_t origin = 0;          // Token the expression starts at
+        std::vector<int> reads;     // Value each load of `expression` reads, -1 elsewhere
+        int read = -1;              // Value a WRITE, RETURN_VARIABLE, COPY or ARGUMENT reads from its slot
+        std::vector<int> arguments; // Value each call argument reads from its slot, -1 for the others
+        int defines = -1;           // Value it declares
+        std::vector<int> before;    // Value of every slot before it runs
+    };
+
+    struct Block {
+        std::vector<Statement> statements;
+        std::vector<int> predecessors;
+        std::vector<int> phis;
+        bool reachable = false;
+    };
+
+    struct Graph {
+        Program &program;
+        bool topLevel = false; // Its slots outlive it, see tiering::runTopLevel
+        std::vector<Block> blocks;
+        std::vector<Value> values;
+        std::vector<int> exits; // Value of every slot where the program runs off its end
+        bool valid = true;      // False for code the passes don't understand, it is left alone
+    };
+
+    inline bool branches(const Op op) {
+        return op == Op::BRANCH || op == Op::BRANCH_IF;
+    }
+
+    inline bool evaluates(const Op op) {
+        return op == Op::DECLARE_ARITHMETIC || op == Op::DECLARE_RESULT || op == Op::RETURN_ARITHMETIC || branches(op);
+    }
+
+    inline bool returns(const Op op) {
+        return op == Op::RETURN || op == Op::RETURN_CONSTANT || op == Op::RETURN_VARIABLE || op == Op::RETURN_ARITHMETIC || op == Op::RETURN_CALL;
+    }
+
+    inline bool calls(const Op op) {
+        return op == Op::CALL || op == Op::DECLARE_CALL || op == Op::RETURN_CALL;
+    }
+
+    inline bool declares(const Op op) {
+        return op == Op::DECLARE || op == Op::DECLARE_ARITHMETIC || op == Op::DECLARE_CALL || op == Op::COPY ||
+               op == Op::ARGUMENT || op == Op::DECLARE_RESULT;
+    }
+
+    // Ops reading every argument of calls[b]
+    inline bool passes(const Op op) {
+        return calls(op) || op == Op::CHECK;
+    }
+
+    inline bool loads(const Op op) {
+        return op == Op::LOCAL || op == Op::FREE || op == Op::LOCAL_OR_FREE;
+    }
+
+    inline int intern(Program &program, const std::string &value) {
+        if (const auto it = std::ranges::find(program.strings, value); it != program.strings.end()) {
+            return static_cast<int>(it - program.strings.begin());
+        }
+        program.strings.push_back(value);
+        return static_cast<int>(program.strings.size() - 1);
+    }
+
+    inline int intern(Program &program, const double value) {
+        for (size_t i = 0; i < program.numbers.size(); i++) {
+            if (std::bit_cast<uint64_t>(program.numbers[i]) == std::bit_cast<uint64_t>(value)) return static_cast<int>(i);
+        }
+        program.numbers.push_back(value);
+        return static_cast<int>(program.numbers.size() - 1);
+    }
+
+    // Blocks control goes to after block `b`, blocks.size() being the end of the program
+    inline std::vector<int> successors(const Graph &graph, const int b) {
+        const int next = b + 1;
+        const auto &statements = graph.blocks[b].statements;
+        if (statements.empty()) return {next};
+        const Instruction &last = statements.back().in;
+        if (branches(last.op)) return last.a == next ? std::vector{next} : std::vector{next, last.a};
+        if (last.op == Op::JUMP) return {last.a};
+        if (returns(last.op)) return {};
+        return {next};
+    }
+
+    // Whether the slot holds a variable once it has Value `v`, nullopt when that depends on the path
+    inline std::optional<bool> declared(const Graph &graph, const int v) {
+        const Value &value = graph.values[v];
+        if (value.kind == Value::Kind::UNDECLARED) return false;
+        if (value.kind != Value::Kind::PHI) return true;
+        const std::optional<bool> first = declared(graph, value.inputs[0]);
+        for (size_t i = 1; first && i < value.inputs.size(); i++) {
+            if (declared(graph, value.inputs[i]) != first) return std::nullopt;
+        }
+        return first;
+    }
+
+    // Number the Values: what every load reads, and phis where paths merge. Reachability is
+    // worked out on the way.
+    inline void analyze(Graph &graph) {
+        const Program &program = graph.program;
+        const int slots = static_cast<int>(program.slotNames.size());
+        auto &values = graph.values;
+        values.clear();
+        graph.exits.clear();
+        for (int slot = 0; slot < slots; slot++) values.push_back({Value::Kind::UNDECLARED, slot, {}, std::nullopt});
+        const auto define = [&values](const Value::Kind kind, const int slot, std::vector<int> inputs = {}, std::optional<std::string> known = std::nullopt) {
+            values.push_back({kind, slot, std::move(inputs), std::move(known)});
+            return static_cast<int>(values.size() - 1);
+        };
+
+        struct State {
+            std::vector<int> slots;
+            std::vector<std::pair<int, std::vector<int>>> saved; // Then-blocks entered, with what their slots held
+        };
+        std::vector<State> ends(graph.blocks.size());
+        for (Block &block : graph.blocks) {
+            block.predecessors.clear();
+            block.phis.clear();
+            block.reachable = false;
+        }
+        graph.blocks[0].reachable = true;
+
+        for (size_t b = 0; b < graph.blocks.size(); b++) {
+            Block &block = graph.blocks[b];
+            if (!block.reachable) continue;
+
+            State state;
+            if (b == 0) {
+                for (int slot = 0; slot < slots; slot++) state.slots.push_back(slot);
+                for (const int parameter : program.parameters) state.slots[parameter] = define(Value::Kind::PARAMETER, parameter);
+            } else {
+                const auto merge = [&](const int slot, const std::vector<int> &incoming) {
+                    if (std::ranges::all_of(incoming, [&](const int v) { return v == incoming[0]; })) return incoming[0];
+                    std::optional<std::string> known = values[incoming[0]].known;
+                    for (const int v : incoming) {
+                        if (values[v].known != known) known.reset();
+                    }
+                    const int phi = define(Value::Kind::PHI, slot, incoming, known);
+                    block.phis.push_back(phi);
+                    return phi;
+                };
+                state = ends[block.predecessors[0]];
+                for (const int p : block.predecessors) {
+                    const auto &saved = ends[p].saved;
+                    if (saved.size() != state.saved.size() || !std::ranges::equal(saved | std::views::keys, state.saved | std::views::keys)) {
+                        graph.valid = false;
+                        return;
+                    }
+                }
+                std::vector<int> incoming;
+                for (int slot = 0; slot < slots; slot++) {
+                    incoming.clear();
+                    for (const int p : block.predecessors) incoming.push_back(ends[p].slots[slot]);
+                    state.slots[slot] = merge(slot, incoming);
+                }
+                for (size_t i = 0; i < state.saved.size(); i++) {
+                    const auto &saves = program.blocks[state.saved[i].first];
+                    for (size_t j = 0; j < saves.size(); j++) {
+                        incoming.clear();
+                        for (const int p : block.predecessors) incoming.push_back(ends[p].saved[i].second[j]);
+                        state.saved[i].second[j] = merge(saves[j], incoming);
+                    }
+                }
+            }
+
+            for (Statement &s : block.statements) {
+                const Instruction &in = s.in;
+                s.before = state.slots;
+                s.reads.assign(s.expression.size(), -1);
+                for (size_t i = 0; i < s.expression.size(); i++) {
+                    const Instruction &load = s.expression[i];
+                    if (load.op == Op::LOCAL || load.op == Op::LOCAL_OR_FREE) s.reads[i] = state.slots[load.a];
+                }
+                s.read = -1;
+                s.defines = -1;
+                s.arguments.clear();
+                if (passes(in.op)) {
+                    for (const auto &argument : program.calls[in.b].arguments) {
+                        s.arguments.push_back(argument.slot >= 0 ? state.slots[argument.slot] : -1);
+                    }
+                }
+                switch (in.op) {
+                    case Op::DECLARE:
+                        s.defines = define(Value::Kind::DECLARE, in.a, {}, program.strings[in.b]);
+                        break;
+                    case Op::DECLARE_ARITHMETIC:
+                        s.defines = define(Value::Kind::ARITHMETIC, in.a);
+                        break;
+                    case Op::DECLARE_CALL:
+                        s.defines = define(Value::Kind::CALL, in.a);
+                        break;
+                    case Op::DECLARE_RESULT:
+                        s.defines = define(Value::Kind::ARITHMETIC, in.a);
+                        break;
+                    case Op::COPY: {
+                        s.read = state.slots[in.b];
+                        const std::string &type = program.strings[in.c];
+                        std::optional<std::string> known = values[s.read].known;
+                        if (known) known = coerce(*known, type);
+                        // Rounding to an int makes a new string, the copy can't be read through
+                        const auto kind = type == "int" ? Value::Kind::ARITHMETIC : Value::Kind::COPY;
+                        s.defines = define(kind, in.a, kind == Value::Kind::COPY ? std::vector{s.read} : std::vector<int>{}, std::move(known));
+                        break;
+                    }
+                    case Op::ARGUMENT: {
+                        const tiering::Argument &argument = program.calls[in.b].arguments[in.c];
+                        if (argument.constant) {
+                            s.defines = define(Value::Kind::DECLARE, in.a, {}, argument.constant->value);
+                        } else if (argument.slot >= 0 && argument.free < 0) {
+                            s.read = state.slots[argument.slot];
+                            s.defines = define(Value::Kind::COPY, in.a, {s.read}, values[s.read].known);
+                        } else {
+                            if (argument.slot >= 0) s.read = state.slots[argument.slot];
+                            s.defines = define(Value::Kind::PARAMETER, in.a);
+                        }
+                        break;
+                    }
+                    case Op::WRITE:
+                    case Op::RETURN_VARIABLE:
+                        if (in.a >= 0) s.read = state.slots[in.a];
+                        break;
+                    case Op::ENTER: {
+                        std::vector<int> held;
+                        for (const int slot : program.blocks[in.a]) held.push_back(state.slots[slot]);
+                        state.saved.emplace_back(in.a, std::move(held));
+                        break;
+                    }
+                    case Op::LEAVE: {
+                        if (state.saved.empty() || state.saved.back().first != in.a) {
+                            graph.valid = false;
+                            return;
+                        }
+                        const auto &held = state.saved.back().second;
+                        for (size_t i = 0; i < held.size(); i++) state.slots[program.blocks[in.a][i]] = held[i];
+                        state.saved.pop_back();
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                if (s.defines >= 0) state.slots[in.a] = s.defines;
+            }
+
+            for (const int next : successors(graph, static_cast<int>(b))) {
+                if (next == static_cast<int>(graph.blocks.size())) {
+                    graph.exits.insert(graph.exits.end(), state.slots.begin(), state.slots.end());
+                    continue;
+                }
+                graph.blocks[next].reachable = true;
+                graph.blocks[next].predecessors.push_back(static_cast<int>(b));
+            }
+            ends[b] = std::move(state);
+        }
+    }
+
+    // Split `program` into blocks at every jump, jump target and return
+    inline Graph build(Program &program, const bool topLevel) {
+        Graph graph{program, topLevel, {}, {}, {}};
+        const auto &code = program.code;
+        std::vector<bool> leader(code.size() + 1, false);
+        leader[0] = true;
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            const Instruction &in = code[pc];
+            if (branches(in.op) || in.op == Op::JUMP) {
+                if (in.a <= static_cast<int>(pc) || in.a > static_cast<int>(code.size())) {
+                    graph.valid = false; // The compiler only jumps forward
+                    return graph;
+                }
+                leader[in.a] = true;
+            }
+            if (branches(in.op) || in.op == Op::JUMP || returns(in.op)) leader[pc + 1] = true;
+        }
+
+        std::vector<int> blockAt(code.size() + 1);
+        for (size_t pc = 0; pc <= code.size(); pc++) {
+            if (leader[pc]) graph.blocks.emplace_back();
+            blockAt[pc] = static_cast<int>(graph.blocks.size() - 1);
+            if (pc == code.size()) break;
+            Statement statement{code[pc], {}, 0, {}, -1, {}, -1, {}};
+            if (evaluates(code[pc].op)) {
+                statement.expression = program.expressions[code[pc].b];
+                statement.origin = program.origins[code[pc].b];
+            }
+            graph.blocks.back().statements.push_back(std::move(statement));
+        }
+        for (Block &block : graph.blocks) {
+            for (Statement &s : block.statements) {
+                if (branches(s.in.op) || s.in.op == Op::JUMP) s.in.a = blockAt[s.in.a];
+            }
+        }
+        return graph;
+    }
+
+    // `left op right` as Machine::evaluate computes it
+    inline double apply(const Program &program, const Instruction &in, const double left, const double right) {
+        switch (in.op) {
+            case Op::ADD: return left + right;
+            case Op::SUBTRACT: return left - right;
+            case Op::MULTIPLY: return left * right;
+            case Op::DIVIDE:
+                if (right == 0) throw std::runtime_error(program.strings[in.a]);
+                return left / right;
+            case Op::LESS: return left < right ? 1.0 : 0.0;
+            case Op::GREATER: return left > right ? 1.0 : 0.0;
+            case Op::LESS_EQUAL: return left <= right ? 1.0 : 0.0;
+            case Op::GREATER_EQUAL: return left >= right ? 1.0 : 0.0;
+            case Op::EQUAL: return left == right ? 1.0 : 0.0;
+            case Op::NOT_EQUAL: return left != right ? 1.0 : 0.0;
+            case Op::AND: return left != 0.0 && right != 0.0 ? 1.0 : 0.0;
+            case Op::OR: return left != 0.0 || right != 0.0 ? 1.0 : 0.0;
+            default: return 0.0;
+        }
+    }
+
+    // An expression without loads, throwing what Machine::evaluate would
+    inline double evaluate(const Program &program, const std::vector<Instruction> &code) {
+        std::vector<double> stack;
+        for (const Instruction &in : code) {
+            switch (in.op) {
+                case Op::NUMBER: stack.push_back(program.numbers[in.a]); break;
+                case Op::OPERAND: break;
+                case Op::ROUND_TRIP: stack.back() = std::stod(std::to_string(stack.back())); break;
+                default: {
+                    const double right = stack.back();
+                    stack.pop_back();
+                    stack.back() = apply(program, in, stack.back(), right);
+                }
+            }
+        }
+        return stack.back();
+    }
+
+    // An operand while folding an expression: a number known at compile time, or the code computing
+    // it. OPERAND marks stay in front of the code of the operand they announce.
+    struct Folded {
+        std::optional<double> number;
+        std::vector<Instruction> code;
+        std::vector<int> reads;
+    };
+
+    inline void materialize(Program &program, Folded &folded) {
+        if (!folded.number) return;
+        folded.code.push_back({Op::NUMBER, intern(program, *folded.number)});
+        folded.reads.push_back(-1);
+        folded.number.reset();
+    }
+
+    inline void append(Folded &to, Folded &&from) {
+        to.code.insert(to.code.end(), from.code.begin(), from.code.end());
+        to.reads.insert(to.reads.end(), from.reads.begin(), from.reads.end());
+    }
+
+    // Folds what is known of the expression of `s`, keeping the order of whatever is left to compute
+    inline uint64_t foldExpression(Graph &graph, Statement &s) {
+        Program &program = graph.program;
+        uint64_t changes = 0;
+        std::vector<Folded> stack;
+        std::vector<Instruction> marks;
+        const auto leaf = [&](Folded folded) {
+            folded.code.insert(folded.code.begin(), marks.begin(), marks.end());
+            folded.reads.insert(folded.reads.begin(), marks.size(), -1);
+            marks.clear();
+            stack.push_back(std::move(folded));
+        };
+
+        for (size_t i = 0; i < s.expression.size(); i++) {
+            Instruction in = s.expression[i];
+            switch (in.op) {
+                case Op::OPERAND:
+                    marks.push_back(in);
+                    break;
+                case Op::NUMBER:
+                    leaf({program.numbers[in.a], {}, {}});
+                    break;
+                case Op::FREE:
+                    leaf({std::nullopt, {in}, {-1}});
+                    break;
+                case Op::LOCAL:
+                case Op::LOCAL_OR_FREE: {
+                    int read = s.reads[i];
+                    if (const auto &known = graph.values[read].known) {
+                        std::optional<double> number;
+                        try {
+                            number = std::stod(*known);
+                        } catch (const std::exception &) {}
+                        if (number) {
+                            leaf({number, {}, {}});
+                            changes++;
+                            break;
+                        }
+                    }
+                    if (in.op == Op::LOCAL_OR_FREE) {
+                        if (const auto isDeclared = declared(graph, read)) {
+                            in = *isDeclared ? Instruction{Op::LOCAL, in.a} : Instruction{Op::FREE, -1, in.b};
+                            if (!*isDeclared) read = -1;
+                            changes++;
+                        }
+                    }
+                    leaf({std::nullopt, {in}, {read}});
+                    break;
+                }
+                case Op::ROUND_TRIP: {
+                    Folded &top = stack.back();
+                    if (top.number) {
+                        try {
+                            top.number = std::stod(std::to_string(*top.number));
+                            changes++;
+                            break;
+                        } catch (const std::exception &) {}
+                        materialize(program, top);
+                    }
+                    top.code.push_back(in);
+                    top.reads.push_back(-1);
+                    break;
+                }
+                default: {
+                    Folded right = std::move(stack.back());
+                    stack.pop_back();
+                    Folded &left = stack.back();
+                    if (left.number && right.number) {
+                        std::optional<double> result;
+                        try {
+                            result = apply(program, in, *left.number, *right.number);
+                        } catch (const std::exception &) {}
+                        if (result) {
+                            left.number = result;
+                            append(left, std::move(right));
+                            changes++;
+                            break;
+                        }
+                    }
+                    materialize(program, left);
+                    materialize(program, right);
+                    append(left, std::move(right));
+                    left.code.push_back(in);
+                    left.reads.push_back(-1);
+                }
+            }
+        }
+
+        Folded &result = stack.back();
+        materialize(program, result);
+        s.expression = std::move(result.code);
+        s.reads = std::move(result.reads);
+        return changes;
+    }
+
+    // Constant folding and propagation over every reachable statement
+    inline uint64_t fold(Graph &graph) {
+        Program &program = graph.program;
+        uint64_t changes = 0;
+        // Slot and free variable read by WRITE, RETURN_VARIABLE and call arguments, down to one of
+        // them when SSA knows whether the slot is declared by then
+        const auto settle = [&](int &slot, int &freeVar, int &read) {
+            if (slot < 0 || freeVar < 0 || read < 0) return;
+            const auto isDeclared = declared(graph, read);
+            if (!isDeclared) return;
+            if (*isDeclared) {
+                freeVar = -1;
+            } else {
+                slot = -1;
+                read = -1;
+            }
+            changes++;
+        };
+
+        for (Block &block : graph.blocks) {
+            if (!block.reachable) continue;
+            std::vector<Statement> kept;
+            for (Statement &s : block.statements) {
+                Instruction &in = s.in;
+                if (evaluates(in.op)) {
+                    changes += foldExpression(graph, s);
+                    if (std::ranges::none_of(s.expression, [](const Instruction &e) { return loads(e.op); })) {
+                        if (in.op == Op::DECLARE_ARITHMETIC) {
+                            std::string value;
+                            try {
+                                value = std::to_string(evaluate(program, s.expression));
+                            } catch (const std::exception &e) {
+                                value = "Error: " + std::string(e.what());
+                            }
+                            in = {Op::DECLARE, in.a, intern(program, value), in.c};
+                            s.expression.clear();
+                            s.reads.clear();
+                            graph.values[s.defines].kind = Value::Kind::DECLARE;
+                            graph.values[s.defines].known = value;
+                            changes++;
+                        } else {
+                            std::optional<double> result;
+                            try {
+                                result = evaluate(program, s.expression);
+                            } catch (const std::exception &) {} // Raised at run time
+                            if (result && in.op == Op::RETURN_ARITHMETIC) {
+                                in = {Op::RETURN_CONSTANT, -1, intern(program, std::to_string(*result))};
+                                s.expression.clear();
+                                s.reads.clear();
+                                changes++;
+                            } else if (result && in.op == Op::DECLARE_RESULT) {
+                                const std::string value = std::to_string(*result);
+                                in = {Op::DECLARE, in.a, intern(program, value), intern(program, "any")};
+                                s.expression.clear();
+                                s.reads.clear();
+                                graph.values[s.defines].kind = Value::Kind::DECLARE;
+                                graph.values[s.defines].known = value;
+                                changes++;
+                            } else if (result && branches(in.op)) {
+                                changes++;
+                                if ((*result != 0.0) != (in.op == Op::BRANCH_IF)) continue; // Always falls through
+                                in = {Op::JUMP, in.a};
+                                s.expression.clear();
+                                s.reads.clear();
+                            }
+                        }
+                    }
+                } else if (in.op == Op::COPY && graph.values[s.defines].known) {
+                    in = {Op::DECLARE, in.a, intern(program, *graph.values[s.defines].known), in.c};
+                    s.read = -1;
+                    graph.values[s.defines].kind = Value::Kind::DECLARE;
+                    graph.values[s.defines].inputs.clear();
+                    changes++;
+                } else if (in.op == Op::RETURN_VARIABLE && s.read >= 0 && graph.values[s.read].known) {
+                    in = {Op::RETURN_CONSTANT, -1, intern(program, *graph.values[s.read].known)};
+                    s.read = -1;
+                    changes++;
+                } else if (in.op == Op::WRITE || in.op == Op::RETURN_VARIABLE) {
+                    settle(in.a, in.b, s.read);
+                } else if (passes(in.op)) {
+                    auto &arguments = program.calls[in.b].arguments;
+                    for (size_t i = 0; i < arguments.size(); i++) settle(arguments[i].slot, arguments[i].free, s.arguments[i]);
+                }
+                kept.push_back(std::move(s));
+            }
+            block.statements = std::move(kept);
+        }
+        return changes;
+    }
+
+    // Drops unreachable blocks and declarations whose Value is never read
+    inline uint64_t eliminate(Graph &graph) {
+        uint64_t removed = 0;
+        for (Block &block : graph.blocks) {
+            if (block.reachable) continue;
+            removed += block.statements.size();
+            block.statements.clear();
+        }
+
+        while (true) {
+            std::vector<bool> live(graph.values.size(), false);
+            std::vector<int> work;
+            const auto use = [&](const int v) {
+                if (v < 0 || live[v]) return;
+                live[v] = true;
+                work.push_back(v);
+            };
+            for (const Block &block : graph.blocks) {
+                for (const Statement &s : block.statements) {
+                    for (const int v : s.reads) use(v);
+                    for (const int v : s.arguments) use(v);
+                    use(s.read);
+                }
+            }
+            if (graph.topLevel) {
+                for (const int v : graph.exits) {
+                    if (static_cast<size_t>(graph.values[v].slot) < graph.program.named) use(v); // Locals of inlined calls aren't kept
+                }
+            }
+            while (!work.empty()) {
+                const int v = work.back();
+                work.pop_back();
+                if (graph.values[v].kind == Value::Kind::PHI) {
+                    for (const int input : graph.values[v].inputs) use(input);
+                }
+            }
+
+            // Whether a call may still run once block b starts
+            std::vector<bool> callFrom(graph.blocks.size() + 1, false);
+            for (int b = static_cast<int>(graph.blocks.size()) - 1; b >= 0; b--) {
+                bool any = std::ranges::any_of(graph.blocks[b].statements, [](const Statement &s) { return calls(s.in.op); });
+                for (const int next : successors(graph, b)) any = any || callFrom[next];
+                callFrom[b] = any;
+            }
+
+            uint64_t round = 0;
+            for (int b = 0; b < static_cast<int>(graph.blocks.size()); b++) {
+                auto &statements = graph.blocks[b].statements;
+                bool exposed = false; // A callee could read the slot
+                for (const int next : successors(graph, b)) exposed = exposed || callFrom[next];
+                std::vector<bool> dead(statements.size(), false);
+                for (size_t i = statements.size(); i-- > 0;) {
+                    const Statement &s = statements[i];
+                    const bool pure = s.in.op == Op::DECLARE || s.in.op == Op::DECLARE_ARITHMETIC || s.in.op == Op::COPY || s.in.op == Op::ARGUMENT;
+                    dead[i] = pure && !exposed && !live[s.defines];
+                    exposed = exposed || calls(s.in.op);
+                }
+                std::vector<Statement> kept;
+                for (size_t i = 0; i < statements.size(); i++) {
+                    if (dead[i]) {
+                        round++;
+                    } else {
+                        kept.push_back(std::move(statements[i]));
+                    }
+                }
+                statements = std::move(kept);
+            }
+            removed += round;
+            if (round == 0) return removed;
+        }
+    }
+
+    // `s`'s expression with each load replaced by the Value it reads, the same for two expressions
+    // that always compute the same
+    inline std::string signature(const Graph &graph, const Statement &s) {
+        std::string key;
+        for (size_t i = 0; i < s.expression.size(); i++) {
+            const Instruction &in = s.expression[i];
+            key += std::to_string(static_cast<int>(in.op));
+            switch (in.op) {
+                case Op::NUMBER: key += ":" + std::to_string(std::bit_cast<uint64_t>(graph.program.numbers[in.a])); break;
+                case Op::LOCAL: key += ":" + std::to_string(s.reads[i]); break;
+                case Op::FREE: key += ":" + std::to_string(in.b); break;
+                case Op::LOCAL_OR_FREE: key += ":" + std::to_string(s.reads[i]) + ":" + std::to_string(in.b); break;
+                case Op::DIVIDE: {
+                    const std::string &message = graph.program.strings[in.a]; // Part of the result when it fails
+                    key += ":" + std::to_string(message.size()) + ":" + message;
+                    break;
+                }
+                default: break;
+            }
+            key += ",";
+        }
+        return key;
+    }
+
+    // Common-subexpression elimination: an arithmetic declaration of what a dominating one computed,
+    // still held by its slot, copies that slot instead
+    inline uint64_t eliminateCommon(Graph &graph) {
+        const auto &blocks = graph.blocks;
+        std::vector<int> idom(blocks.size(), -1);
+        const auto intersect = [&idom](int a, int b) {
+            while (a != b) {
+                while (a > b) a = idom[a];
+                while (b > a) b = idom[b];
+            }
+            return a;
+        };
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (!blocks[b].reachable) continue;
+            if (b == 0) {
+                idom[b] = 0;
+                continue;
+            }
+            int dominator = -1;
+            for (const int p : blocks[b].predecessors) dominator = dominator < 0 ? p : intersect(dominator, p);
+            idom[b] = dominator;
+        }
+        const auto dominates = [&idom](const int a, int b) {
+            while (b > a) b = idom[b];
+            return a == b;
+        };
+
+        struct Available {
+            int block;
+            int value;
+            int slot;
+        };
+        std::unordered_map<std::string, std::vector<Available>> available;
+        uint64_t changes = 0;
+        for (size_t b = 0; b < graph.blocks.size(); b++) {
+            if (!graph.blocks[b].reachable) continue;
+            for (Statement &s : graph.blocks[b].statements) {
+                if (s.in.op != Op::DECLARE_ARITHMETIC) continue;
+                auto &candidates = available[signature(graph, s)];
+                const auto it = std::ranges::find_if(candidates, [&](const Available &c) {
+                    return dominates(c.block, static_cast<int>(b)) && s.before[c.slot] == c.value;
+                });
+                if (it == candidates.end()) {
+                    candidates.push_back({static_cast<int>(b), s.defines, s.in.a});
+                    continue;
+                }
+                s.in = {Op::COPY, s.in.a, it->slot, s.in.c};
+                s.expression.clear();
+                s.reads.clear();
+                s.read = it->value;
+                changes++;
+            }
+        }
+        return changes;
+    }
+
+    // Copy propagation: what reads a copy reads the Value it was copied from, while its slot holds it
+    inline uint64_t propagateCopies(Graph &graph) {
+        const auto original = [&graph](int v, const std::vector<int> &before) {
+            int found = v;
+            while (graph.values[v].kind == Value::Kind::COPY) {
+                v = graph.values[v].inputs[0];
+                if (before[graph.values[v].slot] == v) found = v;
+            }
+            return found;
+        };
+
+        uint64_t changes = 0;
+        for (Block &block : graph.blocks) {
+            if (!block.reachable) continue;
+            for (Statement &s : block.statements) {
+                for (size_t i = 0; i < s.expression.size(); i++) {
+                    if (s.reads[i] < 0) continue;
+                    if (const int root = original(s.reads[i], s.before); root != s.reads[i]) {
+                        s.expression[i] = {Op::LOCAL, graph.values[root].slot};
+                        s.reads[i] = root;
+                        changes++;
+                    }
+                }
+                if (s.read < 0 || (s.in.op != Op::WRITE && s.in.op != Op::RETURN_VARIABLE && s.in.op != Op::COPY)) continue;
+                if (const int root = original(s.read, s.before); root != s.read) {
+                    if (s.in.op == Op::COPY) {
+                        s.in.b = graph.values[root].slot;
+                    } else {
+                        s.in.a = graph.values[root].slot;
+                        s.in.b = -1;
+                    }
+                    s.read = root;
+                    changes++;
+                }
+            }
+        }
+        return changes;
+    }
+
+    // Lay the reachable blocks out again as `graph.program`'s code
+    inline void lower(Graph &graph) {
+        Program &program = graph.program;
+
+        // Then-blocks save only the slots still declared inside them, and none at all when there
+        // are none or when they always return
+        std::vector<Statement*> order;
+        for (Block &block : graph.blocks) {
+            if (!block.reachable) continue;
+            for (Statement &s : block.statements) order.push_back(&s);
+        }
+        std::vector<int> enter(program.blocks.size(), -1), leave(program.blocks.size(), -1);
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i]->in.op == Op::ENTER) enter[order[i]->in.a] = static_cast<int>(i);
+            if (order[i]->in.op == Op::LEAVE) leave[order[i]->in.a] = static_cast<int>(i);
+        }
+        std::unordered_set<const Statement*> dropped;
+        for (size_t a = 0; a < program.blocks.size(); a++) {
+            if (enter[a] < 0 || leave[a] < 0) {
+                if (enter[a] >= 0) dropped.insert(order[enter[a]]);
+                continue;
+            }
+            std::set<int> slots;
+            for (int i = enter[a] + 1; i < leave[a]; i++) {
+                if (declares(order[i]->in.op)) slots.insert(order[i]->in.a);
+            }
+            if (slots.empty()) {
+                dropped.insert(order[enter[a]]);
+                dropped.insert(order[leave[a]]);
+            } else {
+                program.blocks[a].assign(slots.begin(), slots.end());
+            }
+        }
+
+        // Sizes from the last block back, a jump to where control would go anyway is dropped
+        const size_t count = graph.blocks.size();
+        std::vector<size_t> sizes(count, 0);
+        for (size_t b = count; b-- > 0;) {
+            const Block &block = graph.blocks[b];
+            if (!block.reachable) continue;
+            for (const Statement &s : block.statements) {
+                if (!dropped.contains(&s)) sizes[b]++;
+            }
+            if (!block.statements.empty() && block.statements.back().in.op == Op::JUMP) {
+                const Statement &jump = block.statements.back();
+                bool adjacent = true;
+                for (int between = static_cast<int>(b) + 1; between < jump.in.a; between++) adjacent = adjacent && sizes[between] == 0;
+                if (adjacent) {
+                    dropped.insert(&jump);
+                    sizes[b]--;
+                }
+            }
+        }
+        std::vector<int> start(count + 1, 0);
+        for (size_t b = 0; b < count; b++) start[b + 1] = start[b] + static_cast<int>(sizes[b]);
+
+        std::vector<Instruction> code;
+        std::vector<std::vector<Instruction>> expressions;
+        std::vector<size_t> origins;
+        for (const Block &block : graph.blocks) {
+            if (!block.reachable) continue;
+            for (const Statement &s : block.statements) {
+                if (dropped.contains(&s)) continue;
+                Instruction in = s.in;
+                if (evaluates(in.op)) {
+                    in.b = static_cast<int>(expressions.size());
+                    expressions.push_back(s.expression);
+                    origins.push_back(s.origin);
+                }
+                if (branches(in.op) || in.op == Op::JUMP) in.a = start[in.a];
+                code.push_back(in);
+            }
+        }
+        program.code = std::move(code);
+        program.expressions = std::move(expressions);
+        program.origins = std::move(origins);
+    }
+
+    // The graph as text, for --dump-ir
+    inline std::string print(const Graph &graph, const std::string &name, const int level) {
+        const Program &program = graph.program;
+        const auto value = [&](const int v) {
+            if (v < 0) return std::string("?");
+            const Value &val = graph.values[v];
+            if (val.kind == Value::Kind::UNDECLARED) return std::string("undef");
+            return "%" + program.slotNames[val.slot] + "." + std::to_string(v);
+        };
+        const auto freeName = [&](const int f) {
+            std::string path = "@";
+            for (size_t i = 0; i < program.frees[f].path.size(); i++) path += (i == 0 ? "" : "::") + program.frees[f].path[i];
+            return path;
+        };
+        const auto variable = [&](const int slot, const int freeVar, const int read) {
+            if (slot < 0) return freeName(freeVar);
+            return freeVar < 0 ? value(read) : value(read) + "|" + freeName(freeVar);
+        };
+        const auto expression = [&](const Statement &s) {
+            static const std::unordered_map<Op, std::string> symbols = {
+                {Op::ADD, "+"}, {Op::SUBTRACT, "-"}, {Op::MULTIPLY, "*"}, {Op::DIVIDE, "/"}, {Op::LESS, "<"}, {Op::GREATER, ">"},
+                {Op::LESS_EQUAL, "<="}, {Op::GREATER_EQUAL, ">="}, {Op::EQUAL, "=="}, {Op::NOT_EQUAL, "!="}, {Op::AND, "&&"}, {Op::OR, "||"},
+            };
+            std::vector<std::string> stack;
+            for (size_t i = 0; i < s.expression.size(); i++) {
+                const Instruction &in = s.expression[i];
+                switch (in.op) {
+                    case Op::NUMBER: {
+                        std::ostringstream number;
+                        number << program.numbers[in.a];
+                        stack.push_back(number.str());
+                        break;
+                    }
+                    case Op::LOCAL: stack.push_back(value(s.reads[i])); break;
+                    case Op::FREE: stack.push_back(freeName(in.b)); break;
+                    case Op::LOCAL_OR_FREE: stack.push_back(value(s.reads[i]) + "|" + freeName(in.b)); break;
+                    case Op::OPERAND: break;
+                    case Op::ROUND_TRIP: stack.back() = "str(" + stack.back() + ")"; break;
+                    default: {
+                        const std::string right = stack.back();
+                        stack.pop_back();
+                        stack.back() = "(" + stack.back() + " " + symbols.at(in.op) + " " + right + ")";
+                    }
+                }
+            }
+            return stack.empty() ? std::string() : stack.back();
+        };
+        const auto call = [&](const Statement &s) {
+            const tiering::CallSite &site = program.calls[s.in.b];
+            std::string text = "call " + freeName(site.callee).substr(1) + "(";
+            for (size_t i = 0; i < site.arguments.size(); i++) {
+                const auto &argument = site.arguments[i];
+                if (i != 0) text += ", ";
+                text += argument.constant ? "\"" + argument.constant->value + "\"" : variable(argument.slot, argument.free, s.arguments[i]);
+            }
+            return text + ")";
+        };
+
+        std::ostringstream out;
+        out << "ir " << name << " -O" << level << "\n";
+        for (size_t b = 0; b < graph.blocks.size(); b++) {
+            const Block &block = graph.blocks[b];
+            if (!block.reachable) continue;
+            out << "b" << b << ":";
+            for (size_t i = 0; i < block.predecessors.size(); i++) out << (i == 0 ? " ; from b" : ", b") << block.predecessors[i];
+            out << "\n";
+            for (const int phi : block.phis) {
+                out << "    " << value(phi) << " = phi [";
+                const auto &inputs = graph.values[phi].inputs;
+                for (size_t i = 0; i < inputs.size(); i++) out << (i == 0 ? "b" : ", b") << block.predecessors[i] << " " << value(inputs[i]);
+                out << "]\n";
+            }
+            for (const Statement &s : block.statements) {
+                const Instruction &in = s.in;
+                const std::string defined = s.defines >= 0 ? value(s.defines) + " = " : "";
+                out << "    " << defined;
+                switch (in.op) {
+                    case Op::TRACE: out << "trace \"" << program.strings[in.a] << "\"" << (in.b > 1 ? " x" + std::to_string(in.b) : ""); break;
+                    case Op::DECLARE: out << program.strings[in.c] << " \"" << program.strings[in.b] << "\""; break;
+                    case Op::DECLARE_ARITHMETIC: out << program.strings[in.c] << " " << expression(s); break;
+                    case Op::DECLARE_CALL: out << program.strings[in.c] << " " << call(s); break;
+                    case Op::COPY: out << program.strings[in.c] << " copy " << value(s.read); break;
+                    case Op::CHECK: out << "check " << call(s); break;
+                    case Op::ARGUMENT: {
+                        const auto &argument = program.calls[in.b].arguments[in.c];
+                        out << "argument " << (argument.constant ? "\"" + argument.constant->value + "\"" : variable(argument.slot, argument.free, s.read));
+                        break;
+                    }
+                    case Op::DECLARE_RESULT: out << "result " << expression(s); break;
+                    case Op::CALL: out << call(s); break;
+                    case Op::WRITE: out << "writescr " << variable(in.a, in.b, s.read); break;
+                    case Op::RETURN: out << "return"; break;
+                    case Op::RETURN_CONSTANT: out << "return \"" << program.strings[in.b] << "\""; break;
+                    case Op::RETURN_VARIABLE: out << "return " << variable(in.a, in.b, s.read); break;
+                    case Op::RETURN_ARITHMETIC: out << "return " << expression(s); break;
+                    case Op::RETURN_CALL: out << "return " << call(s); break;
+                    case Op::BRANCH: out << "branch " << expression(s) << " else b" << in.a; break;
+                    case Op::BRANCH_IF: out << "branch " << expression(s) << " to b" << in.a; break;
+                    case Op::JUMP: out << "jump b" << in.a; break;
+                    case Op::ENTER:
+                    case Op::LEAVE: {
+                        out << (in.op == Op::ENTER ? "enter" : "leave") << " [";
+                        const auto &slots = program.blocks[in.a];
+                        for (size_t i = 0; i < slots.size(); i++) out << (i == 0 ? "" : ", ") << program.slotNames[slots[i]];
+                        out << "]";
+                        break;
+                    }
+                    default: break;
+                }
+                out << "\n";
+            }
+        }
+        return out.str();
+    }
+
+    inline void record(const Pass pass, const std::chrono::steady_clock::time_point started, const uint64_t changes) {
+        Statistics &totals = statistics();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+        totals.nanoseconds[static_cast<size_t>(pass)] += static_cast<uint64_t>(elapsed.count());
+        totals.changes[static_cast<size_t>(pass)] += changes;
+    }
+
+    // Run the passes of -O`level` over `program` and lower the result back into it. -O0 only builds
+    // the IR, for --dump-ir. Slots of a `topLevel` program are read once it ends.
+    inline void optimize(Program &program, const std::string &name, const int level, const bool dump, const bool topLevel = false) {
+        if (level <= 0 && !dump) return;
+        const size_t before = tiering::instructions(program);
+        auto started = std::chrono::steady_clock::now();
+        Graph graph = build(program, topLevel);
+        if (graph.valid) analyze(graph);
+        record(Pass::BUILD, started, 0);
+        if (!graph.valid) return;
+
+        // Each pass leaves the graph analyzed for the next one
+        const auto run = [&graph](const Pass pass, const auto &body) {
+            const auto started = std::chrono::steady_clock::now();
+            const uint64_t changes = body();
+            analyze(graph);
+            record(pass, started, changes);
+            return graph.valid;
+        };
+        const auto folded = [&graph] {
+            uint64_t total = 0;
+            for (int round = 0; round < MAX_FOLD_ROUNDS && graph.valid; round++) {
+                const uint64_t changes = fold(graph);
+                total += changes;
+                if (changes == 0) break;
+                analyze(graph);
+            }
+            return total;
+        };
+        if (level >= 1 && !(run(Pass::FOLD, folded) && run(Pass::DCE, [&graph] { return eliminate(graph); }))) return;
+        if (level >= 2 && !(run(Pass::CSE, [&graph] { return eliminateCommon(graph); }) &&
+                            run(Pass::COPIES, [&graph] { return propagateCopies(graph); }) &&
+                            run(Pass::DCE, [&graph] { return eliminate(graph); }))) return;
+
+        if (dump) std::cerr << print(graph, name, level) << std::flush;
+        if (level >= 1) {
+            started = std::chrono::steady_clock::now();
+            lower(graph);
+            record(Pass::LOWER, started, 0);
+        }
+        Statistics &totals = statistics();
+        totals.programs++;
+        totals.before += before;
+        totals.after += tiering::instructions(program);
+    }
+
+    // --time-passes, once the program is done
+    inline void report(std::ostream &out) {
+        const Statistics &totals = statistics();
+        std::ostringstream text;
+        text << "ir: " << totals.programs << " program(s), " << totals.before << " -> " << totals.after << " instructions\n";
+        for (size_t i = 0; i < PASS_NAMES.size(); i++) {
+            const std::string name = PASS_NAMES[i];
+            text << "  " << name << std::string(8 - name.size(), ' ') << totals.nanoseconds[i] / 1000 << "us";
+            if (i != static_cast<size_t>(Pass::BUILD) && i != static_cast<size_t>(Pass::LOWER)) text << ", " << totals.changes[i] << " change(s)";
+            text << "\n";
+        }
+        out << text.str() << std::flush;
+    }
+}
@@ -0,0 +1,1604 @@
+#pragma once
+
+// Tiered execution of hot functions.
+//
+// Every call is counted on the function's Profile. Once a function has been called
+// --tier-threshold times it is queued for a background compiler thread, which translates the body
+// to bytecode: locals live in numbered slots of a frame instead of a copied symbol table,
+// expressions are parsed once into stack code, and every load is specialized by where the name
+// lives. The Program is published on the Profile and picked up by the next call; calls already
+// running carry on interpreting. A body using anything the compiler doesn't handle stays
+// interpreted. With --jit its expressions are also assembled to native code, see jit.h.
+// Expressions whose operands keep reading as numbers are quickened, see quicken.h. Functions a
+// --profile-in profile has as hot are compiled on their first call, see pgo.h.
+//
+// Calls keep their dynamic scoping: a name the callee doesn't declare is looked up through the
+// frames of its callers, down to the symbol table of the interpreted code that started the chain.
+// The compiler relies on what those names were when the function got hot (a variable, a function,
+// a namespace member). That is checked on entry, and a call that finds something else runs
+// interpreted instead.
+//
+// From -O1 on, calls of small functions are inlined: the callee's body is compiled into the
+// caller's program, its locals in slots of their own. It reads the caller's variables like the
+// call would have, and its errors are still reported at its own tokens. The caller only runs
+// compiled while the name still refers to the function that was inlined. Calls whose argument types
+// are known to fit the callee are checked when compiled, with the callee pinned the same way;
+// functions with `any` parameters get programs for the argument types they are called with, see
+// specialize.h.
+namespace tiering {
+    using Table = std::unordered_map<std::string, SymbolInfo>;
+
+    struct Frame;
+
+    // Where a function looks up the names it doesn't declare
+    struct Scope {
+        const Frame* frame = nullptr; // Innermost compiled caller, whose callers follow
+        const Table* table = nullptr; // Symbol table of the interpreted code below them
+    };
+
+    // A name resolved in a scope
+    struct Binding {
+        const Variable* variable = nullptr; // Set for variables, also the locals of compiled frames
+        const SymbolInfo* symbol = nullptr; // Set for entries of a symbol table
+
+        [[nodiscard]] Kind kind() const {
+            if (variable != nullptr) return Kind::VARIABLE;
+            if (symbol == nullptr) return Kind::ABSENT;
+            return std::holds_alternative<Function>(*symbol) ? Kind::FUNCTION : Kind::NAMESPACE;
+        }
+    };
+
+    struct Frame {
+        const Program &program;
+        std::vector<std::optional<Variable>> slots;
+        std::vector<Binding> frees; // Resolved on entry
+        Scope parent;
+    };
+
+    inline Binding lookup(const Scope &scope, const std::string &name) {
+        for (const Frame* frame = scope.frame; frame != nullptr; frame = frame->parent.frame) {
+            if (const auto it = frame->program.slots.find(name); it != frame->program.slots.end() && frame->slots[it->second]) {
+                return {&*frame->slots[it->second], nullptr};
+            }
+        }
+        if (scope.table != nullptr) {
+            if (const auto it = scope.table->find(name); it != scope.table->end()) {
+                return {std::get_if<Variable>(&it->second), &it->second};
+            }
+        }
+        return {};
+    }
+
+    // `path[0]::path[1]::...`
+    inline Binding resolve(const Scope &scope, const std::vector<std::string> &path) {
+        Binding binding = lookup(scope, path[0]);
+        for (size_t i = 1; i < path.size(); i++) {
+            if (binding.kind() != Kind::NAMESPACE) return {};
+            const auto &members = *std::get<Namespace>(*binding.symbol).symbols;
+            const auto it = members.find(path[i]);
+            if (it == members.end()) return {};
+            binding = {std::get_if<Variable>(&it->second), &it->second};
+        }
+        return binding;
+    }
+
+    inline std::string key(const std::vector<std::string> &path) {
+        std::string joined = path[0];
+        for (size_t i = 1; i < path.size(); i++) {
+            joined += "::" + path[i];
+        }
+        return joined;
+    }
+
+    // The path key() joined
+    inline std::vector<std::string> split(const std::string &name) {
+        std::vector<std::string> path;
+        for (size_t at = 0;;) {
+            const size_t separator = name.find("::", at);
+            path.push_back(name.substr(at, separator - at));
+            if (separator == std::string::npos) break;
+            at = separator + 2;
+        }
+        return path;
+    }
+
+    // Whether `binding` is what `free` was compiled against
+    inline bool matches(const Binding &binding, const Free &free) {
+        if (binding.kind() != free.kind) return false;
+        return free.body == nullptr || std::get<Function>(*binding.symbol).body == free.body;
+    }
+
+    // The symbol table an interpreted callee would have been handed
+    inline Table materialize(const Scope &scope) {
+        Table table = scope.table != nullptr ? *scope.table : Table{};
+        std::vector<const Frame*> chain;
+        for (const Frame* frame = scope.frame; frame != nullptr; frame = frame->parent.frame) {
+            chain.push_back(frame);
+        }
+        for (const Frame* frame : chain | std::views::reverse) {
+            for (size_t i = 0; i < frame->program.named; i++) {
+                if (frame->slots[i]) table[frame->program.slotNames[i]] = *frame->slots[i];
+            }
+        }
+        return table;
+    }
+
+    // What every name and `ns::member` chain in tokens [begin, end) refers to from `scope`
+    inline std::unordered_map<std::string, Kind> survey(const std::vector<Token> &tokens, const size_t begin, const size_t end, const Scope &scope) {
+        std::unordered_map<std::string, Kind> kinds;
+        for (size_t i = begin; i < end && i < tokens.size(); i++) {
+            if (tokens[i].type != TokenType::IDENTIFIER) continue;
+            std::vector<std::string> path = {tokens[i].value};
+            kinds.try_emplace(path[0], lookup(scope, path[0]).kind());
+            for (size_t j = i + 1; j + 1 < tokens.size() && tokens[j].value == "::"; j += 2) {
+                path.push_back(tokens[j + 1].value);
+                kinds.try_emplace(key(path), resolve(scope, path).kind());
+            }
+        }
+        return kinds;
+    }
+
+    // ... in the body of `func`
+    inline std::unordered_map<std::string, Kind> survey(const Function &func, const Scope &scope) {
+        return survey(*func.body, 0, func.body->size(), scope);
+    }
+
+    // Functions calls may be inlined into their callers, by the name they are called with
+    using Callees = std::unordered_map<std::string, Function>;
+
+    constexpr size_t MAX_INLINE_TOKENS = 64;       // Longer bodies are never inlined
+    constexpr int MAX_INLINE_DEPTH = 3;            // Inlined into an inlined body, and so on
+    constexpr size_t INLINE_CALL_COST = 10;        // What a call costs, in instructions of the body replacing it
+    constexpr size_t INLINE_CONSTANT_BONUS = 4;    // Per constant argument, which the optimizer can fold in
+    constexpr size_t MAX_INLINED_INSTRUCTIONS = 256; // Per program
+
+    // The functions short enough to be inlined that `kinds` (a survey from `scope`) calls, and the
+    // ones their bodies call in turn. Their bodies are surveyed into `kinds` on the way: an inlined
+    // body looks names up from its caller's scope, like the call would have.
+    inline Callees inlinable(std::unordered_map<std::string, Kind> &kinds, const Scope &scope) {
+        Callees callees;
+        std::vector<std::string> names;
+        for (const auto &[name, kind] : kinds) {
+            if (kind == Kind::FUNCTION) names.push_back(name);
+        }
+        for (int depth = 0; depth < MAX_INLINE_DEPTH && !names.empty(); depth++) {
+            std::vector<std::string> next;
+            for (const auto &name : names) {
+                const Binding binding = resolve(scope, split(name));
+                if (binding.kind() != Kind::FUNCTION || callees.contains(name)) continue;
+                const Function &callee = std::get<Function>(*binding.symbol);
+                if (callee.body->size() > MAX_INLINE_TOKENS) continue;
+                callees.emplace(name, callee);
+                for (const auto &[found, kind] : survey(callee, scope)) {
+                    if (kinds.try_emplace(found, kind).second && kind == Kind::FUNCTION) next.push_back(found);
+                }
+            }
+            names = std::move(next);
+        }
+        return callees;
+    }
+
+    // Every function `kinds` (a survey from `scope`) has as one, whose parameters the arguments of
+    // calls to it are checked against when compiled
+    inline Callees signatures(const std::unordered_map<std::string, Kind> &kinds, const Scope &scope) {
+        Callees found;
+        for (const auto &[name, kind] : kinds) {
+            if (kind != Kind::FUNCTION) continue;
+            if (const Binding binding = resolve(scope, split(name)); binding.kind() == Kind::FUNCTION) {
+                found.emplace(name, std::get<Function>(*binding.symbol));
+            }
+        }
+        return found;
+    }
+
+    // Thrown while compiling a body that has to stay interpreted
+    struct Unsupported {
+        std::string reason;
+    };
+
+    // Translates one function body. It follows what Parser does with the same tokens, including
+    // the debug traces it prints, so switching tiers changes nothing but the speed.
+    class Compiler {
+    private:
+        const Function &func;
+        const std::vector<Token> &tokens;
+        const std::vector<Token> &unfilteredTokens;
+        const std::unordered_map<std::string, Kind> &kinds;
+        const size_t first; // The statements compiled are tokens [first, last)
+        const size_t last;
+        const bool topLevel; // Top-level statements rather than a function body
+        const Callees* callees; // Calls to these may be inlined
+        const pgo::Record* record; // What --profile-in has on the function, if anything
+        const Callees* signatures; // Calls to these get their argument types checked here when they can be
+        const std::vector<std::string> parameterTypes; // Of the arguments of the calls compiled for, empty for any call
+        std::vector<const std::vector<Token>*> chain; // Bodies this one is being inlined into, never inlined again
+        std::shared_ptr<Program> program = std::make_shared<Program>();
+        std::vector<bool> declared; // Slots certainly declared at the current point
+        std::vector<std::string> slotTypes; // Type of the named slots at the current point, empty when it isn't known
+        std::unordered_map<std::string, int> freeIndex;
+        std::unordered_map<std::string, std::shared_ptr<const Program>> inlineable; // Compiled callees, nullptr for those that can't be inlined
+        size_t inlined = 0; // Instructions inlined so far
+        std::unordered_map<std::string, int> hiddenSlots; // Kept out of program->slots, which frames are searched by
+        const std::vector<std::string> types = {"int", "float", "double", "char", "string", "bool", "void", "any"};
+
+        // Lookahead past the end reads the terminating eof
+        [[nodiscard]] const Token& at(const size_t pos) const {
+            return pos < tokens.size() ? tokens[pos] : tokens.back();
+        }
+
+        [[noreturn]] static void unsupported(const std::string &reason) {
+            throw Unsupported{reason};
+        }
+
+        void expect(const size_t pos, const std::string &value) const {
+            if (at(pos).value != value) unsupported("expected '" + value + "' at line " + std::to_string(at(pos).line));
+        }
+
+        int intern(const std::string &value) {
+            program->strings.push_back(value);
+            return static_cast<int>(program->strings.size() - 1);
+        }
+
+        int free(const std::vector<std::string> &path, const Kind kind) {
+            const std::string name = key(path);
+            const auto it = kinds.find(name);
+            if (it == kinds.end() || it->second != kind) unsupported("'" + name + "' changes meaning between calls");
+            if (const auto known = freeIndex.find(name); known != freeIndex.end()) return known->second;
+            program->frees.push_back({path, kind, nullptr});
+            return freeIndex[name] = static_cast<int>(program->frees.size() - 1);
+        }
+
+        // What `name` is at this point of the body
+        Kind kindOf(const std::string &name) {
+            if (const auto it = program->slots.find(name); it != program->slots.end()) {
+                if (!declared[it->second]) free({name}, Kind::VARIABLE); // Until it is declared, the caller's
+                return Kind::VARIABLE;
+            }
+            const auto it = kinds.find(name);
+            return it == kinds.end() ? Kind::ABSENT : it->second;
+        }
+
+        // Slot and free variable to read `name` from
+        std::pair<int, int> variable(const std::string &name) {
+            if (kindOf(name) != Kind::VARIABLE) unsupported("'" + name + "' is not a variable");
+            const auto it = program->slots.find(name);
+            if (it == program->slots.end()) return {-1, free({name}, Kind::VARIABLE)};
+            if (declared[it->second]) return {it->second, -1};
+            return {it->second, free({name}, Kind::VARIABLE)};
+        }
+
+        void load(std::vector<Instruction> &code, const std::string &name) {
+            const auto [slot, freeVar] = variable(name);
+            code.push_back({slot < 0 ? Op::FREE : freeVar < 0 ? Op::LOCAL : Op::LOCAL_OR_FREE, slot, freeVar});
+        }
+
+        // RecursiveDescentParser's grammar, from `pos` up to at most `end`
+        size_t expression(std::vector<Instruction> &code, size_t pos, const size_t end) {
+            pos = term(code, pos, end);
+            while (pos < end && (at(pos).value == "+" || at(pos).value == "-")) {
+                const Op op = at(pos).value == "+" ? Op::ADD : Op::SUBTRACT;
+                pos = term(code, pos + 1, end);
+                code.push_back({op});
+            }
+            return pos;
+        }
+
+        size_t term(std::vector<Instruction> &code, size_t pos, const size_t end) {
+            pos = factor(code, pos, end);
+            while (pos < end && (at(pos).value == "*" || at(pos).value == "/")) {
+                if (at(pos).value == "*") {
+                    pos = factor(code, pos + 1, end);
+                    code.push_back({Op::MULTIPLY});
+                } else {
+                    pos = factor(code, pos + 1, end);
+                    const Token &last = tokens[pos - 1]; // Where the interpreter reports it
+                    code.push_back({Op::DIVIDE, intern("Division by zero at line " + std::to_string(last.line) + ":" + std::to_string(last.column))});
+                }
+            }
+            return pos;
+        }
+
+        size_t factor(std::vector<Instruction> &code, size_t pos, const size_t end) {
+            if (pos >= end) unsupported("incomplete expression");
+            const Token &token = at(pos);
+            if (token.type == TokenType::NUMBER) {
+                try {
+                    program->numbers.push_back(std::stod(token.value));
+                } catch (const std::exception &) {
+                    unsupported("number '" + token.value + "'");
+                }
+                code.push_back({Op::NUMBER, static_cast<int>(program->numbers.size() - 1)});
+                return pos + 1;
+            }
+            if (token.value == "(") {
+                pos = expression(code, pos + 1, end);
+                if (pos >= end || at(pos).value != ")") unsupported("unbalanced parentheses");
+                return pos + 1;
+            }
+            if (token.type != TokenType::IDENTIFIER) unsupported("'" + token.value + "' in an expression");
+            load(code, token.value);
+            return pos + 1;
+        }
+
+        // An expression of the program, starting at token `origin`
+        int add(std::vector<Instruction> code, const size_t origin) {
+            program->expressions.push_back(std::move(code));
+            program->origins.push_back(origin);
+            return static_cast<int>(program->expressions.size() - 1);
+        }
+
+        // ConditionParser's grammar over [begin, end)
+        int condition(const size_t begin, const size_t end) {
+            std::vector<Instruction> code;
+            if (logical(code, begin, end, 0) != end) unsupported("condition with trailing tokens");
+            return add(std::move(code), begin);
+        }
+
+        // The operator `value` is at precedence `level`, from loosest: ||, &&, equality, relational
+        static std::optional<Op> binary(const int level, const std::string &value) {
+            switch (level) {
+                case 0: if (value == "||") return Op::OR; break;
+                case 1: if (value == "&&") return Op::AND; break;
+                case 2:
+                    if (value == "==") return Op::EQUAL;
+                    if (value == "!=") return Op::NOT_EQUAL;
+                    break;
+                default:
+                    if (value == "<") return Op::LESS;
+                    if (value == ">") return Op::GREATER;
+                    if (value == "<=") return Op::LESS_EQUAL;
+                    if (value == ">=") return Op::GREATER_EQUAL;
+            }
+            return std::nullopt;
+        }
+
+        size_t logical(std::vector<Instruction> &code, size_t pos, const size_t end, const int level) {
+            constexpr int RELATIONAL = 3;
+            const auto operand = [&](const size_t from) {
+                if (level < RELATIONAL) return logical(code, from, end, level + 1);
+                code.push_back({Op::OPERAND, static_cast<int>(from)});
+                const size_t next = expression(code, from, end);
+                code.push_back({Op::ROUND_TRIP});
+                return next;
+            };
+
+            pos = operand(pos);
+            while (pos < end) {
+                const auto op = binary(level, at(pos).value);
+                if (!op) break;
+                pos = operand(pos + 1);
+                code.push_back({*op});
+            }
+            return pos;
+        }
+
+        size_t terminator(size_t pos) const {
+            while (pos < tokens.size() && at(pos).type != TokenType::eof && at(pos).value != ";") ++pos;
+            if (pos >= tokens.size() || at(pos).type == TokenType::eof) unsupported("statement without ';'");
+            return pos;
+        }
+
+        // Index of the `}` matching the `{` at `pos`, counted like Parser::getScope
+        size_t closing(size_t pos) const {
+            int depth = 0;
+            do {
+                if (pos >= tokens.size() || at(pos).type == TokenType::eof) unsupported("unbalanced block");
+                if (at(pos).value == "{") ++depth;
+                else if (at(pos).value == "}") --depth;
+                ++pos;
+            } while (depth != 0);
+            return pos - 1;
+        }
+
+        // A slot for a local of an inlined call, which the body can't name
+        int hidden(const std::string &name) {
+            const auto [it, inserted] = hiddenSlots.try_emplace(name, static_cast<int>(program->slotNames.size()));
+            if (inserted) {
+                program->slotNames.push_back(name);
+                declared.push_back(true); // Never read before an inlined call declares it
+            }
+            return it->second;
+        }
+
+        // The program of callee `name` when its calls can be inlined: a run of statements without
+        // calls left, ending in its only return if it has one
+        const Program* inlineProgram(const std::string &name) {
+            if (const auto it = inlineable.find(name); it != inlineable.end()) return it->second.get();
+            auto &compiled = inlineable[name];
+            const auto callee = callees->find(name);
+            if (callee == callees->end() || std::ranges::find(chain, callee->second.body.get()) != chain.end() || callee->second.body.get() == &tokens) return nullptr;
+            std::shared_ptr<Program> body;
+            try {
+                auto nested = chain;
+                nested.push_back(&tokens);
+                body = Compiler(callee->second, kinds, callees, nullptr, signatures, {}, std::move(nested)).compile();
+            } catch (const Unsupported &) {
+                return nullptr;
+            } catch (const ErrInfo &) {
+                return nullptr;
+            }
+            const auto local = [](const int slot, const int freeVar) { return slot < 0 || freeVar < 0; };
+            for (size_t pc = 0; pc < body->code.size(); pc++) {
+                const Instruction &in = body->code[pc];
+                switch (in.op) {
+                    case Op::TRACE: case Op::DECLARE: case Op::DECLARE_ARITHMETIC: case Op::COPY:
+                    case Op::CHECK: case Op::ARGUMENT: case Op::DECLARE_RESULT:
+                        break;
+                    case Op::WRITE:
+                        if (!local(in.a, in.b)) return nullptr;
+                        break;
+                    case Op::RETURN: case Op::RETURN_CONSTANT: case Op::RETURN_ARITHMETIC: case Op::RETURN_VARIABLE:
+                        if (pc + 1 != body->code.size() || !local(in.a, in.b)) return nullptr;
+                        break;
+                    default:
+                        return nullptr; // Calls, branches
+                }
+            }
+            for (const auto &expression : body->expressions) {
+                if (std::ranges::any_of(expression, [](const Instruction &in) { return in.op == Op::LOCAL_OR_FREE; })) return nullptr;
+            }
+            for (const CallSite &site : body->calls) {
+                if (std::ranges::any_of(site.arguments, [&](const Argument &argument) { return !local(argument.slot, argument.free); })) return nullptr;
+            }
+            compiled = body;
+            return compiled.get();
+        }
+
+        // Replace calls[call] with the body of its callee when that pays off, and return the slot
+        // holding what the call returns, converted to the callee's return type
+        std::optional<int> inlineCall(const int call) {
+            if (callees == nullptr) return std::nullopt;
+            const std::string name = key(program->frees[program->calls[call].callee].path);
+            const Program* callee = inlineProgram(name);
+            if (callee == nullptr) return std::nullopt;
+            const auto started = std::chrono::steady_clock::now();
+            const Function &function = callees->at(name);
+            const size_t arguments = program->calls[call].arguments.size();
+            if (arguments != callee->parameters.size() || arguments != function.parameters.size()) return std::nullopt;
+            const size_t constants = std::ranges::count_if(program->calls[call].arguments, [](const Argument &argument) { return argument.constant.has_value(); });
+            const size_t size = instructions(*callee);
+            if (size > INLINE_CALL_COST + INLINE_CONSTANT_BONUS * constants || inlined + size > MAX_INLINED_INSTRUCTIONS) return std::nullopt;
+
+            // What the callee's free names are from here: a variable may well be one of ours
+            const size_t freeCount = program->frees.size();
+            const auto freeIndexes = freeIndex;
+            std::vector<std::pair<int, int>> frees;
+            try {
+                for (const Free &used : callee->frees) {
+                    if (used.path.size() == 1 && used.kind == Kind::VARIABLE) {
+                        frees.push_back(variable(used.path[0]));
+                    } else {
+                        frees.emplace_back(-1, free(used.path, used.kind));
+                        if (used.body) program->frees[frees.back().second].body = used.body;
+                    }
+                }
+                const Instruction &last = callee->code.empty() ? Instruction{Op::TRACE} : callee->code.back();
+                if (last.op == Op::RETURN_VARIABLE && last.a < 0 && frees[last.b].second >= 0) unsupported("returns a variable of the caller's scope");
+            } catch (const Unsupported &) {
+                program->frees.resize(freeCount);
+                freeIndex = freeIndexes;
+                return std::nullopt;
+            }
+            program->frees[program->calls[call].callee].body = function.body;
+            inlined += size;
+
+            std::vector<int> slots;
+            for (const auto &slotName : callee->slotNames) slots.push_back(hidden(name + "." + slotName));
+            size_t base = program->tokens->size();
+            for (const auto &body : program->inlined) base += body->size();
+            program->inlined.push_back(callee->tokens);
+            program->inlined.insert(program->inlined.end(), callee->inlined.begin(), callee->inlined.end());
+
+            const auto string = [&](const int index) { return intern(callee->strings[index]); };
+            const auto read = [&](const int slot, const int freeVar) { return slot >= 0 ? std::pair{slots[slot], -1} : frees[freeVar]; };
+            const auto expression = [&](const int index) {
+                std::vector<Instruction> code;
+                for (const Instruction &in : callee->expressions[index]) {
+                    switch (in.op) {
+                        case Op::NUMBER:
+                            program->numbers.push_back(callee->numbers[in.a]);
+                            code.push_back({Op::NUMBER, static_cast<int>(program->numbers.size() - 1)});
+                            break;
+                        case Op::LOCAL: code.push_back({Op::LOCAL, slots[in.a]}); break;
+                        case Op::FREE: {
+                            const auto [slot, freeVar] = frees[in.b];
+                            code.push_back({slot < 0 ? Op::FREE : freeVar < 0 ? Op::LOCAL : Op::LOCAL_OR_FREE, slot, freeVar});
+                            break;
+                        }
+                        case Op::DIVIDE: code.push_back({Op::DIVIDE, string(in.a)}); break;
+                        case Op::OPERAND: code.push_back({Op::OPERAND, in.a + static_cast<int>(base)}); break;
+                        default: code.push_back(in); break;
+                    }
+                }
+                return add(std::move(code), callee->origins[index] + base);
+            };
+            std::vector<int> sites;
+            for (const CallSite &site : callee->calls) {
+                CallSite copy{frees[site.callee].second, site.name, {}, site.token + base, site.traced, site.checked};
+                for (const Argument &argument : site.arguments) {
+                    const auto [slot, freeVar] = argument.constant ? std::pair{-1, -1} : read(argument.slot, argument.free);
+                    copy.arguments.push_back({slot, freeVar, argument.constant});
+                }
+                program->calls.push_back(std::move(copy));
+                sites.push_back(static_cast<int>(program->calls.size() - 1));
+            }
+
+            program->code.push_back({Op::CHECK, -1, call});
+            for (size_t i = 0; i < arguments; i++) {
+                program->code.push_back({Op::ARGUMENT, slots[callee->parameters[i]], call, static_cast<int>(i)});
+            }
+            const int result = hidden(name + ".return");
+            const std::string &type = function.returnType;
+            bool returned = false;
+            for (const Instruction &in : callee->code) {
+                switch (in.op) {
+                    case Op::TRACE: program->code.push_back({Op::TRACE, string(in.a), in.b}); break;
+                    case Op::DECLARE: program->code.push_back({Op::DECLARE, slots[in.a], string(in.b), string(in.c)}); break;
+                    case Op::DECLARE_ARITHMETIC: program->code.push_back({Op::DECLARE_ARITHMETIC, slots[in.a], expression(in.b), string(in.c)}); break;
+                    case Op::COPY: program->code.push_back({Op::COPY, slots[in.a], slots[in.b], string(in.c)}); break;
+                    case Op::CHECK: program->code.push_back({Op::CHECK, -1, sites[in.b]}); break;
+                    case Op::ARGUMENT: program->code.push_back({Op::ARGUMENT, slots[in.a], sites[in.b], in.c}); break;
+                    case Op::DECLARE_RESULT: program->code.push_back({Op::DECLARE_RESULT, slots[in.a], expression(in.b), in.c + static_cast<int>(base)}); break;
+                    case Op::WRITE: {
+                        const auto [slot, freeVar] = read(in.a, in.b);
+                        program->code.push_back({Op::WRITE, slot, freeVar});
+                        break;
+                    }
+                    case Op::RETURN_CONSTANT:
+                        program->code.push_back({Op::DECLARE, result, intern(coerce(callee->strings[in.b], type)), intern(type)});
+                        returned = true;
+                        break;
+                    case Op::RETURN_VARIABLE:
+                        program->code.push_back({Op::COPY, result, read(in.a, in.b).first, intern(type)});
+                        returned = true;
+                        break;
+                    case Op::RETURN_ARITHMETIC: {
+                        const int at = in.c + static_cast<int>(base);
+                        if (type == "int") { // Rounded once it has been checked
+                            const int value = hidden(name + ".value");
+                            program->code.push_back({Op::DECLARE_RESULT, value, expression(in.b), at});
+                            program->code.push_back({Op::COPY, result, value, intern(type)});
+                        } else {
+                            program->code.push_back({Op::DECLARE_RESULT, result, expression(in.b), at});
+                        }
+                        returned = true;
+                        break;
+                    }
+                    default: break; // RETURN
+                }
+            }
+            if (!returned) program->code.push_back({Op::DECLARE, result, intern(""), intern(type)});
+            ssa::record(ssa::Pass::INLINE, started, 1);
+            return result;
+        }
+
+        // `name(args)` or `ns::name(args)` at `pos`, which is left after the `)`
+        int callSite(size_t &pos, const bool traced) {
+            CallSite site;
+            site.traced = traced;
+            std::vector<std::string> path = {tokens[pos++].value};
+            if (!traced) {
+                while (at(pos).value == "::" && at(pos + 1).type == TokenType::IDENTIFIER) {
+                    path.push_back(at(pos + 1).value);
+                    pos += 2;
+                }
+            }
+            site.callee = free(path, Kind::FUNCTION);
+            site.name = path.back();
+
+            expect(pos++, "(");
+            if (at(pos).value != ")") {
+                site.arguments.push_back(argument(pos));
+                while (at(pos).value == ",") {
+                    ++pos;
+                    site.arguments.push_back(argument(pos));
+                }
+            }
+            expect(pos++, ")");
+            site.token = pos;
+            checked(site);
+            program->calls.push_back(std::move(site));
+            return static_cast<int>(program->calls.size() - 1);
+        }
+
+        // The type `argument` certainly has when the call is made, empty when it isn't known
+        [[nodiscard]] std::string typeOf(const Argument &argument) const {
+            if (argument.constant) return argument.constant->type;
+            if (argument.slot >= 0 && argument.free < 0 && static_cast<size_t>(argument.slot) < slotTypes.size()) return slotTypes[argument.slot];
+            return "";
+        }
+
+        // When the arguments of `site` pass the parameters of its callee whatever the call finds,
+        // check them now and pin the callee, calls finding another one are interpreted
+        void checked(CallSite &site) {
+            if (signatures == nullptr) return;
+            const auto callee = signatures->find(key(program->frees[site.callee].path));
+            if (callee == signatures->end()) return;
+            const std::vector<std::string> &parameters = callee->second.parameters;
+            for (size_t i = 0; i < site.arguments.size(); i++) {
+                const std::string type = typeOf(site.arguments[i]);
+                if (type.empty() || i >= parameters.size() || (parameters[i] != type && parameters[i] != "any")) return;
+            }
+            site.checked = true;
+            program->frees[site.callee].body = callee->second.body;
+        }
+
+        // Like abstract::_pcall_arg
+        Argument argument(size_t &pos) {
+            int cursor = static_cast<int>(pos);
+            int initialPos = cursor;
+            try {
+                if (auto [val, func] = combinators::_ror<ascii::noErr::_aname, ascii::noErr::_adigit, ascii::noErr::_pstring>(cursor, tokens); func == ascii::noErr::_aname) {
+                    pos = cursor;
+                    const auto [slot, freeVar] = variable(val);
+                    return {slot, freeVar, std::nullopt};
+                } else if (func == ascii::noErr::_adigit) {
+                    pos = cursor;
+                    return {-1, -1, Variable{"", "int", val, ""}};
+                } else if (func == ascii::noErr::_pstring) {
+                    pos = cursor;
+                    return {-1, -1, Variable{"", "string", ascii::_pstring(initialPos, unfilteredTokens), ""}};
+                }
+            } catch (const ErrInfo &) {}
+            unsupported("argument '" + at(pos).value + "'");
+        }
+
+        void trace(const std::string &message, const int times = 1) {
+            if (times > 0) program->code.push_back({Op::TRACE, intern(message), times});
+        }
+
+        // A string literal at `pos`, read the way abstract::_value reads it
+        std::string literal(size_t &pos) const {
+            int cursor = static_cast<int>(pos);
+            size_t close = pos + 1;
+            while (close < tokens.size() && tokens[close].type != TokenType::eof && tokens[close].value != "\"") ++close;
+            if (close >= tokens.size() || tokens[close].type == TokenType::eof) unsupported("unterminated string");
+            std::unordered_map<std::string, SymbolInfo> none;
+            std::string value = abstract::_value(cursor, tokens, "string", unfilteredTokens, none);
+            pos = cursor;
+            return value;
+        }
+
+        size_t declaration(size_t pos) {
+            trace("Parsing variable");
+            if (at(pos + 1).type != TokenType::IDENTIFIER) unsupported("variable name");
+            const int slot = program->slots.at(at(pos + 1).value);
+            expect(pos + 2, ":");
+            const std::string &type = at(pos + 3).value;
+            if (std::ranges::find(types, type) == types.end()) unsupported("type '" + type + "'");
+            expect(pos + 4, "=");
+            size_t value = pos + 5;
+
+            const Token &first = at(value);
+            const Kind kind = first.type == TokenType::IDENTIFIER ? kindOf(first.value) : Kind::ABSENT;
+            if (first.type == TokenType::LITERAL) {
+                expect(++value, ";"); // Folded by ctfe.h, already a `type`
+                program->code.push_back({Op::DECLARE, slot, intern(first.value), intern(type)});
+            } else if (kind == Kind::FUNCTION || kind == Kind::NAMESPACE) {
+                const int call = callSite(value, kind == Kind::FUNCTION);
+                expect(value, ";");
+                if (const auto result = inlineCall(call)) {
+                    program->code.push_back({Op::COPY, slot, *result, intern(type)});
+                } else {
+                    program->code.push_back({Op::DECLARE_CALL, slot, call, intern(type)});
+                }
+            } else if (type == "int" && !first.value.empty() && std::ranges::all_of(first.value, [](const char c) { return std::isdigit(c); })) {
+                expect(++value, ";");
+                program->code.push_back({Op::DECLARE, slot, intern(first.value), intern(type)});
+            } else if (type == "string" && first.value == "\"") {
+                const std::string text = literal(value);
+                expect(value, ";");
+                program->code.push_back({Op::DECLARE, slot, intern(text), intern(type)});
+            } else if (type == "any") {
+                const size_t end = terminator(value);
+                std::vector<Instruction> code;
+                if (expression(code, value, end) != end) unsupported("expression with trailing tokens");
+                program->code.push_back({Op::DECLARE_ARITHMETIC, slot, add(std::move(code), value), intern(type)});
+                // The interpreter leaves the expression to the statement loop, which steps over it
+                trace("Variable found", static_cast<int>(std::count_if(tokens.begin() + static_cast<long>(value), tokens.begin() + static_cast<long>(end),
+                    [](const Token &token) { return token.type == TokenType::IDENTIFIER; })));
+                value = end;
+            } else {
+                unsupported("initializer of a '" + type + "' variable");
+            }
+            declared[slot] = true;
+            slotTypes[slot] = type;
+            return value + 1;
+        }
+
+        size_t ret(const size_t pos) {
+            if (topLevel) unsupported("return outside a function");
+            trace("Parsing return");
+            const size_t value = pos + 1;
+            const size_t end = terminator(value);
+            const Token &first = at(value);
+            const Kind kind = first.type == TokenType::IDENTIFIER ? kindOf(first.value) : Kind::ABSENT;
+            if (end == value) {
+                program->code.push_back({Op::RETURN});
+            } else if (first.value == "\"") {
+                size_t cursor = value;
+                program->code.push_back({Op::RETURN_CONSTANT, -1, intern(literal(cursor))});
+            } else if (first.type == TokenType::LITERAL && end - value == 1) {
+                program->code.push_back({Op::RETURN_CONSTANT, -1, intern(first.value)});
+            } else if (kind == Kind::FUNCTION || kind == Kind::NAMESPACE) {
+                size_t cursor = value;
+                const int call = callSite(cursor, kind == Kind::FUNCTION); // The rest is never read
+                if (const auto result = inlineCall(call)) {
+                    program->code.push_back({Op::RETURN_VARIABLE, *result, -1});
+                } else {
+                    program->code.push_back({Op::RETURN_CALL, -1, call});
+                }
+            } else if (end - value == 1 && kind == Kind::VARIABLE) {
+                const auto [slot, freeVar] = variable(first.value);
+                program->code.push_back({Op::RETURN_VARIABLE, slot, freeVar});
+            } else {
+                std::vector<Instruction> code;
+                if (expression(code, value, end) != end) unsupported("expression with trailing tokens");
+                program->code.push_back({Op::RETURN_ARITHMETIC, -1, add(std::move(code), value), static_cast<int>(value)});
+            }
+            return end + 1;
+        }
+
+        size_t write(size_t pos) {
+            trace("Parsing extern");
+            expect(pos + 1, "\"");
+            if (at(pos + 2).value != "writescr") unsupported("extern \"" + at(pos + 2).value + "\"");
+            expect(pos + 3, "\"");
+            expect(pos + 4, "(");
+            const auto [slot, freeVar] = variable(at(pos + 5).value);
+            expect(pos + 6, ")");
+            expect(pos + 7, ";");
+            program->code.push_back({Op::WRITE, slot, freeVar});
+            return pos + 8;
+        }
+
+        size_t conditional(const size_t pos) {
+            trace("Parsing if");
+            expect(pos + 1, "(");
+            size_t close = pos + 2;
+            while (close < tokens.size() && tokens[close].type != TokenType::eof && tokens[close].value != ")") ++close;
+            if (at(close).value != ")") unsupported("unterminated condition");
+            const int test = condition(pos + 2, close);
+            expect(close + 1, "{");
+            const size_t thenEnd = closing(close + 1);
+            const bool hasElse = at(thenEnd + 1).value == "else";
+            size_t elseEnd = thenEnd;
+            if (hasElse) {
+                if (at(thenEnd + 2).value != "{") unsupported("else if");
+                elseEnd = closing(thenEnd + 2);
+                if (at(elseEnd + 1).value == "else") unsupported("second else");
+            }
+
+            // The then-block runs on a copy of the table, whatever it declares is gone afterwards
+            std::vector<int> saved;
+            for (size_t i = close + 2; i < thenEnd; i++) {
+                if (tokens[i].value == "var" && tokens[i].type == TokenType::KEYWORD && program->slots.contains(at(i + 1).value)) {
+                    saved.push_back(program->slots.at(at(i + 1).value));
+                }
+            }
+            program->blocks.push_back(saved);
+            const int block = static_cast<int>(program->blocks.size() - 1);
+            const auto before = declared;
+            const auto typesBefore = slotTypes;
+            auto typesAfter = slotTypes;
+            const auto thenBlock = [&] {
+                program->code.push_back({Op::ENTER, block});
+                statements(close + 2, thenEnd);
+                program->code.push_back({Op::LEAVE, block});
+                declared = before;
+                slotTypes = typesBefore;
+            };
+            // The else-block runs in the statement loop, in this scope
+            const auto elseBlock = [&] {
+                statements(thenEnd + 3, elseEnd);
+                declared = before; // Only declared when the branch was taken
+                for (size_t i = 0; i < slotTypes.size(); i++) {
+                    if (slotTypes[i] != typesBefore[i]) typesAfter[i].clear(); // Either type, depending on the branch
+                }
+                slotTypes = typesBefore;
+            };
+
+            // Whichever block comes first jumps over the other. When the profile has the then-block
+            // run more often and it doesn't always return, it goes last and skips the jump.
+            bool returns = false;
+            for (size_t i = close + 2, depth = 0; i < thenEnd; i++) {
+                if (tokens[i].value == "{") depth++;
+                else if (tokens[i].value == "}") depth--;
+                else if (depth == 0 && tokens[i].type == TokenType::KEYWORD && tokens[i].value == "return") returns = true;
+            }
+            const size_t branch = program->code.size();
+            const bool thenLast = hasElse && !returns && pgo::likely(record, pos + 2);
+            program->code.push_back({thenLast ? Op::BRANCH_IF : Op::BRANCH, -1, test});
+            thenLast ? elseBlock() : thenBlock();
+            if (hasElse) {
+                const size_t jump = program->code.size();
+                program->code.push_back({Op::JUMP});
+                program->code[branch].a = static_cast<int>(program->code.size());
+                thenLast ? thenBlock() : elseBlock();
+                program->code[jump].a = static_cast<int>(program->code.size());
+            } else {
+                program->code[branch].a = static_cast<int>(program->code.size());
+            }
+            slotTypes = std::move(typesAfter);
+            return elseEnd + 1;
+        }
+
+        void statements(size_t pos, const size_t end) {
+            while (pos < end && at(pos).type != TokenType::eof) {
+                const Token &token = at(pos);
+                if (token.type == TokenType::KEYWORD && token.value == "var") {
+                    pos = declaration(pos);
+                } else if (token.type == TokenType::KEYWORD && token.value == "return") {
+                    pos = ret(pos);
+                } else if (token.type == TokenType::KEYWORD && token.value == "extern") {
+                    pos = write(pos);
+                } else if (token.type == TokenType::KEYWORD && token.value == "if") {
+                    pos = conditional(pos);
+                } else if (token.type == TokenType::IDENTIFIER) {
+                    const Kind kind = kindOf(token.value);
+                    if (kind != Kind::FUNCTION && kind != Kind::NAMESPACE) unsupported("statement starting with '" + token.value + "'");
+                    trace(kind == Kind::FUNCTION ? "Function found" : "Namespace found");
+                    const int call = callSite(pos, kind == Kind::FUNCTION);
+                    expect(pos++, ";");
+                    if (!inlineCall(call)) program->code.push_back({Op::CALL, -1, call});
+                } else if (token.value == ";") {
+                    ++pos;
+                } else {
+                    unsupported("'" + token.value + "'");
+                }
+            }
+        }
+
+        Compiler(const Function &func, const std::unordered_map<std::string, Kind> &kinds, const Callees* callees, const pgo::Record* record,
+                 const Callees* signatures, std::vector<std::string> parameterTypes, std::vector<const std::vector<Token>*> chain)
+            : func(func), tokens(*func.body), unfilteredTokens(*func.unfilteredBody), kinds(kinds), first(0), last(tokens.size()), topLevel(false),
+              callees(callees), record(record), signatures(signatures), parameterTypes(std::move(parameterTypes)), chain(std::move(chain)) {}
+
+    public:
+        // `callees` are the functions whose calls may be inlined, see inlinable(), `record` what
+        // --profile-in has on `func`, `signatures` the functions calls to which are checked here,
+        // see signatures(). With `parameterTypes` the program is only run for calls whose
+        // arguments have those types (specialize.h).
+        Compiler(const Function &func, const std::unordered_map<std::string, Kind> &kinds, const Callees* callees = nullptr, const pgo::Record* record = nullptr,
+                 const Callees* signatures = nullptr, std::vector<std::string> parameterTypes = {})
+            : Compiler(func, kinds, callees, record, signatures, std::move(parameterTypes), {}) {}
+
+        // Top-level statements [first, last) of a file, `func` holding its tokens
+        Compiler(const Function &func, const std::unordered_map<std::string, Kind> &kinds, const size_t first, const size_t last, const Callees* callees = nullptr,
+                 const Callees* signatures = nullptr)
+            : func(func), tokens(*func.body), unfilteredTokens(*func.unfilteredBody), kinds(kinds), first(first), last(last), topLevel(true), callees(callees),
+              record(nullptr), signatures(signatures) {}
+
+        std::shared_ptr<Program> compile() {
+            if (first >= last || tokens.empty()) unsupported("empty body");
+            program->tokens = func.body;
+            const auto addSlot = [&](const std::string &name) {
+                if (const auto [it, inserted] = program->slots.try_emplace(name, static_cast<int>(program->slotNames.size())); inserted) {
+                    program->slotNames.push_back(name);
+                }
+                return program->slots.at(name);
+            };
+            for (const auto &parameter : func.localVariables) {
+                program->parameters.push_back(addSlot(parameter.identifier));
+            }
+            for (size_t i = first; i < last && i + 1 < tokens.size(); i++) {
+                if (tokens[i].type == TokenType::KEYWORD && tokens[i].value == "var" && at(i + 1).type == TokenType::IDENTIFIER) {
+                    addSlot(at(i + 1).value);
+                }
+            }
+            program->named = program->slotNames.size();
+            declared.assign(program->slotNames.size(), false);
+            for (const int slot : program->parameters) declared[slot] = true;
+            slotTypes.assign(program->slotNames.size(), "");
+            for (size_t i = 0; i < program->parameters.size() && i < func.parameters.size(); i++) {
+                // An argument has the type of its parameter unless that is `any`
+                if (i < parameterTypes.size()) slotTypes[program->parameters[i]] = parameterTypes[i];
+                else if (func.parameters[i] != "any") slotTypes[program->parameters[i]] = func.parameters[i];
+            }
+
+            statements(first, last);
+            return program;
+        }
+    };
+
+    // Native code for the expressions of `program`, one template per op
+    inline std::shared_ptr<const jit::Code> assemble(const Program &program, const std::string &name) {
+        std::vector<std::vector<uint8_t>> functions;
+        for (const auto &code : program.expressions) {
+            jit::Function function;
+            for (const Instruction &in : code) {
+                switch (in.op) {
+                    case Op::NUMBER: function.number(program.numbers[in.a]); break;
+                    case Op::LOCAL:
+                    case Op::FREE:
+                    case Op::LOCAL_OR_FREE: function.operand(); break;
+                    case Op::OPERAND: break; // Only read when the interpreter reports an error
+                    case Op::ROUND_TRIP: function.roundTrip(); break;
+                    case Op::ADD: function.add(); break;
+                    case Op::SUBTRACT: function.subtract(); break;
+                    case Op::MULTIPLY: function.multiply(); break;
+                    case Op::DIVIDE: function.divide(); break;
+                    case Op::LESS: function.less(); break;
+                    case Op::GREATER: function.greater(); break;
+                    case Op::LESS_EQUAL: function.lessEqual(); break;
+                    case Op::GREATER_EQUAL: function.greaterEqual(); break;
+                    case Op::EQUAL: function.equal(); break;
+                    case Op::NOT_EQUAL: function.notEqual(); break;
+                    case Op::AND: function.both(); break;
+                    case Op::OR: function.either(); break;
+                    default: function.unsupported(); break;
+                }
+            }
+            functions.push_back(function.finish());
+        }
+        return std::make_shared<const jit::Code>(functions, name);
+    }
+
+    // Compiles hot functions off the calling threads, one at a time
+    class Background {
+    private:
+        struct Job {
+            std::shared_ptr<Profile> profile;
+            Function function;
+            std::unordered_map<std::string, Kind> kinds;
+            Callees callees;
+            std::string name;
+            uint64_t calls;
+            bool log;
+            bool jit;
+            int level; // -O
+            bool dump;
+            Callees signatures;
+            std::vector<std::string> types; // Of the arguments a specialization is for, empty for the program of any call
+            size_t index = 0; // Of that specialization
+        };
+
+        std::mutex mutex;
+        std::condition_variable queued;
+        std::deque<Job> jobs;
+        std::thread thread;
+
+        void loop() {
+            context().exitOnError = false; // A body the parser helpers reject just stays interpreted
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock lock(mutex);
+                    queued.wait(lock, [this] { return !jobs.empty(); });
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+
+                const auto start = std::chrono::steady_clock::now();
+                std::shared_ptr<Program> program;
+                std::string reason;
+                try {
+                    program = Compiler(job.function, job.kinds, &job.callees, job.profile->recorded.get(), &job.signatures, job.types).compile();
+                    ssa::optimize(*program, job.name, job.level, job.dump);
+                    if (job.jit && jit::supported()) program->native = assemble(*program, job.name);
+                    program->feedback = quicken::analyze(*program);
+                    pgo::instrument(*program, job.profile->recorded.get(), job.profile->recording);
+                } catch (const Unsupported &unsupported) {
+                    reason = unsupported.reason;
+                } catch (const ErrInfo &) {
+                    reason = "malformed body";
+                }
+                if (program && !job.types.empty()) {
+                    specialize::Entry &entry = job.profile->specializations->entries[job.index];
+                    entry.compiled = program;
+                    entry.program.store(program.get(), std::memory_order_release);
+                } else if (program) {
+                    job.profile->compiled = program;
+                    job.profile->program.store(program.get(), std::memory_order_release);
+                }
+
+                if (job.log) {
+                    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                    std::ostringstream line; // Written at once, other threads may be logging too
+                    if (program) {
+                        line << "tier-up: " << job.name;
+                        if (job.types.empty()) line << " compiled after " << job.calls << " calls, ";
+                        else line << " specialized for (" << specialize::describe(job.types) << "), ";
+                        line << instructions(*program) << " instructions";
+                        if (program->native) line << ", " << program->native->compiled() << " of " << program->expressions.size() << " expressions native";
+                        line << " in " << elapsed.count() << "us\n";
+                    } else {
+                        line << "tier-up: " << job.name << " stays interpreted, " << reason << "\n";
+                    }
+                    std::cerr << line.str() << std::flush;
+                }
+            }
+        }
+
+        static Job build(const Function &function, const Scope &scope, const std::string &name, const uint64_t calls, const Options &options) {
+            Job job{function.profile, function, survey(function, scope), {}, name, calls, options.tierLog, options.jit, options.optimize, options.dumpIr, {}, {}};
+            if (options.optimize >= 1) {
+                job.callees = inlinable(job.kinds, scope);
+                job.signatures = signatures(job.kinds, scope);
+            }
+            return job;
+        }
+
+        void push(Job job) {
+            {
+                std::lock_guard lock(mutex);
+                jobs.push_back(std::move(job));
+            }
+            queued.notify_one();
+        }
+
+    public:
+        Background() : thread([this] { loop(); }) {
+            scheduler::threadsStarted = true;
+        }
+
+        void enqueue(const Function &function, const Scope &scope, const std::string &name, const uint64_t calls, const Options &options) {
+            push(build(function, scope, name, calls, options));
+        }
+
+        // Compile specialization `index` of `function`, whose entry has the argument types
+        void specialize(const Function &function, const Scope &scope, const std::string &name, const size_t index, const Options &options) {
+            Job job = build(function, scope, name, 0, options);
+            job.types = function.profile->specializations->entries[index].types;
+            job.index = index;
+            push(std::move(job));
+        }
+    };
+
+    // Created on first use and never torn down, like the worker pool
+    inline Background& background() {
+        static Background* instance = new Background();
+        return *instance;
+    }
+
+    // The program compiled for calls of `func` with the types of `arguments`, nullptr until there
+    // is one. The first call with types worth a specialization of their own queues it, see specialize.h.
+    inline const Program* specialization(const Function &func, const std::vector<Variable> &arguments, const Scope &scope, const std::string &name) {
+        Profile &profile = *func.profile;
+        const Options &options = context().options;
+        if (options.maxSpecializations == 0 || options.optimize < 1 || profile.body != nullptr || std::ranges::find(func.parameters, "any") == func.parameters.end()) {
+            return nullptr;
+        }
+        std::call_once(profile.specialized, [&] {
+            profile.specializations = std::make_shared<specialize::Specializations>(options.maxSpecializations);
+        });
+        specialize::Specializations &table = *profile.specializations;
+        if (const specialize::Entry* entry = table.find(arguments)) return entry->program.load(std::memory_order_acquire);
+        if (!specialize::worthwhile(func, arguments)) return nullptr;
+        if (const auto index = table.claim(arguments)) background().specialize(func, scope, name, *index, options);
+        return nullptr;
+    }
+
+    using Dispatch = Variable (*)(const Function &func, const std::vector<Variable> &arguments, const Scope &scope, const std::string &filePath, const std::string &name);
+
+    // Runs a compiled body. Besides run(), the bytecode loop, its public members are what bodies
+    // compiled ahead of time (aot.h) are made of: one call per instruction, pc being its index.
+    class Machine {
+    private:
+        Frame &frame;
+        const Program &program;
+        const Function &func;
+        const std::string &filePath;
+        const std::string &name;
+        Dispatch dispatch;
+        size_t operand = 0; // Token of the condition operand being evaluated
+        std::vector<std::vector<std::optional<Variable>>> saved; // Slots shadowed by the then-blocks being run
+
+        void raise(const ErrorType type, const size_t at, const std::string &expected) const {
+            const Token &token = tiering::token(program, at);
+            ErrInfo errInfo = { type, token.line, token.column, context().unfilteredLines[token.line], expected, context().currfilePath };
+            error::gen(errInfo);
+        }
+
+        [[nodiscard]] const Variable& variable(const int slot, const int freeVar) const {
+            if (slot >= 0 && frame.slots[slot]) return *frame.slots[slot];
+            return *frame.frees[freeVar].variable;
+        }
+
+        // Native code for expressions[index] when its operands all read as numbers and nothing goes
+        // wrong, otherwise nullopt and the expression is evaluated below, errors included
+        std::optional<double> native(const int index) {
+            const jit::Entry entry = program.native ? program.native->entry(index) : nullptr;
+            if (entry == nullptr) return std::nullopt;
+            std::vector<double> operands;
+            try {
+                for (const Instruction &in : program.expressions[index]) {
+                    switch (in.op) {
+                        case Op::LOCAL: operands.push_back(local(in.a)); break;
+                        case Op::FREE: operands.push_back(freeVariable(in.b)); break;
+                        case Op::LOCAL_OR_FREE: operands.push_back(localOrFree(in.a, in.b)); break;
+                        default: break;
+                    }
+                }
+            } catch (const std::exception &) {
+                return std::nullopt;
+            }
+            double result;
+            jit::failed = false;
+            if (entry(operands.data(), &result) != 0 || jit::failed) return std::nullopt;
+            return result;
+        }
+
+        // Operand of a quickened expression, false when it doesn't read as a number
+        [[nodiscard]] bool number(const quicken::Step &step, double &value) const {
+            const Variable* read = nullptr;
+            switch (step.load) {
+                case Op::NUMBER: value = program.numbers[step.a]; return true;
+                case Op::LOCAL: if (frame.slots[step.a]) read = &*frame.slots[step.a]; break;
+                case Op::FREE: read = frame.frees[step.b].variable; break;
+                default: read = &variable(step.a, step.b); break;
+            }
+            return read != nullptr && quicken::parse(read->value, value);
+        }
+
+        [[nodiscard]] bool chain(const quicken::Chain &steps, double &value) const {
+            if (!number(steps[0], value)) return false;
+            for (size_t i = 1; i < steps.size(); i++) {
+                double right;
+                if (!number(steps[i], right)) return false;
+                switch (steps[i].op) {
+                    case Op::ADD: value += right; break;
+                    case Op::SUBTRACT: value -= right; break;
+                    case Op::MULTIPLY: value *= right; break;
+                    default:
+                        if (right == 0) return false; // Raised by the generic code
+                        value /= right;
+                        break;
+                }
+            }
+            return true;
+        }
+
+        // expressions[index] as its superinstruction once it is quickened, nullopt when it isn't or
+        // a guard fails
+        std::optional<double> quick(const int index) const {
+            if (!program.feedback) return std::nullopt;
+            quicken::Site &site = program.feedback->sites[index];
+            if (site.state.load(std::memory_order_relaxed) != quicken::State::QUICK) return std::nullopt;
+            const quicken::Form &form = *site.form;
+            double left;
+            double right;
+            if (chain(form.left, left)) {
+                if (form.compare == Op::NUMBER) return left;
+                if (chain(form.right, right)) {
+                    left = std::stod(std::to_string(left));
+                    right = std::stod(std::to_string(right));
+                    switch (form.compare) {
+                        case Op::LESS: return left < right ? 1.0 : 0.0;
+                        case Op::GREATER: return left > right ? 1.0 : 0.0;
+                        case Op::LESS_EQUAL: return left <= right ? 1.0 : 0.0;
+                        case Op::GREATER_EQUAL: return left >= right ? 1.0 : 0.0;
+                        case Op::EQUAL: return left == right ? 1.0 : 0.0;
+                        default: return left != right ? 1.0 : 0.0;
+                    }
+                }
+            }
+            quicken::deoptimize(site);
+            return std::nullopt;
+        }
+
+        // Throws what RecursiveDescentParser would have caught
+        double evaluate(const int index) {
+            if (const auto result = quick(index)) return *result;
+            if (const auto result = native(index)) return *result;
+            const std::vector<Instruction> &code = program.expressions[index];
+            std::vector<double> stack;
+            stack.reserve(code.size());
+            const auto pop = [&stack] {
+                const double value = stack.back();
+                stack.pop_back();
+                return value;
+            };
+            for (const Instruction &in : code) {
+                switch (in.op) {
+                    case Op::NUMBER: stack.push_back(program.numbers[in.a]); break;
+                    case Op::LOCAL: stack.push_back(local(in.a)); break;
+                    case Op::FREE: stack.push_back(freeVariable(in.b)); break;
+                    case Op::LOCAL_OR_FREE: stack.push_back(localOrFree(in.a, in.b)); break;
+                    case Op::OPERAND: setOperand(in.a); break;
+                    case Op::ROUND_TRIP: stack.back() = std::stod(std::to_string(stack.back())); break;
+                    default: {
+                        const double right = pop();
+                        double &left = stack.back();
+                        switch (in.op) {
+                            case Op::ADD: left += right; break;
+                            case Op::SUBTRACT: left -= right; break;
+                            case Op::MULTIPLY: left *= right; break;
+                            case Op::DIVIDE: left = quotient(left, right, in.a); break;
+                            case Op::LESS: left = left < right ? 1.0 : 0.0; break;
+                            case Op::GREATER: left = left > right ? 1.0 : 0.0; break;
+                            case Op::LESS_EQUAL: left = left <= right ? 1.0 : 0.0; break;
+                            case Op::GREATER_EQUAL: left = left >= right ? 1.0 : 0.0; break;
+                            case Op::EQUAL: left = left == right ? 1.0 : 0.0; break;
+                            case Op::NOT_EQUAL: left = left != right ? 1.0 : 0.0; break;
+                            case Op::AND: left = left != 0.0 && right != 0.0 ? 1.0 : 0.0; break;
+                            case Op::OR: left = left != 0.0 || right != 0.0 ? 1.0 : 0.0; break;
+                            default: break;
+                        }
+                    }
+                }
+            }
+            if (program.feedback) quicken::observe(program.feedback->sites[index]);
+            return stack.back();
+        }
+
+        [[nodiscard]] const Variable& argument(const Argument &argument) const {
+            return argument.constant ? *argument.constant : variable(argument.slot, argument.free);
+        }
+
+        // Trace and type check the arguments of a call, like Parser::parseFunctionCall
+        void check(const CallSite &site, const Function &callee, const std::vector<Variable> &arguments) const {
+            if (site.traced) {
+                std::cout << "Parsing function call" << std::endl;
+                std::cout << "Function call to " << site.name << " with arguments: ";
+                for (const auto &arg : arguments) {
+                    std::cout << arg.value << " ";
+                }
+                std::cout << std::endl;
+            }
+            if (site.checked) return;
+            for (size_t i = 0; i < arguments.size(); i++) {
+                if (i >= callee.parameters.size() || (callee.parameters[i] != arguments[i].type && callee.parameters[i] != "any")) {
+                    raise(ErrorType::INVALID_TYPE, site.token, "Valid type");
+                }
+            }
+        }
+
+        [[nodiscard]] std::vector<Variable> arguments(const CallSite &site) const {
+            std::vector<Variable> values;
+            values.reserve(site.arguments.size());
+            for (const Argument &passed : site.arguments) values.push_back(argument(passed));
+            return values;
+        }
+
+        Variable call(const CallSite &site) {
+            const Function &callee = std::get<Function>(*frame.frees[site.callee].symbol);
+            const std::vector<Variable> values = arguments(site);
+            check(site, callee, values);
+            return dispatch(callee, values, Scope{&frame, frame.parent.table}, filePath, site.name);
+        }
+
+        Variable returned(const std::string &value) const {
+            return Variable{"", func.returnType, coerce(value, func.returnType), ""};
+        }
+
+    public:
+        Machine(Frame &frame, const Function &func, const std::string &filePath, const std::string &name, const Dispatch dispatch)
+            : frame(frame), program(frame.program), func(func), filePath(filePath), name(name), dispatch(dispatch) {}
+
+        // Expression operands, throwing like std::stod when they don't read as a number
+        [[nodiscard]] double local(const int slot) const { return std::stod(frame.slots[slot]->value); }
+        [[nodiscard]] double freeVariable(const int freeVar) const { return std::stod(frame.frees[freeVar].variable->value); }
+        [[nodiscard]] double localOrFree(const int slot, const int freeVar) const { return std::stod(variable(slot, freeVar).value); }
+
+        void setOperand(const size_t at) {
+            operand = at;
+        }
+
+        // left / right, the error message is strings[message]
+        [[nodiscard]] double quotient(const double left, const double right, const int message) const {
+            if (right == 0) throw std::runtime_error(program.strings[message]);
+            return left / right;
+        }
+
+        // The value RecursiveDescentParser::parse() would have produced for `evaluate()`
+        template <typename Evaluate>
+        std::string arithmetic(Evaluate &&evaluate) {
+            try {
+                return std::to_string(evaluate());
+            } catch (const std::exception &e) {
+                return "Error: " + std::string(e.what());
+            }
+        }
+
+        // Whether the condition `evaluate()` holds, raised like ConditionParser when it fails
+        template <typename Evaluate>
+        bool holds(Evaluate &&evaluate) {
+            try {
+                return evaluate() != 0.0;
+            } catch (const std::exception &) {
+                raise(ErrorType::INVALID_BOOL, operand, "Valid condition");
+            }
+            return false;
+        }
+
+        // DECLARE_ARITHMETIC at `pc`, with its expression already evaluated
+        void declare(const size_t pc, std::string value) {
+            const Instruction &in = program.code[pc];
+            frame.slots[in.a] = Variable{program.slotNames[in.a], program.strings[in.c], std::move(value), name};
+        }
+
+        // DECLARE_RESULT at `pc`, with its expression already evaluated
+        void result(const size_t pc, std::string value) {
+            const Instruction &in = program.code[pc];
+            if (value.starts_with("Error: ")) {
+                raise(ErrorType::EXPECTED_VALID_EXPRESSION, in.c, value.substr(7));
+            }
+            frame.slots[in.a] = Variable{program.slotNames[in.a], "any", std::move(value), name};
+        }
+
+        // RETURN_ARITHMETIC at `pc`, with its expression already evaluated
+        Variable returnArithmetic(const size_t pc, const std::string &value) {
+            if (value.starts_with("Error: ")) {
+                raise(ErrorType::EXPECTED_VALID_EXPRESSION, program.code[pc].c, value.substr(7));
+            }
+            return returned(value);
+        }
+
+        // Running off the end of the body
+        [[nodiscard]] Variable finish() const {
+            return returned("");
+        }
+
+        // Any instruction but the branches and the ones holding an expression, a value once it returns
+        std::optional<Variable> step(const size_t pc) {
+            const Instruction &in = program.code[pc];
+            switch (in.op) {
+                case Op::TRACE:
+                    for (int i = 0; i < in.b; i++) std::cout << program.strings[in.a] << std::endl;
+                    break;
+                case Op::DECLARE:
+                    frame.slots[in.a] = Variable{program.slotNames[in.a], program.strings[in.c], program.strings[in.b], name};
+                    break;
+                case Op::DECLARE_CALL: {
+                    std::string value = coerce(call(program.calls[in.b]).value, program.strings[in.c]);
+                    frame.slots[in.a] = Variable{program.slotNames[in.a], program.strings[in.c], std::move(value), name};
+                    break;
+                }
+                case Op::COPY:
+                    frame.slots[in.a] = Variable{program.slotNames[in.a], program.strings[in.c], coerce(frame.slots[in.b]->value, program.strings[in.c]), name};
+                    break;
+                case Op::CHECK: {
+                    const CallSite &site = program.calls[in.b];
+                    check(site, std::get<Function>(*frame.frees[site.callee].symbol), arguments(site));
+                    break;
+                }
+                case Op::ARGUMENT:
+                    frame.slots[in.a] = argument(program.calls[in.b].arguments[in.c]);
+                    break;
+                case Op::CALL:
+                    call(program.calls[in.b]);
+                    break;
+                case Op::WRITE: {
+                    const std::string &message = variable(in.a, in.b).value;
+                    std::lock_guard lock(*context().outputMutex);
+                    *context().output << message << "\n";
+                    break;
+                }
+                case Op::RETURN:
+                    return returned("");
+                case Op::RETURN_CONSTANT:
+                    return returned(program.strings[in.b]);
+                case Op::RETURN_VARIABLE:
+                    return returned(variable(in.a, in.b).value);
+                case Op::RETURN_CALL:
+                    return returned(call(program.calls[in.b]).value);
+                case Op::ENTER: {
+                    auto &copies = saved.emplace_back();
+                    for (const int slot : program.blocks[in.a]) copies.push_back(frame.slots[slot]);
+                    break;
+                }
+                case Op::LEAVE: {
+                    const auto &block = program.blocks[in.a];
+                    for (size_t i = 0; i < block.size(); i++) frame.slots[block[i]] = std::move(saved.back()[i]);
+                    saved.pop_back();
+                    break;
+                }
+                default:
+                    break;
+            }
+            return std::nullopt;
+        }
+
+        Variable run() {
+            size_t pc = 0;
+            while (pc < program.code.size()) {
+                const Instruction &in = program.code[pc];
+                switch (in.op) {
+                    case Op::DECLARE_ARITHMETIC:
+                        declare(pc, arithmetic([&] { return evaluate(in.b); }));
+                        break;
+                    case Op::DECLARE_RESULT:
+                        result(pc, arithmetic([&] { return evaluate(in.b); }));
+                        break;
+                    case Op::RETURN_ARITHMETIC:
+                        return returnArithmetic(pc, arithmetic([&] { return evaluate(in.b); }));
+                    case Op::BRANCH:
+                    case Op::BRANCH_IF: {
+                        const bool held = holds([&] { return evaluate(in.b); });
+                        if (program.counts) program.counts->count(in.b, held);
+                        if (held == (in.op == Op::BRANCH_IF)) {
+                            pc = in.a;
+                            continue;
+                        }
+                        break;
+                    }
+                    case Op::JUMP:
+                        pc = in.a;
+                        continue;
+                    default:
+                        if (auto value = step(pc)) return std::move(*value);
+                        break;
+                }
+                pc++;
+            }
+            return finish();
+        }
+    };
+
+    // Run `program` for a call of `func`, nullopt when what it was compiled against has changed
+    // and the call has to be interpreted. `body` is the program compiled ahead of time, if any.
+    inline std::optional<Variable> run(const Program &program, const Function &func, const std::vector<Variable> &arguments, const Scope &scope,
+                                       const std::string &filePath, const std::string &name, const Dispatch dispatch, const Body body = nullptr) {
+        if (arguments.size() != program.parameters.size()) return std::nullopt;
+        Frame frame{program, std::vector<std::optional<Variable>>(program.slotNames.size()), {}, scope};
+        frame.frees.reserve(program.frees.size());
+        for (const Free &free : program.frees) {
+            const Binding binding = resolve(scope, free.path);
+            if (!matches(binding, free)) return std::nullopt;
+            frame.frees.push_back(binding);
+        }
+        for (size_t i = 0; i < arguments.size(); i++) {
+            frame.slots[program.parameters[i]] = arguments[i];
+        }
+        set_filePath(filePath);
+        Machine machine(frame, func, filePath, name, dispatch);
+        return body != nullptr ? body(machine) : machine.run();
+    }
+
+    // Top-level statements [begin, end) of the file whose tokens `file` holds, compiled against
+    // `table` and optimized, nullptr when the compiler doesn't handle them
+    inline std::shared_ptr<Program> compileTopLevel(const Function &file, const size_t begin, const size_t end, const Table &table, const Options &options) {
+        const bool exitOnError = std::exchange(context().exitOnError, false);
+        try {
+            auto kinds = survey(*file.body, begin, end, Scope{nullptr, &table});
+            const Callees callees = options.optimize >= 1 ? inlinable(kinds, Scope{nullptr, &table}) : Callees{};
+            const Callees checked = options.optimize >= 1 ? signatures(kinds, Scope{nullptr, &table}) : Callees{};
+            auto program = Compiler(file, kinds, begin, end, &callees, &checked).compile();
+            context().exitOnError = exitOnError;
+            ssa::optimize(*program, "top level at line " + std::to_string((*file.body)[begin].line), options.optimize, options.dumpIr, true);
+            return program;
+        } catch (const Unsupported &) {
+        } catch (const ErrInfo &) {} // Raised again when the statements are interpreted
+        context().exitOnError = exitOnError;
+        return nullptr;
+    }
+
+    // Run a program of top-level statements on `table`, then declare there what it left declared.
+    // False when `table` changed since it was compiled, and nothing ran.
+    inline bool runTopLevel(const Program &program, const Function &file, Table &table, const std::string &filePath, const std::string &scope, const Dispatch dispatch) {
+        Frame frame{program, std::vector<std::optional<Variable>>(program.slotNames.size()), {}, Scope{nullptr, &table}};
+        for (const Free &free : program.frees) {
+            const Binding binding = resolve(frame.parent, free.path);
+            if (!matches(binding, free)) return false;
+            frame.frees.push_back(binding);
+        }
+        set_filePath(filePath);
+        Machine(frame, file, filePath, scope, dispatch).run();
+        for (size_t i = 0; i < program.named; i++) {
+            if (frame.slots[i]) table[program.slotNames[i]] = std::move(*frame.slots[i]);
+        }
+        return true;
+    }
+
+    // Everything a compiled body depends on. A body compiled ahead of time only runs on a program
+    // with the digest it was generated from.
+    inline uint64_t digest(const Program &program) {
+        uint64_t hash = 14695981039346656037ull;
+        const auto mix = [&hash](const uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                hash ^= (value >> (8 * i)) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        };
+        const auto text = [&mix](const std::string &value) {
+            mix(value.size());
+            for (const char c : value) mix(static_cast<unsigned char>(c));
+        };
+        const auto code = [&mix](const std::vector<Instruction> &instructions) {
+            mix(instructions.size());
+            for (const Instruction &in : instructions) {
+                mix(static_cast<uint64_t>(in.op));
+                mix(static_cast<uint64_t>(in.a));
+                mix(static_cast<uint64_t>(in.b));
+                mix(static_cast<uint64_t>(in.c));
+            }
+        };
+        code(program.code);
+        for (const auto &expression : program.expressions) code(expression);
+        for (const double number : program.numbers) mix(std::bit_cast<uint64_t>(number));
+        for (const auto &string : program.strings) text(string);
+        for (const auto &slot : program.slotNames) text(slot);
+        for (const int parameter : program.parameters) mix(static_cast<uint64_t>(parameter));
+        for (const Free &free : program.frees) {
+            for (const auto &part : free.path) text(part);
+            mix(static_cast<uint64_t>(free.kind));
+            mix(free.body != nullptr);
+        }
+        mix(program.named);
+        for (const CallSite &site : program.calls) {
+            mix(static_cast<uint64_t>(site.callee));
+            text(site.name);
+            for (const Argument &argument : site.arguments) {
+                mix(static_cast<uint64_t>(argument.slot));
+                mix(static_cast<uint64_t>(argument.free));
+                if (argument.constant) {
+                    text(argument.constant->type);
+                    text(argument.constant->value);
+                }
+            }
+            mix(site.token);
+            mix(site.traced);
+            mix(site.checked);
+        }
+        for (const auto &block : program.blocks) {
+            mix(block.size());
+            for (const int slot : block) mix(static_cast<uint64_t>(slot));
+        }
+        return hash;
+    }
+
+    // A function body compiled to C++ by --emit-cpp, see aot.h
+    struct Precompiled {
+        const char* path; // File declaring the function
+        const char* name;
+        uint64_t digest;
+        Body body;
+    };
+
+    // Filled once at start-up by an executable built with --build, read-only afterwards
+    inline std::unordered_map<std::string, const Precompiled*>& precompiled() {
+        static std::unordered_map<std::string, const Precompiled*> registry;
+        return registry;
+    }
+
+    inline const Precompiled* findPrecompiled(const std::string &path, const std::string &name) {
+        auto &registry = precompiled();
+        if (registry.empty()) return nullptr;
+        const auto it = registry.find(path + '\n' + name);
+        return it == registry.end() ? nullptr : it->second;
+    }
+
+    // On the first call of a precompiled function, compile its program against the caller's scope
+    // and publish it with the precompiled body when it is the program the body was made from.
+    // Otherwise the function goes through the usual tiers. A function --profile-in found hot is
+    // compiled on its first call too, like the background compiler would once it got hot again.
+    inline void prepare(const Function &func, const Scope &scope) {
+        Profile &profile = *func.profile;
+        std::call_once(profile.prepared, [&] {
+            const auto start = std::chrono::steady_clock::now();
+            const Options &options = context().options;
+            const pgo::Record* record = profile.precompiled == nullptr ? profile.recorded.get() : nullptr; // Bodies are generated without one
+            std::shared_ptr<Program> program;
+            const bool exitOnError = std::exchange(context().exitOnError, false);
+            try {
+                auto kinds = survey(func, scope);
+                const Callees callees = options.optimize >= 1 ? inlinable(kinds, scope) : Callees{};
+                const Callees checked = options.optimize >= 1 ? signatures(kinds, scope) : Callees{};
+                program = Compiler(func, kinds, &callees, record, &checked).compile();
+            } catch (const Unsupported &) {
+            } catch (const ErrInfo &) {}
+            context().exitOnError = exitOnError;
+            if (!program) return;
+            ssa::optimize(*program, func.identifier, options.optimize, options.dumpIr);
+            if (profile.precompiled != nullptr) {
+                if (digest(*program) != profile.precompiled->digest) return;
+                profile.body = profile.precompiled->body;
+            } else {
+                if (options.jit && jit::supported()) program->native = assemble(*program, func.identifier);
+                program->feedback = quicken::analyze(*program);
+                pgo::instrument(*program, record, profile.recording);
+            }
+            profile.compiled = program;
+            profile.program.store(program.get(), std::memory_order_release);
+
+            if (options.tierLog && profile.precompiled == nullptr) {
+                const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                std::ostringstream line;
+                line << "tier-up: " << func.identifier << " compiled on its first call, " << record->calls << " calls in the profile, "
+                     << instructions(*program) << " instructions in " << elapsed.count() << "us\n";
+                std::cerr << line.str() << std::flush;
+            }
+        });
+    }
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+// Whole-program dead symbol elimination.
+//
+// Every identifier chain (`a`, `ns::a`, `ns::inner::a`) that appears in the entry file's
+// top-level code is a root. Entry functions become live once referenced, and their bodies
+// add more roots. So do the bodies of live merged functions: calls bind dynamically, a module
+// can call a function the entry file declares. Nothing is dropped until every top-level merge
+// of the entry file is done and the whole program is known. Merged namespaces are then swept:
+// functions and variables that no live reference can resolve to are dropped, as are namespaces
+// left without any live member, and so are the entry functions nothing live refers to.
+namespace treeshake {
+    using Path = std::vector<std::string>;
+    using Table = std::unordered_map<std::string, SymbolInfo>;
+
+    struct Report {
+        size_t symbols = 0; // Number of functions, variables and namespaces dropped.
+    };
+
+    // Count a symbol and, for namespaces, everything nested inside it
+    inline size_t count(const SymbolInfo &info) {
+        size_t symbols = 1;
+        if (const auto *ns = std::get_if<Namespace>(&info)) {
+            for (const auto &symbol : *ns->symbols | std::views::values) {
+                symbols += count(symbol);
+            }
+        }
+        return symbols;
+    }
+
+    // Collect every identifier chain in [begin, end), e.g. `std :: print` becomes {"std", "print"}
+    inline std::vector<Path> references(const std::vector<Token> &tokens, size_t begin, size_t end) {
+        std::vector<Path> paths;
+        for (size_t i = begin; i < end; i++) {
+            if (tokens[i].type != TokenType::IDENTIFIER) continue;
+
+            Path path = {tokens[i].value};
+            while (i + 2 < end && tokens[i + 1].value == "::" && tokens[i + 2].type == TokenType::IDENTIFIER) {
+                path.push_back(tokens[i + 2].value);
+                i += 2;
+            }
+            paths.push_back(std::move(path));
+        }
+        return paths;
+    }
+
+    class Pass {
+    private:
+        std::vector<Path> roots;
+        std::unordered_map<std::string, std::vector<Path>> functionRefs; // Of every entry function
+        std::unordered_set<std::string> liveFunctions;
+        std::vector<std::string> aliases; // Of the top-level merges done so far
+        size_t merges = 0;                // Top-level merges in the entry file
+        bool settled = false;             // Whether liveFunctions is final
+        Report report;
+
+        void mark(const Namespace &ns, const Path &path, size_t index, std::unordered_set<const SymbolInfo*> &live, std::vector<std::pair<const Namespace*, const Function*>> &pending) const {
+            if (index >= path.size()) return;
+
+            const auto it = ns.symbols->find(path[index]);
+            if (it == ns.symbols->end()) return;
+
+            if (const auto *inner = std::get_if<Namespace>(&it->second)) {
+                live.insert(&it->second);
+                mark(*inner, path, index + 1, live, pending);
+            } else if (live.insert(&it->second).second) {
+                if (const auto *func = std::get_if<Function>(&it->second)) {
+                    pending.emplace_back(&ns, func);
+                }
+            }
+        }
+
+        // Rebind `ns` to what is marked in it, returns false if the namespace ended up empty. The
+        // loaded module stays as it was, other merges of it share it.
+        bool sweep(Namespace &ns, const std::unordered_set<const SymbolInfo*> &live) {
+            std::unordered_map<std::string, SymbolInfo> kept;
+            for (const auto &[name, symbol] : *ns.symbols) {
+                SymbolInfo copy = symbol;
+                bool keep = live.contains(&symbol);
+                if (keep) {
+                    if (auto *inner = std::get_if<Namespace>(&copy)) {
+                        keep = sweep(*inner, live);
+                    }
+                }
+
+                if (keep) {
+                    kept.emplace(name, std::move(copy));
+                    continue;
+                }
+
+                report.symbols += count(symbol);
+            }
+            ns.symbols = std::make_shared<const std::unordered_map<std::string, SymbolInfo>>(std::move(kept));
+            return !ns.symbols->empty();
+        }
+
+        // Everything reachable from the roots, with every merged namespace of `table` known. Entry
+        // functions can be called from module code and then see that module's names unqualified.
+        void settle(Table &table) {
+            std::vector<Namespace*> namespaces;
+            std::unordered_map<std::string, Namespace*> byAlias;
+            for (const auto &alias : aliases) {
+                const auto it = table.find(alias);
+                if (it == table.end()) continue;
+                if (auto *ns = std::get_if<Namespace>(&it->second); ns != nullptr && byAlias.emplace(alias, ns).second) namespaces.push_back(ns);
+            }
+
+            std::unordered_set<const SymbolInfo*> live;
+            std::vector<std::pair<const Namespace*, const Function*>> pending;
+            std::vector<std::pair<Path, bool>> work; // And whether it was named inside a function body
+            for (const auto &path : roots) work.emplace_back(path, false);
+            while (!work.empty() || !pending.empty()) {
+                while (!work.empty()) {
+                    const auto [path, inBody] = std::move(work.back());
+                    work.pop_back();
+                    if (const auto it = byAlias.find(path.front()); it != byAlias.end()) mark(*it->second, path, 1, live, pending);
+                    if (inBody) {
+                        for (const Namespace* ns : namespaces) mark(*ns, path, 0, live, pending);
+                    }
+                    if (const auto it = functionRefs.find(path.front()); it != functionRefs.end() && liveFunctions.insert(path.front()).second) {
+                        for (const auto &ref : it->second) work.emplace_back(ref, true);
+                    }
+                }
+
+                // A live merged function keeps alive whatever its body can name, from inside its
+                // module or from wherever it is called
+                while (!pending.empty()) {
+                    const auto [owner, func] = pending.back();
+                    pending.pop_back();
+                    for (auto &path : references(*func->body, 0, func->body->size())) {
+                        mark(*owner, path, 0, live, pending);
+                        work.emplace_back(std::move(path), true);
+                    }
+                }
+            }
+
+            for (Namespace* ns : namespaces) sweep(*ns, live);
+            for (const auto &name : functionRefs | std::views::keys) {
+                const auto it = table.find(name);
+                if (liveFunctions.contains(name) || it == table.end() || !std::holds_alternative<Function>(it->second)) continue;
+                table.erase(it);
+                report.symbols++;
+            }
+            settled = true;
+        }
+
+    public:
+        explicit Pass(const std::vector<Token> &tokens) {
+            // Split the entry file into top-level code and function bodies
+            size_t segment = 0;
+            const auto topLevel = [&](const size_t begin, const size_t end) {
+                std::ranges::move(references(tokens, begin, end), std::back_inserter(roots));
+                for (size_t i = begin; i < end; i++) {
+                    if (tokens[i].type == TokenType::KEYWORD && tokens[i].value == "merge") ++merges;
+                }
+            };
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (tokens[i].value != "fn" || tokens[i].type != TokenType::KEYWORD || i + 1 >= tokens.size()) continue;
+
+                topLevel(segment, i);
+
+                const std::string name = tokens[i + 1].value;
+                size_t end = i + 1;
+                while (end < tokens.size() && tokens[end].value != "{") ++end;
+                int depth = 0;
+                for (; end < tokens.size(); end++) {
+                    if (tokens[end].value == "{") ++depth;
+                    else if (tokens[end].value == "}" && --depth == 0) break;
+                }
+
+                auto refs = references(tokens, i + 2, std::min(end, tokens.size()));
+                std::ranges::move(refs, std::back_inserter(functionRefs[name]));
+                i = end;
+                segment = end + 1;
+            }
+            if (segment < tokens.size()) {
+                topLevel(segment, tokens.size());
+            }
+
+            if (merges == 0) {
+                Table none;
+                settle(none);
+            }
+        }
+
+        // Entry functions are all kept until the program is known
+        [[nodiscard]] bool keepFunction(const std::string &name) const {
+            return !settled || liveFunctions.contains(name);
+        }
+
+        // Called when an entry function is skipped rather than declared
+        void dropFunction() {
+            report.symbols++;
+        }
+
+        // Called once the top-level merge binding `alias` in `table` is done. After the last one
+        // the program is swept.
+        void merged(const std::string &alias, Table &table) {
+            if (settled) return;
+            aliases.push_back(alias);
+            if (aliases.size() == merges) settle(table);
+        }
+
+        [[nodiscard]] const Report& getReport() const {
+            return report;
+        }
+    };
+}
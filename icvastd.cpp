@@ -0,0 +1,74 @@
+#include "headers/icvast.h"
+#include "headers/icvastd.h"
+
+void usage(const std::string &program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --socket <path>   Unix socket to listen on / connect to (default /tmp/icvastd.sock)" << std::endl;
+    std::cout << "  --workers <n>     Number of worker threads (default: one per CPU)" << std::endl;
+    std::cout << "  --queue <n>       Requests that may wait for a worker before new ones are rejected" << std::endl;
+    std::cout << "  --max-request <n> Largest inline source accepted, in bytes (default 16 MiB)" << std::endl;
+    std::cout << "  --timeout <s>     Seconds a client has to send its whole request (default 5)" << std::endl;
+    std::cout << "  --preload <file>  Script run once at start-up, its merges stay loaded" << std::endl;
+    std::cout << "  --run <file>      Submit a script to a running daemon" << std::endl;
+    std::cout << "  --eval <file>     Submit the contents of a file (or - for stdin) as inline source" << std::endl;
+    std::cout << "  --stats           Print the daemon's latency histogram and counters" << std::endl;
+}
+
+int main(const int argc, char* argv[])
+{
+    std::signal(SIGSEGV, signalHandler);
+
+#if defined(_WIN32)
+    std::cerr << "icvastd: " << bold_red << "error: " << reset << "not supported on this platform" << std::endl;
+    return 1;
+#else
+    icvastd::Config config;
+    std::vector<std::string> preload;
+    std::string request;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            config.socket = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            config.workers = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--queue" && i + 1 < argc) {
+            config.queueCapacity = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--max-request" && i + 1 < argc) {
+            config.maxRequestBytes = std::max(1ll, std::atoll(argv[++i]));
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            config.timeout = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--preload" && i + 1 < argc) {
+            preload.emplace_back(argv[++i]);
+        } else if (arg == "--run" && i + 1 < argc) {
+            request = "RUN " + std::filesystem::absolute(argv[++i]).string() + "\n";
+        } else if (arg == "--eval" && i + 1 < argc) {
+            const std::string file = argv[++i];
+            std::ostringstream source;
+            if (file == "-") {
+                source << std::cin.rdbuf();
+            } else {
+                source << std::ifstream(file).rdbuf();
+            }
+            request = "EVAL " + std::to_string(source.str().size()) + "\n" + source.str();
+        } else if (arg == "--stats") {
+            request = "STATS\n";
+        } else {
+            std::cerr << "icvastd: " << bold_red << "error: " << reset << "unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!request.empty()) {
+        return icvastd::submit(config.socket, request);
+    }
+
+    Interpreter interpreter;
+    for (const auto &script : preload) {
+        if (const int code = driver::runFile(interpreter, script); code != 0) return code;
+    }
+    return icvastd::Server(config).run();
+#endif
+}
@@ -135,7 +135,7 @@ fi
 printf "${CYAN}\n🌀 Compiling with ${GXX} (C++20 mode)...${RESET}"
 spin='-\|/'
 i=0
-if ! "$GXX" main.cpp -o InterpretedCVast -std=c++20 2> compile.log; then
+if ! "$GXX" main.cpp -o InterpretedCVast -std=c++20 -pthread 2> compile.log; then
     printf "\r${RED}✗ Compilation failed!${RESET}\n"
     printf "${YELLOW}Error log:${RESET}\n"
     cat compile.log
@@ -1,46 +1,4 @@
-#include <cstring>
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <vector>
-#include <algorithm>
-#include <map>
-#include <csignal>
-#include <thread>
-#include <future>
-#include <variant>
-#include <optional>
-#include <filesystem>
-#include <unordered_map>
-#include <cstdlib>
-#include <ranges>
-#include <stdexcept>
-#include <string>
-#include <utility>
-#include <vector>
-#include <set>
-#include <memory>
-#include <sstream>
-#include <cctype>
-#include <unordered_set>
-
-#if defined(_WIN32)
-    #include <windows.h>
-#else
-    #include <unistd.h>
-    #include <csignal>
-#endif
-
-#define ICVAST_VERSION "1.0.0"
-
-#define INTERPRETER_NAME "ICVAST"
-
-#define PARGS (pos, *tokens);
-
-#include "headers/errh.h"
-#include "headers/lexer.h"
-#include "headers/parsers.h"
-#include "headers/parser.h"
+#include "headers/icvast.h"
 
 void printTree(const std::vector<Token>& tokenizedList)
 {
@@ -59,6 +17,9 @@ void printTree(const std::vector<Token>& tokenizedList)
             case TokenType::NUMBER:
                 std::cout << "NUMBER";
             break;
+            case TokenType::LITERAL:
+                std::cout << "LITERAL";
+            break;
             default:
                 std::cout << "UNKNOWN";
             break;
@@ -71,40 +32,5 @@ int main(const int argc, char* argv[])
 {
     std::signal(SIGSEGV, signalHandler);
 
-    std::string input;
-    for (size_t i = 1; i < argc; i++)
-    {
-        if (std::string(argv[i]) == "-h" || std::string(argv[i]) == "--help") {
-            std::cout << "Usage: " << argv[0] << " [input file]" << std::endl;
-            continue;
-        } else if (std::string(argv[i]) == "-v" || std::string(argv[i]) == "--version") {
-            std::cout << "ICVAST version " << ICVAST_VERSION << std::endl;
-            continue;
-        }
-        input = argv[i];
-    }
-    if (input.empty()) {
-        // TODO: instead of this, in the future, we can use a REPL
-        std::cerr << INTERPRETER_NAME << ": ";
-        std::cerr << "\033[31m" << "error: " << "No input file provided" << "\033[0m" << std::endl;
-        return 0;
-    }
-
-    std::cout << "Input: " << input << std::endl;
-
-
-
-    auto file = std::fstream(input, std::ios::in);
-
-    auto lex = Lexer(file);
-
-    auto [tokenizedOutput, unfilteredTokens, unfilteredLines] = lex.tokenize();
-
-    // printTree(tokenizedOutput);
-
-    set_unfilteredLines(unfilteredLines);
-
-    Parser parser(std::make_unique<std::vector<Token>>(tokenizedOutput), std::make_unique<std::vector<Token>>(unfilteredTokens), input);
-    parser.parse();
-    return 0;
+    return driver::run(std::vector<std::string>(argv, argv + argc));
 }
@@ -1,14 +1,218 @@
+import os
+import shutil
 import subprocess
+import tempfile
+
+# The interpreter under test, `cvast` from the PATH unless CVAST names another one
+CVAST = os.environ.get("CVAST", "cvast")
+HERE = os.path.dirname(os.path.abspath(__file__))
+# Lines the interpreter prints about what it is doing, everything else is the script's output
+TRACE = ("Input: ", "Parsing ", "Function call to ", "stdlib path: ", "Function found", "Variable found", "Namespace found")
+
+
+def run(*args, stdlib=None):
+    env = dict(os.environ)
+    env.setdefault("CVAST_STDLIB", os.path.join(HERE, "..", "stdlib"))
+    env.setdefault("CVAST_INCLUDE", os.path.join(HERE, "..", "headers"))
+    if stdlib is not None:
+        env["CVAST_STDLIB"] = os.path.join(HERE, stdlib)
+    return subprocess.run([CVAST, *args], cwd=HERE, capture_output=True, text=True, env=env)
+
+
+def printed(result):
+    return [line for line in result.stdout.splitlines() if not line.startswith(TRACE)]
+
+
+# A diagnostic's code, as the process exit status
+def failed(result, code, message):
+    assert result.returncode == code % 256, result.stderr
+    assert message in result.stderr, result.stderr
+
 
 # TODO: make it visually appealing and add more tests
 def test_merge():
     # Run merge script
-    test = subprocess.run(["cvast", "cvFiles/merge_test.cv"])
+    test = run("cvFiles/merge_test.cv")
     # Check the exit code
     assert test.returncode == 0
 
     # Run fn script
-    test = subprocess.run(["cvast", "cvFiles/fn_test.cv"])
+    test = run("cvFiles/fn_test.cv")
 
-test_merge()
 
+def test_directory_merge():
+    test = run("cvFiles/dir_merge_test.cv", stdlib="cvFiles/stdlib")
+    assert test.returncode == 0, test.stderr
+    assert printed(test) == ["9.000000", "27.000000"]
+
+    test = run("cvFiles/dir_merge_clash_test.cv", stdlib="cvFiles/stdlib")
+    failed(test, 4003, "'area' in")
+
+
+def test_tree_shake():
+    # cb::run calls the entry file's callback, only `dead` and cb::unused can go
+    plain = run("cvFiles/tree_shake_test.cv", stdlib="cvFiles/stdlib")
+    test = run("--tree-shake", "cvFiles/tree_shake_test.cv", stdlib="cvFiles/stdlib")
+    assert test.returncode == 0, test.stderr
+    assert printed(test) == printed(plain) == ["hi", "hi"]
+    assert "Tree shaking removed 2 symbol(s)" in test.stderr
+
+
+def test_snapshot():
+    with tempfile.TemporaryDirectory() as directory:
+        image = os.path.join(directory, "app.snap")
+        test = run("--snapshot-out", image, "cvFiles/snapshot_test.cv", stdlib="cvFiles/stdlib")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == ["8.000000", "16.000000"]
+
+        # The merge comes from the image
+        test = run("--snapshot-in", image, "cvFiles/snapshot_test.cv", stdlib="cvFiles/stdlib")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == ["8.000000", "16.000000"]
+        assert "stdlib path: " not in test.stdout
+
+        # An image of another program is ignored
+        test = run("--snapshot-in", image, "cvFiles/dir_merge_test.cv", stdlib="cvFiles/stdlib")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == ["9.000000", "27.000000"]
+        assert "Snapshot was taken from a different program" in test.stderr
+        assert "stdlib path: " in test.stdout
+
+        # and so is one whose merged modules changed since
+        stdlib = os.path.join(directory, "stdlib")
+        shutil.copytree(os.path.join(HERE, "cvFiles", "stdlib"), stdlib)
+        test = run("--snapshot-out", image, "cvFiles/snapshot_test.cv", stdlib=stdlib)
+        assert printed(test) == ["8.000000", "16.000000"]
+        square = os.path.join(stdlib, "shapes", "square.cv")
+        with open(square) as module:
+            source = module.read()
+        with open(square, "w") as module:
+            module.write(source.replace("n * n", "n * 3"))
+        test = run("--snapshot-in", image, "cvFiles/snapshot_test.cv", stdlib=stdlib)
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == ["8.000000", "12.000000"]
+        assert "changed since the snapshot was taken" in test.stderr
+
+
+def test_spawn():
+    # An error inside a task is raised again at the join
+    test = run("cvFiles/spawn_test.cv")
+    failed(test, 3012, "Invalid boolean error")
+    assert printed(test) == ["1", "joined"]
+
+    # and when nobody joins it, once the script is done
+    test = run("cvFiles/spawn_unjoined_test.cv")
+    failed(test, 3012, "Invalid boolean error")
+    assert printed(test) == ["spawned"]
+
+
+def test_par_reduce():
+    # Partial results are combined in index order, `last` keeps the final iteration's
+    for options in ([], ["-O2"], ["--tier-threshold", "1", "--jit"]) * 3:
+        test = run(*options, "cvFiles/par_reduce_test.cv")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == ["2666466670000.000000", "399960001.000000", "7"]
+
+
+def test_channels():
+    # What was sent before the close is still received, then values are empty and sending fails
+    test = run("cvFiles/channel_test.cv")
+    failed(test, 3003, "Send on a closed channel")
+    assert printed(test) == ["10", "20", "30", "", "closed"]
+
+
+def test_tiers():
+    # Every tier and optimization level prints, traces and fails exactly like the interpreter
+    reference = run("--tier-threshold", "0", "-O0", "cvFiles/tiers_test.cv")
+    failed(reference, 3012, "Invalid boolean error")
+    assert printed(reference) == ["610.000000", "1.500000", "11.000000", "21.000000", "9.000000", "101.000000", "3.000000"]
+    for options in (["--tier-threshold", "1", "-O1"], ["--tier-threshold", "1", "-O2"], ["-O2", "--jit"],
+                    ["--tier-threshold", "1", "-O2", "--jit"], ["--tier-threshold", "0", "-O2"]):
+        test = run(*options, "cvFiles/tiers_test.cv")
+        assert (test.returncode, test.stdout, test.stderr) == (reference.returncode, reference.stdout, reference.stderr), options
+
+
+def test_build():
+    reference = run("cvFiles/tiers_test.cv")
+    with tempfile.TemporaryDirectory() as directory:
+        source = os.path.join(directory, "tiers.cpp")
+        test = run("--emit-cpp", source, "cvFiles/tiers_test.cv")
+        assert test.returncode == 0, test.stderr
+        with open(source) as generated:
+            assert "// fib in " in generated.read()
+
+        executable = os.path.join(directory, "tiers")
+        test = run("--build", executable, "cvFiles/tiers_test.cv")
+        assert test.returncode == 0, test.stderr
+        test = subprocess.run([executable], cwd=HERE, capture_output=True, text=True)
+        # The executable names the script by the absolute path it was built from
+        absolute = os.path.join(HERE, "cvFiles")
+        assert test.returncode == reference.returncode, test.stderr
+        assert test.stdout.replace(absolute, "cvFiles") == reference.stdout
+        assert test.stderr.replace(absolute, "cvFiles") == reference.stderr
+
+
+def test_constants():
+    test = run("cvFiles/const_test.cv")
+    assert test.returncode == 0, test.stderr
+    assert printed(test) == ["const name", "hello there", "42", "const name", "hello there", "42",
+                             "9.000000", "1585.000000", "1586.000000", "120.000000", "16.000000"]
+    # Computed when `table` and `pick` were declared, not when they run
+    for call in test.stdout.split("Function call to table")[1:]:
+        assert "Function call to sq with arguments: 12" not in call and "Function call to fact" not in call
+    assert "Function call to fact" not in test.stdout.split("Function call to pick")[1]
+
+    for case, message in ((1, "Expected 'Constant expression'"),
+                          (2, "Expected 'Call of a pure function with constant arguments'"),
+                          (3, "Expected 'static call as an initializer or return value'"),
+                          (4, "Expected 'Call of a pure function'")):
+        test = run("cvFiles/const_error_%d.cv" % case)
+        failed(test, 2009, message)
+
+
+def test_memoize():
+    test = run("--memo-stats", "cvFiles/memo_test.cv")
+    assert test.returncode == 0, test.stderr
+    # `other` sees another helper, so its call of twice runs the body
+    assert printed(test) == ["832040.000000", "side", "side", "4.000000", "6.000000", "4.000000"]
+    assert "memoize: noisy is not pure, its results are not cached" in test.stderr
+    assert "fib: 28 of 59 calls hit (47.4%), 31 result(s) kept" in test.stderr
+    assert "twice: 1 of 2 calls hit (50.0%), 1 result(s) kept" in test.stderr
+
+
+def test_profile():
+    expected = ["144.000000", "1.500000", "11.000000", "21.000000"]
+    with tempfile.TemporaryDirectory() as directory:
+        profile = os.path.join(directory, "app.prof")
+        test = run("--tier-threshold", "2", "--profile-out", profile, "cvFiles/pgo_test.cv")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == expected
+
+        # Functions that were hot are compiled on their first call, at every level
+        for options in (["-O0"], ["-O1"], ["-O2", "--jit"]):
+            test = run("--tier-log", "--tier-threshold", "2", *options, "--profile-in", profile, "--profile-out", profile, "cvFiles/pgo_test.cv")
+            assert test.returncode == 0, test.stderr
+            assert printed(test) == expected
+            assert "tier-up: fib compiled on its first call, 465 calls in the profile" in test.stderr, options
+
+        # A profile that can't be read is ignored
+        with open(profile, "w") as damaged:
+            damaged.write("garbage\n")
+        test = run("--tier-log", "--tier-threshold", "2", "--profile-in", profile, "cvFiles/pgo_test.cv")
+        assert test.returncode == 0, test.stderr
+        assert printed(test) == expected
+        assert "calls in the profile" not in test.stderr
+
+
+test_merge()
+test_directory_merge()
+test_tree_shake()
+test_snapshot()
+test_spawn()
+test_par_reduce()
+test_channels()
+test_tiers()
+test_build()
+test_constants()
+test_memoize()
+test_profile()